@@ -0,0 +1,273 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "allocator.h"
+
+/* Every block is preceded by a header holding the requested size; 16 bytes
+ * keep the payload aligned like malloc's. */
+#define ALLOCATOR_HEADER_SIZE 16
+
+/* Size classes 16, 32, ..., 512 bytes are pooled */
+#define ALLOCATOR_CLASSES 6
+#define ALLOCATOR_MIN_CLASS_SIZE 16
+#define ALLOCATOR_MAX_CLASS_SIZE (ALLOCATOR_MIN_CLASS_SIZE << (ALLOCATOR_CLASSES - 1))
+
+/* Pools grow by one slab at a time */
+#define ALLOCATOR_SLAB_SIZE (64 * 1024)
+
+struct epdf_allocator_s
+{
+    fz_alloc_context context; /**< Functions handed to mupdf */
+    epdf_memory_stats_t stats; /**< Statistics */
+    void* free_lists[ALLOCATOR_CLASSES]; /**< Free blocks per size class */
+    void* slabs; /**< Slabs of the pools, linked through their first word */
+};
+
+G_LOCK_DEFINE_STATIC(default_limit);
+static uint64_t default_limit = 0;
+
+static int
+size_class(size_t size)
+{
+    if (size > ALLOCATOR_MAX_CLASS_SIZE) {
+        return -1;
+    }
+
+    int c = 0;
+    for (size_t class_size = ALLOCATOR_MIN_CLASS_SIZE; class_size < size; class_size <<= 1) {
+        c++;
+    }
+
+    return c;
+}
+
+static bool
+pool_refill(epdf_allocator_t* allocator, int c)
+{
+    char* slab = malloc(ALLOCATOR_SLAB_SIZE);
+    if (slab == NULL) {
+        return false;
+    }
+
+    *(void**) slab    = allocator->slabs;
+    allocator->slabs  = slab;
+    allocator->stats.pooled += ALLOCATOR_SLAB_SIZE;
+
+    /* the first 16 bytes link the slab, each block is a header and payload */
+    const size_t block_size = ALLOCATOR_HEADER_SIZE + (ALLOCATOR_MIN_CLASS_SIZE << c);
+    for (size_t offset = 16; offset + block_size <= ALLOCATOR_SLAB_SIZE; offset += block_size) {
+        void* block = slab + offset + ALLOCATOR_HEADER_SIZE;
+        *(void**) block = allocator->free_lists[c];
+        allocator->free_lists[c] = block;
+    }
+
+    return true;
+}
+
+/* Whether live may grow by size bytes; live exceeds a limit lowered below it */
+static bool
+allocator_fits(const epdf_allocator_t* allocator, size_t size)
+{
+    if (allocator->stats.limit == 0) {
+        return true;
+    }
+
+    return allocator->stats.live <= allocator->stats.limit &&
+        size <= allocator->stats.limit - allocator->stats.live;
+}
+
+static void*
+allocator_malloc(void* user, size_t size)
+{
+    epdf_allocator_t* allocator = user;
+
+    if (size > SIZE_MAX - ALLOCATOR_HEADER_SIZE) {
+        return NULL;
+    }
+
+    if (allocator_fits(allocator, size) == false) {
+        allocator->stats.failed++;
+        return NULL;
+    }
+
+    char* block = NULL;
+    const int c = size_class(size);
+    if (c >= 0) {
+        if (allocator->free_lists[c] == NULL && pool_refill(allocator, c) == false) {
+            return NULL;
+        }
+        block = allocator->free_lists[c];
+        allocator->free_lists[c] = *(void**) block;
+        block -= ALLOCATOR_HEADER_SIZE;
+    } else {
+        block = malloc(ALLOCATOR_HEADER_SIZE + size);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    *(size_t*) block = size;
+
+    allocator->stats.live += size;
+    allocator->stats.peak  = MAX(allocator->stats.peak, allocator->stats.live);
+    allocator->stats.allocations++;
+
+    return block + ALLOCATOR_HEADER_SIZE;
+}
+
+static void
+allocator_free(void* user, void* ptr)
+{
+    epdf_allocator_t* allocator = user;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    char* block = (char*) ptr - ALLOCATOR_HEADER_SIZE;
+    const size_t size = *(size_t*) block;
+    allocator->stats.live -= size;
+
+    const int c = size_class(size);
+    if (c >= 0) {
+        *(void**) ptr = allocator->free_lists[c];
+        allocator->free_lists[c] = ptr;
+    } else {
+        free(block);
+    }
+}
+
+static void*
+allocator_realloc(void* user, void* ptr, size_t size)
+{
+    epdf_allocator_t* allocator = user;
+
+    if (ptr == NULL) {
+        return allocator_malloc(user, size);
+    }
+
+    if (size == 0) {
+        allocator_free(user, ptr);
+        return NULL;
+    }
+
+    if (size > SIZE_MAX - ALLOCATOR_HEADER_SIZE) {
+        return NULL;
+    }
+
+    char* block = (char*) ptr - ALLOCATOR_HEADER_SIZE;
+    const size_t old_size = *(size_t*) block;
+    const int old_class   = size_class(old_size);
+    const int new_class   = size_class(size);
+
+    if (size > old_size && allocator_fits(allocator, size - old_size) == false) {
+        allocator->stats.failed++;
+        return NULL;
+    }
+
+    /* stays in the same pooled block */
+    if (old_class >= 0 && old_class == new_class) {
+        *(size_t*) block = size;
+        allocator->stats.live = allocator->stats.live - old_size + size;
+        allocator->stats.peak = MAX(allocator->stats.peak, allocator->stats.live);
+        return ptr;
+    }
+
+    /* both unpooled */
+    if (old_class < 0 && new_class < 0) {
+        char* new_block = realloc(block, ALLOCATOR_HEADER_SIZE + size);
+        if (new_block == NULL) {
+            return NULL;
+        }
+        *(size_t*) new_block = size;
+        allocator->stats.live = allocator->stats.live - old_size + size;
+        allocator->stats.peak = MAX(allocator->stats.peak, allocator->stats.live);
+        return new_block + ALLOCATOR_HEADER_SIZE;
+    }
+
+    /* moves between pool and heap */
+    void* new_ptr = allocator_malloc(user, size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, MIN(old_size, size));
+    allocator_free(user, ptr);
+
+    return new_ptr;
+}
+
+epdf_allocator_t*
+epdf_allocator_new(uint64_t limit)
+{
+    epdf_allocator_t* allocator = calloc(1, sizeof(epdf_allocator_t));
+    if (allocator == NULL) {
+        return NULL;
+    }
+
+    allocator->context     = (fz_alloc_context) { allocator, allocator_malloc, allocator_realloc, allocator_free };
+    allocator->stats.limit = limit;
+
+    return allocator;
+}
+
+void
+epdf_allocator_free(epdf_allocator_t* allocator)
+{
+    if (allocator == NULL) {
+        return;
+    }
+
+    while (allocator->slabs != NULL) {
+        void* next = *(void**) allocator->slabs;
+        free(allocator->slabs);
+        allocator->slabs = next;
+    }
+
+    free(allocator);
+}
+
+fz_alloc_context*
+epdf_allocator_get_context(epdf_allocator_t* allocator)
+{
+    return allocator != NULL ? &allocator->context : NULL;
+}
+
+void
+epdf_allocator_set_limit(epdf_allocator_t* allocator, uint64_t limit)
+{
+    if (allocator == NULL) {
+        return;
+    }
+
+    allocator->stats.limit = limit;
+}
+
+void
+epdf_allocator_get_stats(epdf_allocator_t* allocator, epdf_memory_stats_t* stats)
+{
+    if (allocator == NULL || stats == NULL) {
+        return;
+    }
+
+    *stats = allocator->stats;
+}
+
+void
+epdf_allocator_set_default_limit(uint64_t limit)
+{
+    G_LOCK(default_limit);
+    default_limit = limit;
+    G_UNLOCK(default_limit);
+}
+
+uint64_t
+epdf_allocator_get_default_limit(void)
+{
+    G_LOCK(default_limit);
+    const uint64_t limit = default_limit;
+    G_UNLOCK(default_limit);
+
+    return limit;
+}
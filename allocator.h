@@ -0,0 +1,67 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Creates an allocator to be plugged into a mupdf context. It accounts every
+ * allocation, serves small allocations from size-class pools and refuses
+ * allocations that would exceed the limit, which mupdf reports as
+ * FZ_ERROR_MEMORY after scavenging its store.
+ *
+ * The allocator does no locking on its own: mupdf calls it with FZ_LOCK_ALLOC
+ * held, readers of the statistics have to hold that lock as well.
+ *
+ * @param limit Hard limit of live bytes or 0 for no limit
+ * @return The allocator or NULL if an error occurred
+ */
+epdf_allocator_t* epdf_allocator_new(uint64_t limit);
+
+/**
+ * Frees the allocator and its pools. All contexts using it have to be dropped
+ * before.
+ *
+ * @param allocator The allocator
+ */
+void epdf_allocator_free(epdf_allocator_t* allocator);
+
+/**
+ * Returns the allocation functions for fz_new_context
+ *
+ * @param allocator The allocator
+ * @return The alloc context
+ */
+fz_alloc_context* epdf_allocator_get_context(epdf_allocator_t* allocator);
+
+/**
+ * Sets the hard limit of live bytes
+ *
+ * @param allocator The allocator
+ * @param limit The limit in bytes or 0 for no limit
+ */
+void epdf_allocator_set_limit(epdf_allocator_t* allocator, uint64_t limit);
+
+/**
+ * Returns the statistics of the allocator
+ *
+ * @param allocator The allocator
+ * @param stats Filled with the statistics
+ */
+void epdf_allocator_get_stats(epdf_allocator_t* allocator, epdf_memory_stats_t* stats);
+
+/**
+ * Sets the memory limit for documents opened from now on
+ *
+ * @param limit The limit in bytes or 0 for no limit
+ */
+EPDF_PLUGIN_API void epdf_allocator_set_default_limit(uint64_t limit);
+
+/**
+ * Returns the memory limit for newly opened documents
+ *
+ * @return The limit in bytes or 0 for no limit
+ */
+EPDF_PLUGIN_API uint64_t epdf_allocator_get_default_limit(void);
+
+#endif // ALLOCATOR_H
@@ -0,0 +1,616 @@
+/* Benchmarks for epdf's native code paths.
+
+   Usage: bench encode [-n ITERATIONS] [FILE.pdf]
+          bench run [-n ITERATIONS] [-s SCALES] [-p PAGES] [-q QUERY] FILE|DIR...
+          bench export [-s SCALE] [-f png|ppm] [-j WORKERS] [-r FIRST-LAST] FILE.pdf PREFIX
+
+   encode: compares PNG encoding against handing out the rendered buffer as
+   PPM (P6) for typical page sizes. With FILE.pdf the first page is rendered
+   at each size and the total latency includes rasterization, otherwise a
+   synthetic page is used.
+
+   run: times document open, page init, rendering at each of the comma
+   separated SCALES, text extraction and search for QUERY on the first PAGES
+   pages of every PDF of the corpus, through the mupdf backend. Prints p50,
+   p95 and p99 per operation and the peak RSS as JSON.
+
+   export: writes the pages FIRST to LAST (1-based, all by default) to
+   PREFIX-<number>.png or .ppm with WORKERS threads (one per core by
+   default), or streams them to stdout in page order if PREFIX is "-".
+   Prints the throughput and the peak RSS as JSON to stderr. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <mupdf/fitz.h>
+
+#include "document.h"
+#include "page-export.h"
+#include "image.h"
+#include "page.h"
+#include "plugin.h"
+
+typedef struct bench_size_s
+{
+    const char* name;
+    double dpi;
+} bench_size_t;
+
+/* A4 at common screen resolutions, including HiDPI */
+static const bench_size_t sizes[] = {
+    { "a4@96dpi",  96.0 },
+    { "a4@144dpi", 144.0 },
+    { "a4@192dpi", 192.0 },
+    { "a4@288dpi", 288.0 },
+};
+
+static int
+compare_double(const void* a, const void* b)
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static double
+median(double* values, unsigned int n)
+{
+    qsort(values, n, sizeof(double), compare_double);
+    return values[n / 2];
+}
+
+/* White page with dark runs roughly like lines of text */
+static void
+fill_synthetic_page(epdf_image_buffer_t* image)
+{
+    memset(image->data, 0xff, (size_t) image->rowstride * image->height);
+
+    GRand* rand = g_rand_new_with_seed(42);
+    for (unsigned int y = image->height / 10; y < image->height * 9 / 10; y += 24) {
+        for (unsigned int row = y; row < y + 12 && row < image->height; row++) {
+            unsigned char* p = image->data + (size_t) row * image->rowstride;
+            for (unsigned int x = image->width / 10; x < image->width * 9 / 10; x++) {
+                if (g_rand_int_range(rand, 0, 3) == 0) {
+                    p[3 * x] = p[3 * x + 1] = p[3 * x + 2] = g_rand_int_range(rand, 0, 96);
+                }
+            }
+        }
+    }
+    g_rand_free(rand);
+}
+
+static epdf_image_buffer_t*
+render_page(fz_context* ctx, fz_page* page, double dpi)
+{
+    const fz_matrix ctm = fz_scale(dpi / 72.0, dpi / 72.0);
+    const fz_irect bbox = fz_round_rect(fz_transform_rect(fz_bound_page(ctx, page), ctm));
+
+    epdf_image_buffer_t* image = epdf_image_buffer_create(bbox.x1 - bbox.x0, bbox.y1 - bbox.y0);
+    fz_pixmap* pixmap = fz_new_pixmap_with_bbox_and_data(ctx, fz_device_rgb(ctx), bbox, NULL, 0, image->data);
+    fz_clear_pixmap_with_value(ctx, pixmap, 0xff);
+    fz_device* device = fz_new_draw_device(ctx, fz_identity, pixmap);
+    fz_run_page(ctx, page, device, ctm, NULL);
+    fz_close_device(ctx, device);
+    fz_drop_device(ctx, device);
+    fz_drop_pixmap(ctx, pixmap);
+
+    return image;
+}
+
+static size_t
+encode_png(fz_context* ctx, epdf_image_buffer_t* image, unsigned char* out)
+{
+    fz_pixmap* pixmap = fz_new_pixmap_with_data(ctx, fz_device_rgb(ctx), image->width, image->height,
+                                                NULL, 0, image->rowstride, image->data);
+    fz_buffer* buffer = fz_new_buffer_from_pixmap_as_png(ctx, pixmap, fz_default_color_params);
+
+    unsigned char* data = NULL;
+    const size_t size = fz_buffer_storage(ctx, buffer, &data);
+    /* the bytes end up in a Lisp string */
+    memcpy(out, data, size);
+
+    fz_drop_buffer(ctx, buffer);
+    fz_drop_pixmap(ctx, pixmap);
+
+    return size;
+}
+
+static size_t
+encode_ppm(epdf_image_buffer_t* image, unsigned char* out)
+{
+    size_t size = 0;
+    const unsigned char* ppm = epdf_image_buffer_get_ppm(image, &size);
+    memcpy(out, ppm, size);
+
+    return size;
+}
+
+static int
+bench_encode(unsigned int iterations, const char* path)
+{
+    fz_context* ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+    fz_document* document = NULL;
+    fz_page* page = NULL;
+
+    if (path != NULL) {
+        fz_register_document_handlers(ctx);
+        document = fz_open_document(ctx, path);
+        page     = fz_load_page(ctx, document, 0);
+    }
+
+    double* render = g_new0(double, iterations);
+    double* png    = g_new0(double, iterations);
+    double* ppm    = g_new0(double, iterations);
+
+    printf("%-12s %11s %11s %11s %11s %11s %11s\n", "size", "render ms", "png ms", "png bytes",
+           "ppm ms", "ppm bytes", "speedup");
+
+    for (unsigned int s = 0; s < G_N_ELEMENTS(sizes); s++) {
+        size_t png_size = 0;
+        size_t ppm_size = 0;
+
+        for (unsigned int i = 0; i < iterations; i++) {
+            gint64 start = g_get_monotonic_time();
+            epdf_image_buffer_t* image = NULL;
+            if (page != NULL) {
+                image = render_page(ctx, page, sizes[s].dpi);
+            } else {
+                image = epdf_image_buffer_create(8.27 * sizes[s].dpi, 11.69 * sizes[s].dpi);
+                fill_synthetic_page(image);
+            }
+            render[i] = (g_get_monotonic_time() - start) / 1000.0;
+
+            unsigned char* out = g_malloc((size_t) image->rowstride * image->height * 2 + 1024);
+
+            start    = g_get_monotonic_time();
+            png_size = encode_png(ctx, image, out);
+            png[i]   = (g_get_monotonic_time() - start) / 1000.0;
+
+            start    = g_get_monotonic_time();
+            ppm_size = encode_ppm(image, out);
+            ppm[i]   = (g_get_monotonic_time() - start) / 1000.0;
+
+            g_free(out);
+            epdf_image_buffer_free(image);
+        }
+
+        const double render_ms = page != NULL ? median(render, iterations) : 0.0;
+        const double png_ms    = median(png, iterations);
+        const double ppm_ms    = median(ppm, iterations);
+
+        printf("%-12s %11.2f %11.2f %11zu %11.2f %11zu %10.1fx\n", sizes[s].name, render_ms, png_ms,
+               png_size, ppm_ms, ppm_size, (render_ms + png_ms) / (render_ms + ppm_ms));
+    }
+
+    g_free(render);
+    g_free(png);
+    g_free(ppm);
+
+    fz_drop_page(ctx, page);
+    fz_drop_document(ctx, document);
+    fz_drop_context(ctx);
+
+    return EXIT_SUCCESS;
+}
+
+/* Latency samples of one operation, in milliseconds */
+typedef struct bench_metric_s
+{
+    char* name;
+    GArray* samples;
+} bench_metric_t;
+
+static void
+bench_metric_free(bench_metric_t* metric)
+{
+    g_free(metric->name);
+    g_array_free(metric->samples, TRUE);
+    g_free(metric);
+}
+
+static void
+bench_add_sample(GPtrArray* metrics, const char* name, gint64 start)
+{
+    const double sample = (g_get_monotonic_time() - start) / 1000.0;
+
+    bench_metric_t* metric = NULL;
+    for (unsigned int i = 0; i < metrics->len && metric == NULL; i++) {
+        bench_metric_t* m = g_ptr_array_index(metrics, i);
+        if (strcmp(m->name, name) == 0) {
+            metric = m;
+        }
+    }
+
+    if (metric == NULL) {
+        metric          = g_new0(bench_metric_t, 1);
+        metric->name    = g_strdup(name);
+        metric->samples = g_array_new(FALSE, FALSE, sizeof(double));
+        g_ptr_array_add(metrics, metric);
+    }
+
+    g_array_append_val(metric->samples, sample);
+}
+
+/* Nearest-rank percentile of sorted values */
+static double
+percentile(const double* values, unsigned int n, unsigned int p)
+{
+    const unsigned int rank = (p * n + 99) / 100;
+    return values[MAX(rank, 1) - 1];
+}
+
+/* Adds FILE, or the PDF files in DIR, to the corpus */
+static void
+bench_add_corpus(GPtrArray* corpus, const char* path)
+{
+    if (g_file_test(path, G_FILE_TEST_IS_DIR) == FALSE) {
+        g_ptr_array_add(corpus, g_strdup(path));
+        return;
+    }
+
+    GDir* dir = g_dir_open(path, 0, NULL);
+    if (dir == NULL) {
+        return;
+    }
+
+    const char* name = NULL;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (g_str_has_suffix(name, ".pdf") == TRUE) {
+            g_ptr_array_add(corpus, g_build_filename(path, name, NULL));
+        }
+    }
+    g_dir_close(dir);
+}
+
+/* One pass over a document through the backend, as the module drives it */
+static bool
+bench_document(GPtrArray* metrics, const char* path, const GArray* scales, unsigned int max_pages,
+               const char* query)
+{
+    epdf_document_t* document = g_new0(epdf_document_t, 1);
+    document->file_path       = g_strdup(path);
+
+    gint64 start = g_get_monotonic_time();
+    if (pdf_document_open(document) != EPDF_ERROR_OK) {
+        fprintf(stderr, "bench: can not open %s\n", path);
+        g_free(document->file_path);
+        g_free(document);
+        return false;
+    }
+    bench_add_sample(metrics, "open", start);
+
+    const unsigned int number_of_pages = epdf_document_get_number_of_pages(document);
+    epdf_page_t** pages = g_new0(epdf_page_t*, number_of_pages);
+
+    for (unsigned int i = 0; i < number_of_pages; i++) {
+        pages[i]           = g_new0(epdf_page_t, 1);
+        pages[i]->index    = i;
+        pages[i]->document = document;
+
+        start = g_get_monotonic_time();
+        if (pdf_page_init(pages[i]) == EPDF_ERROR_OK) {
+            bench_add_sample(metrics, "page_init", start);
+        }
+    }
+
+    const unsigned int n = MIN(number_of_pages, max_pages);
+    for (unsigned int i = 0; i < n; i++) {
+        void* data = epdf_page_get_data(pages[i]);
+        if (data == NULL) {
+            continue;
+        }
+
+        for (unsigned int s = 0; s < scales->len; s++) {
+            const double scale = g_array_index(scales, double, s);
+            char name[32];
+            g_snprintf(name, sizeof(name), "render@%.2f", scale);
+
+            epdf_image_buffer_t* image = NULL;
+            start = g_get_monotonic_time();
+            if (pdf_page_render_image(pages[i], data, scale, 0, NULL, &image) == EPDF_ERROR_OK) {
+                bench_add_sample(metrics, name, start);
+            }
+            epdf_image_buffer_free(image);
+        }
+
+        const epdf_rectangle_t all = { 0, 0, epdf_page_get_width(pages[i]), epdf_page_get_height(pages[i]) };
+        start = g_get_monotonic_time();
+        char* text = pdf_page_get_text(pages[i], data, all, NULL);
+        bench_add_sample(metrics, "text", start);
+        g_free(text);
+
+        start = g_get_monotonic_time();
+        GPtrArray* hits = pdf_page_search_text(pages[i], data, query, NULL);
+        bench_add_sample(metrics, "search", start);
+        if (hits != NULL) {
+            g_ptr_array_free(hits, TRUE);
+        }
+    }
+
+    for (unsigned int i = 0; i < number_of_pages; i++) {
+        pdf_page_clear(pages[i], epdf_page_get_data(pages[i]));
+        g_free(pages[i]);
+    }
+    g_free(pages);
+
+    pdf_document_free(document, epdf_document_get_data(document));
+    g_free(document->file_path);
+    g_free(document);
+
+    return true;
+}
+
+/* Prints string as a quoted JSON string */
+static void
+print_json_string(const char* string)
+{
+    putchar('"');
+    for (const unsigned char* c = (const unsigned char*) string; *c != '\0'; c++) {
+        switch (*c) {
+            case '"':
+                fputs("\\\"", stdout);
+                break;
+            case '\\':
+                fputs("\\\\", stdout);
+                break;
+            case '\n':
+                fputs("\\n", stdout);
+                break;
+            case '\r':
+                fputs("\\r", stdout);
+                break;
+            case '\t':
+                fputs("\\t", stdout);
+                break;
+            default:
+                if (*c < 0x20) {
+                    printf("\\u%04x", *c);
+                } else {
+                    putchar(*c);
+                }
+                break;
+        }
+    }
+    putchar('"');
+}
+
+static void
+bench_print_json(GPtrArray* metrics, GPtrArray* corpus, unsigned int iterations)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("{\n  \"iterations\": %u,\n  \"files\": [", iterations);
+    for (unsigned int i = 0; i < corpus->len; i++) {
+        fputs(i == 0 ? "" : ", ", stdout);
+        print_json_string(g_ptr_array_index(corpus, i));
+    }
+    printf("],\n  \"peak_rss_kib\": %ld,\n  \"metrics\": {", usage.ru_maxrss);
+
+    for (unsigned int i = 0; i < metrics->len; i++) {
+        bench_metric_t* metric = g_ptr_array_index(metrics, i);
+        double* values         = (double*) metric->samples->data;
+        const unsigned int n   = metric->samples->len;
+        qsort(values, n, sizeof(double), compare_double);
+
+        printf("%s\n    ", i == 0 ? "" : ",");
+        print_json_string(metric->name);
+        printf(": { \"count\": %u, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f }", n,
+               percentile(values, n, 50), percentile(values, n, 95), percentile(values, n, 99));
+    }
+
+    printf("\n  }\n}\n");
+}
+
+static int
+bench_run(unsigned int iterations, GArray* scales, unsigned int max_pages, const char* query,
+          GPtrArray* corpus)
+{
+    GPtrArray* metrics = g_ptr_array_new_with_free_func((GDestroyNotify) bench_metric_free);
+    int ret = EXIT_SUCCESS;
+
+    for (unsigned int i = 0; i < iterations; i++) {
+        for (unsigned int f = 0; f < corpus->len; f++) {
+            if (bench_document(metrics, g_ptr_array_index(corpus, f), scales, max_pages, query) == false) {
+                ret = EXIT_FAILURE;
+            }
+        }
+    }
+
+    bench_print_json(metrics, corpus, iterations);
+    g_ptr_array_free(metrics, TRUE);
+
+    return ret;
+}
+
+static epdf_image_buffer_t*
+bench_render_page(epdf_page_t* page, double scale, unsigned int rotation, void* UNUSED(data),
+                  epdf_error_t* error)
+{
+    epdf_image_buffer_t* image = NULL;
+    const epdf_error_t ret     = pdf_page_render_image(page, epdf_page_get_data(page), scale, rotation,
+                                                       NULL, &image);
+    if (ret != EPDF_ERROR_OK && error != NULL) {
+        *error = ret;
+    }
+
+    return image;
+}
+
+/* Batch export through the backend, the pages are set up as the module does */
+static int
+bench_export(const char* path, const char* prefix, double scale, epdf_page_export_format_t format,
+             unsigned int workers, unsigned int first, unsigned int last)
+{
+    epdf_document_t* document = g_new0(epdf_document_t, 1);
+    document->file_path       = g_strdup(path);
+
+    if (pdf_document_open(document) != EPDF_ERROR_OK) {
+        fprintf(stderr, "bench: can not open %s\n", path);
+        g_free(document->file_path);
+        g_free(document);
+        return EXIT_FAILURE;
+    }
+
+    const unsigned int number_of_pages = epdf_document_get_number_of_pages(document);
+    epdf_page_t** pages = g_new0(epdf_page_t*, number_of_pages);
+
+    for (unsigned int i = 0; i < number_of_pages; i++) {
+        pages[i]           = g_new0(epdf_page_t, 1);
+        pages[i]->index    = i;
+        pages[i]->document = document;
+        pdf_page_init(pages[i]);
+    }
+    document->pages = pages;
+
+    epdf_page_export_options_t options = {
+        .first_page = MIN(first, number_of_pages) - 1,
+        .last_page  = MIN(last, number_of_pages) - 1,
+        .scale      = scale,
+        .format     = format,
+        .prefix     = strcmp(prefix, "-") != 0 ? prefix : NULL,
+        .stream     = stdout,
+        .workers    = workers,
+        .render     = bench_render_page,
+    };
+
+    const gint64 start         = g_get_monotonic_time();
+    const epdf_error_t error   = epdf_document_export_pages(document, &options);
+    const double seconds       = (g_get_monotonic_time() - start) / 1e6;
+    const unsigned int written = options.last_page - options.first_page + 1;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "{ \"pages\": %u, \"seconds\": %.3f, \"pages_per_second\": %.1f, \"peak_rss_kib\": %ld, "
+            "\"error\": %d }\n", written, seconds, written / seconds, usage.ru_maxrss, error);
+
+    document->pages = NULL;
+    for (unsigned int i = 0; i < number_of_pages; i++) {
+        pdf_page_clear(pages[i], epdf_page_get_data(pages[i]));
+        g_free(pages[i]);
+    }
+    g_free(pages);
+
+    pdf_document_free(document, epdf_document_get_data(document));
+    g_free(document->file_path);
+    g_free(document);
+
+    return error == EPDF_ERROR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void
+usage(const char* name)
+{
+    fprintf(stderr, "usage: %s encode [-n ITERATIONS] [FILE.pdf]\n"
+            "       %s run [-n ITERATIONS] [-s SCALES] [-p PAGES] [-q QUERY] FILE|DIR...\n"
+            "       %s export [-s SCALE] [-f png|ppm] [-j WORKERS] [-r FIRST-LAST] FILE.pdf PREFIX\n",
+            name, name, name);
+}
+
+static int
+bench_export_main(int argc, char* argv[])
+{
+    double scale                     = 2.0;
+    epdf_page_export_format_t format = EPDF_PAGE_EXPORT_FORMAT_PNG;
+    unsigned int workers             = 0;
+    unsigned int first               = 1;
+    unsigned int last                = G_MAXUINT;
+    const char* path                 = NULL;
+    const char* prefix               = NULL;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = g_ascii_strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            format = strcmp(argv[++i], "ppm") == 0 ? EPDF_PAGE_EXPORT_FORMAT_PPM
+                                                   : EPDF_PAGE_EXPORT_FORMAT_PNG;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            workers = MAX(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%u-%u", &first, &last) < 1) {
+                first = 0;
+            }
+            if (strchr(argv[i], '-') == NULL) {
+                last = first;
+            }
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            prefix = argv[i];
+        }
+    }
+
+    if (path == NULL || prefix == NULL || scale <= 0.0 || first == 0 || first > last) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return bench_export(path, prefix, scale, format, workers, first, last);
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "export") == 0) {
+        return bench_export_main(argc, argv);
+    }
+
+    if (argc < 2 || (strcmp(argv[1], "encode") != 0 && strcmp(argv[1], "run") != 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const bool run          = strcmp(argv[1], "run") == 0;
+    unsigned int iterations = run == true ? 5 : 10;
+    unsigned int max_pages  = 20;
+    const char* scales_arg  = "0.5,1,2";
+    const char* query       = "the";
+    const char* path        = NULL;
+    GPtrArray* corpus       = g_ptr_array_new_with_free_func(g_free);
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = MAX(1, atoi(argv[++i]));
+        } else if (run == true && strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scales_arg = argv[++i];
+        } else if (run == true && strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            max_pages = MAX(1, atoi(argv[++i]));
+        } else if (run == true && strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            query = argv[++i];
+        } else if (run == true) {
+            bench_add_corpus(corpus, argv[i]);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (run == false) {
+        g_ptr_array_free(corpus, TRUE);
+        return bench_encode(iterations, path);
+    }
+
+    if (corpus->len == 0) {
+        usage(argv[0]);
+        g_ptr_array_free(corpus, TRUE);
+        return EXIT_FAILURE;
+    }
+
+    GArray* scales = g_array_new(FALSE, FALSE, sizeof(double));
+    char** parts   = g_strsplit(scales_arg, ",", -1);
+    for (char** part = parts; *part != NULL; part++) {
+        const double scale = g_ascii_strtod(*part, NULL);
+        if (scale > 0.0) {
+            g_array_append_val(scales, scale);
+        }
+    }
+    g_strfreev(parts);
+
+    const int ret = bench_run(iterations, scales, max_pages, query, corpus);
+
+    g_array_free(scales, TRUE);
+    g_ptr_array_free(corpus, TRUE);
+
+    return ret;
+}
@@ -3,10 +3,20 @@
 #include <limits.h>
 #include <glib.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <math.h>
+#ifdef G_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "document.h"
+#include "file-watch.h"
 #include "page.h"
+#include "plugin-manager.h"
+#include "recolor.h"
+#include "render.h"
+#include "trace.h"
 
 static void
 check_set_error(epdf_error_t* error, epdf_error_t code) {
@@ -18,6 +28,8 @@ check_set_error(epdf_error_t* error, epdf_error_t code) {
 static bool
 hash_file_sha256(uint8_t* dst, const char* path)
 {
+    EPDF_TRACE_SPAN("document_hash");
+
     FILE* f = fopen(path, "rb");
     if (f == NULL) {
         return false;
@@ -48,10 +60,383 @@ hash_file_sha256(uint8_t* dst, const char* path)
     return true;
 }
 
+/* Bytes at the end of a mapped file that are paged in right away; the xref
+ * and trailer are read first and live there */
+#define DOCUMENT_MAP_TAIL_SIZE (1024 * 1024)
+
+#ifdef G_OS_UNIX
+static void
+mapping_advise(const char* data, gsize size, gsize offset, gsize length, int advice)
+{
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    const uintptr_t start     = (uintptr_t) (data + offset) & ~(page_size - 1);
+    const uintptr_t end       = (uintptr_t) (data + MIN(size, offset + length));
+    if (end > start) {
+        madvise((void*) start, end - start, advice);
+    }
+}
+#endif
+
+/* Maps the file read-only, NULL if it can not be mapped */
+static GMappedFile*
+map_file(const char* path)
+{
+    GMappedFile* mapping = g_mapped_file_new(path, FALSE, NULL);
+    if (mapping == NULL) {
+        return NULL;
+    }
+
+    /* empty files have no contents to map */
+    if (g_mapped_file_get_contents(mapping) == NULL) {
+        g_mapped_file_unref(mapping);
+        return NULL;
+    }
+
+    return mapping;
+}
+
+/* Hashes the mapped file in one pass, then tells the kernel that mupdf will
+ * access objects randomly except for the xref at the end */
+static bool
+hash_mapping_sha256(uint8_t* dst, GMappedFile* mapping)
+{
+    EPDF_TRACE_SPAN("document_hash");
+
+    const char* data = g_mapped_file_get_contents(mapping);
+    const gsize size = g_mapped_file_get_length(mapping);
+
+#ifdef G_OS_UNIX
+    mapping_advise(data, size, 0, size, MADV_SEQUENTIAL);
+#endif
+
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    if (checksum == NULL) {
+        return false;
+    }
+
+    g_checksum_update(checksum, (const guchar*) data, size);
+
+    gsize dst_size = 32;
+    g_checksum_get_digest(checksum, dst, &dst_size);
+    g_checksum_free(checksum);
+
+#ifdef G_OS_UNIX
+    mapping_advise(data, size, 0, size, MADV_RANDOM);
+    if (size > DOCUMENT_MAP_TAIL_SIZE) {
+        mapping_advise(data, size, size - DOCUMENT_MAP_TAIL_SIZE, DOCUMENT_MAP_TAIL_SIZE, MADV_WILLNEED);
+    } else {
+        mapping_advise(data, size, 0, size, MADV_WILLNEED);
+    }
+#endif
+
+    return true;
+}
+
+/* Process-wide registry of open documents, keyed by real path. Every path maps
+ * to the most recently opened revision of the file. */
+static GMutex registry_lock;
+static GHashTable* registry = NULL;
+
+/* Guards the render cost tables, written by render workers */
+G_LOCK_DEFINE_STATIC(render_costs);
+
+/* Memory budget shared by the stores of all documents, 0 if unlimited */
+static uint64_t global_store_limit = 0;
+
+static epdf_document_t*
+registry_lookup(const char* real_path)
+{
+    g_mutex_lock(&registry_lock);
+
+    epdf_document_t* document = NULL;
+    if (registry != NULL) {
+        document = g_hash_table_lookup(registry, real_path);
+    }
+
+    if (document != NULL) {
+        document->ref_count++;
+    }
+
+    g_mutex_unlock(&registry_lock);
+
+    return document;
+}
+
+static void
+registry_insert(epdf_document_t* document)
+{
+    g_mutex_lock(&registry_lock);
+
+    if (registry == NULL) {
+        registry = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    /* the key is owned by the document, so replace it along with the value */
+    g_hash_table_replace(registry, document->file_path, document);
+
+    g_mutex_unlock(&registry_lock);
+}
+
+static bool
+file_unchanged(epdf_document_t* document, const GStatBuf* st, const uint8_t* hash)
+{
+    if (document->file_size == (int64_t) st->st_size &&
+        document->file_mtime == (int64_t) st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec) {
+        return true;
+    }
+
+    return hash != NULL && memcmp(document->hash_sha256, hash, sizeof(document->hash_sha256)) == 0;
+}
+
+/* Whether the file on disk still is the revision the document has been opened
+ * from or last saved to */
+static bool
+document_file_current(epdf_document_t* document)
+{
+    GStatBuf st;
+    if (g_stat(document->file_path, &st) != 0) {
+        return false;
+    }
+
+    if (file_unchanged(document, &st, NULL) == true) {
+        return true;
+    }
+
+    uint8_t hash[32];
+    return hash_file_sha256(hash, document->file_path) == true && file_unchanged(document, &st, hash) == true;
+}
+
+/* Records the size, modification time and hash of the file on disk as the
+ * revision of the document */
+static void
+document_refresh_file_state(epdf_document_t* document)
+{
+    GStatBuf st;
+    if (g_stat(document->file_path, &st) == 0) {
+        document->file_size  = st.st_size;
+        document->file_mtime = (int64_t) st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+        hash_file_sha256(document->hash_sha256, document->file_path);
+    }
+}
+
+/* Clears the changed flag of every page whose content objects are identical to
+ * the same page in the previous revision of the document. Only pages with
+ * renderings to take over are compared: fingerprinting reads the raw content
+ * of both revisions, and every other page has to be rendered anyway. */
+static void
+document_mark_changed_pages(epdf_document_t* document, epdf_document_t* previous)
+{
+    GArray* cached = epdf_render_cache_get_pages(previous);
+
+    for (unsigned int i = 0; i < cached->len; i++) {
+        const unsigned int page_id = g_array_index(cached, unsigned int, i);
+        epdf_page_t* page          = epdf_document_get_page(document, page_id);
+        epdf_page_t* old_page      = epdf_document_get_page(previous, page_id);
+        if (page == NULL || old_page == NULL) {
+            break;
+        }
+
+        const uint8_t* fingerprint     = epdf_page_get_fingerprint(page, NULL);
+        const uint8_t* old_fingerprint = epdf_page_get_fingerprint(old_page, NULL);
+        if (fingerprint == NULL || old_fingerprint == NULL) {
+            /* backend can not tell, keep everything marked as changed */
+            break;
+        }
+
+        if (memcmp(fingerprint, old_fingerprint, sizeof(page->fingerprint)) == 0) {
+            page->changed = false;
+        }
+    }
+
+    g_array_unref(cached);
+}
+
+/* Loads the pages from ready_pages on, up to the last page or, in progressive
+ * documents, the first page that has not been written yet */
+static epdf_error_t
+document_load_pages(epdf_document_t* document)
+{
+    for (unsigned int page_id = document->ready_pages; page_id < document->number_of_pages; page_id++) {
+        epdf_error_t error = EPDF_ERROR_OK;
+        epdf_page_t* page  = epdf_page_new(document, page_id, &error);
+        if (page == NULL) {
+            if (error == EPDF_ERROR_TRY_LATER && document->open_options.progressive == true) {
+                break;
+            }
+            return EPDF_ERROR_OUT_OF_MEMORY;
+        }
+
+        document->pages[page_id] = page;
+        document->ready_pages    = page_id + 1;
+
+        /* cell_width and cell_height is the maximum of all the pages width and height */
+        const double width = epdf_page_get_width(page);
+        if (document->cell_width < width)
+            document->cell_width = width;
+
+        const double height = epdf_page_get_height(page);
+        if (document->cell_height < height)
+            document->cell_height = height;
+    }
+
+    return EPDF_ERROR_OK;
+}
+
+/* Grows the page arrays to the number of pages after the backend counted more
+ * of them, as reflowed documents do while they are laid out */
+static epdf_error_t
+document_grow_pages(epdf_document_t* document, unsigned int allocated)
+{
+    const unsigned int number_of_pages = document->number_of_pages;
+    if (number_of_pages <= allocated) {
+        return EPDF_ERROR_OK;
+    }
+
+    /* pages beyond allocated are not in use yet */
+    document->number_of_pages = allocated;
+
+    epdf_page_t** pages = realloc(document->pages, number_of_pages * sizeof(epdf_page_t*));
+    if (pages == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+    memset(pages + allocated, 0, (number_of_pages - allocated) * sizeof(epdf_page_t*));
+    document->pages = pages;
+
+    /* render workers record costs concurrently */
+    G_LOCK(render_costs);
+    epdf_render_cost_t* render_costs = g_try_renew(epdf_render_cost_t, document->render_costs, number_of_pages);
+    if (render_costs != NULL) {
+        memset(render_costs + allocated, 0, (number_of_pages - allocated) * sizeof(epdf_render_cost_t));
+        document->render_costs = render_costs;
+    }
+    G_UNLOCK(render_costs);
+
+    if (render_costs == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    document->number_of_pages = number_of_pages;
+
+    return EPDF_ERROR_OK;
+}
+
+/* Store size of a document opened with the given one; called with
+ * registry_lock held */
+static uint64_t
+store_size_clamp(uint64_t store_size)
+{
+    if (global_store_limit != 0 && (store_size == 0 || store_size > global_store_limit)) {
+        return global_store_limit;
+    }
+
+    return store_size;
+}
+
+/* An open document is shared with another opener if it has been opened the
+ * same way and is fully loaded */
+static bool
+document_can_share(epdf_document_t* document, const char* password, const epdf_open_options_t* options)
+{
+    const epdf_open_options_t defaults = { 0 };
+    const epdf_open_options_t* requested = options != NULL ? options : &defaults;
+    const epdf_open_options_t* current   = &document->open_options;
+
+    g_mutex_lock(&registry_lock);
+    const uint64_t store_size = store_size_clamp(requested->store_size);
+    g_mutex_unlock(&registry_lock);
+
+    return g_strcmp0(document->password, password) == 0 &&
+           store_size == current->store_size && requested->mmap == current->mmap &&
+           requested->progressive == current->progressive &&
+           requested->reflow.width == current->reflow.width &&
+           requested->reflow.height == current->reflow.height &&
+           requested->reflow.em == current->reflow.em &&
+           document->complete == true && document->ready_pages == document->number_of_pages;
+}
+
+/* Creates another opener's view of source: its own view state and page
+ * objects over the backend data, pages and renderings of source. Takes over
+ * a reference to source. */
+static epdf_document_t*
+document_new_view(epdf_document_t* source, const char* uri, const char* password)
+{
+    epdf_document_t* document = g_try_malloc0(sizeof(epdf_document_t));
+    if (document == NULL) {
+        epdf_document_free(source);
+        return NULL;
+    }
+
+    document->source    = source;
+    document->file_path = g_strdup(source->file_path);
+    document->uri       = g_strdup(uri);
+    if (document->uri == NULL) {
+        document->basename = g_path_get_basename(document->file_path);
+    } else {
+        GFile* gf = g_file_new_for_uri(document->uri);
+        document->basename = g_file_get_basename(gf);
+        g_object_unref(gf);
+    }
+    memcpy(document->hash_sha256, source->hash_sha256, sizeof(document->hash_sha256));
+    document->password         = g_strdup(password);
+    document->number_of_pages  = source->number_of_pages;
+    document->ready_pages      = source->ready_pages;
+    document->complete         = true;
+    document->data             = source->data;
+    document->plugin           = source->plugin;
+    document->open_options     = source->open_options;
+    document->file_size        = source->file_size;
+    document->file_mtime       = source->file_mtime;
+    document->cell_width       = source->cell_width;
+    document->cell_height      = source->cell_height;
+    document->ref_count        = 1;
+    document->zoom             = 1.0;
+    document->adjust_mode      = EPDF_ADJUST_NONE;
+    document->device_factors.x = 1.0;
+    document->device_factors.y = 1.0;
+    epdf_recolor_init(&document->recolor);
+
+    document->pages = calloc(MAX(document->number_of_pages, 1), sizeof(epdf_page_t*));
+    if (document->pages == NULL) {
+        goto error_free;
+    }
+
+    for (unsigned int page_id = 0; page_id < document->number_of_pages; page_id++) {
+        document->pages[page_id] = epdf_page_new_view(document, source->pages[page_id]);
+        if (document->pages[page_id] == NULL) {
+            goto error_free;
+        }
+    }
+
+    return document;
+
+error_free:
+
+    epdf_document_free(document);
+
+    return NULL;
+}
+
+static void
+document_file_changed(const char* UNUSED(path), epdf_file_event_t UNUSED(event), void* data)
+{
+    epdf_document_t* document = data;
+    g_atomic_int_set(&document->file_changed, 1);
+}
+
+/* Invalidates render jobs submitted for the previous view */
+static void
+document_bump_generation(epdf_document_t* document)
+{
+    g_atomic_int_inc(&document->generation);
+}
+
 epdf_document_t*
 epdf_document_open(epdf_t* epdf, const char* path, const char* uri,
-                   const char* password, epdf_error_t* error)
+                   const char* password, const epdf_open_options_t* options,
+                   epdf_error_t* error)
 {
+    EPDF_TRACE_SPAN("document_open");
+
     if (epdf == NULL || path == NULL) {
         return NULL;
     }
@@ -61,6 +446,11 @@ epdf_document_open(epdf_t* epdf, const char* path, const char* uri,
     char* content_type = NULL;
     epdf_plugin_t* plugin = NULL;
     epdf_document_t* document = NULL;
+    epdf_document_t* previous = NULL;
+    GMappedFile* mapping = NULL;
+    uint8_t hash[32] = { 0 };
+    bool hashed = false;
+    GStatBuf st;
 
     if (file == NULL) {
         check_set_error(error, EPDF_ERROR_UNKNOWN);
@@ -68,11 +458,42 @@ epdf_document_open(epdf_t* epdf, const char* path, const char* uri,
     }
 
     real_path = g_file_get_path(file);
-    if (real_path == NULL) {
+    if (real_path == NULL || g_stat(real_path, &st) != 0) {
         check_set_error(error, EPDF_ERROR_UNKNOWN);
         goto error_free;
     }
 
+    /* share the open document if the file did not change since and it is
+     * opened the same way; the opener gets its own view of it */
+    previous = registry_lookup(real_path);
+    if (previous != NULL && document_can_share(previous, password, options) == true) {
+        if (file_unchanged(previous, &st, NULL) == false) {
+            if (options != NULL && options->mmap == true && options->progressive == false) {
+                mapping = map_file(real_path);
+            }
+            hashed = mapping != NULL ? hash_mapping_sha256(hash, mapping) : hash_file_sha256(hash, real_path);
+        }
+
+        if (file_unchanged(previous, &st, hashed == true ? hash : NULL) == true) {
+            if (mapping != NULL) {
+                g_mapped_file_unref(mapping);
+            }
+            g_object_unref(file);
+            g_free(real_path);
+
+            document = document_new_view(previous, uri, password);
+            if (document == NULL) {
+                check_set_error(error, EPDF_ERROR_OUT_OF_MEMORY);
+            }
+            return document;
+        }
+    }
+
+    /* hashing shares the mapping with the backend */
+    if (mapping == NULL && options != NULL && options->mmap == true && options->progressive == false) {
+        mapping = map_file(real_path);
+    }
+
     content_type = epdf_content_type_guess(epdf->content_type_context, real_path, epdf_plugin_manager_get_content_types(epdf->plugins.manager));
     if (content_type == NULL) {
         check_set_error(error, EPDF_ERROR_UNKNOWN);
@@ -107,8 +528,25 @@ epdf_document_open(epdf_t* epdf, const char* path, const char* uri,
         document->basename = g_file_get_basename(gf);
         g_object_unref(gf);
     }
-    hash_file_sha256(document->hash_sha256, document->file_path);
-    document->password    = password;
+    document->mapping     = mapping;
+    mapping               = NULL;
+    if (hashed == true) {
+        memcpy(document->hash_sha256, hash, sizeof(document->hash_sha256));
+    } else if (document->mapping != NULL) {
+        hash_mapping_sha256(document->hash_sha256, document->mapping);
+    } else {
+        hash_file_sha256(document->hash_sha256, document->file_path);
+    }
+    document->file_size   = st.st_size;
+    document->file_mtime  = (int64_t) st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+    document->ref_count   = 1;
+    if (options != NULL) {
+        document->open_options = *options;
+    }
+    g_mutex_lock(&registry_lock);
+    document->open_options.store_size = store_size_clamp(document->open_options.store_size);
+    g_mutex_unlock(&registry_lock);
+    document->password    = g_strdup(password);
     document->zoom        = 1.0;
     document->plugin      = plugin;
     document->adjust_mode = EPDF_ADJUST_NONE;
@@ -121,6 +559,7 @@ epdf_document_open(epdf_t* epdf, const char* path, const char* uri,
     document->device_factors.y = 1.0;
     document->position_x  = 0.0;
     document->position_y  = 0.0;
+    epdf_recolor_init(&document->recolor);
 
     real_path = NULL;
     g_object_unref(file);
@@ -138,40 +577,66 @@ epdf_document_open(epdf_t* epdf, const char* path, const char* uri,
         goto error_free;
     }
 
-    /* read all pages */
-    document->pages = calloc(document->number_of_pages, sizeof(epdf_page_t*));
-    if (document->pages == NULL) {
+    /* read all pages, a reflowed document may have none counted yet */
+    document->pages        = calloc(MAX(document->number_of_pages, 1), sizeof(epdf_page_t*));
+    document->render_costs = g_try_new0(epdf_render_cost_t, MAX(document->number_of_pages, 1));
+    if (document->pages == NULL || document->render_costs == NULL) {
         check_set_error(error, EPDF_ERROR_OUT_OF_MEMORY);
         goto error_free;
     }
 
-    for (unsigned int page_id = 0; page_id < document->number_of_pages; page_id++) {
-        epdf_page_t* page = epdf_page_new(document, page_id, NULL);
-        if (page == NULL) {
-            check_set_error(error, EPDF_ERROR_OUT_OF_MEMORY);
+    int_error = document_load_pages(document);
+    if (int_error != EPDF_ERROR_OK) {
+        check_set_error(error, int_error);
+        goto error_free;
+    }
+
+    /* pick up the rest of a file that is still being written as it grows */
+    document->complete = true;
+    if (document->open_options.progressive == true) {
+        if (functions->document_update != NULL) {
+            functions->document_update(document, document->data, &document->complete);
+        }
+        if (document->complete == false || document->ready_pages < document->number_of_pages) {
+            document->watch = epdf_file_watch_new(document->file_path, document_file_changed, document);
+        }
+    } else if (document->open_options.reflow.width > 0.0 && functions->document_update != NULL) {
+        /* the rest of a reflowed document is counted in the background and
+         * loaded by epdf_document_update */
+        const unsigned int allocated = document->number_of_pages;
+        functions->document_update(document, document->data, &document->complete);
+
+        int_error = document_grow_pages(document, allocated);
+        if (int_error != EPDF_ERROR_OK) {
+            check_set_error(error, int_error);
             goto error_free;
         }
+    }
 
-        document->pages[page_id] = page;
-
-        /* cell_width and cell_height is the maximum of all the pages width and height */
-        const double width = epdf_page_get_width(page);
-        if (document->cell_width < width)
-            document->cell_width = width;
-
-        const double height = epdf_page_get_height(page);
-        if (document->cell_height < height)
-            document->cell_height = height;
+    /* only re-render what changed since the previous revision */
+    if (previous != NULL) {
+        document_mark_changed_pages(document, previous);
+        epdf_document_free(previous);
     }
 
+    registry_insert(document);
+
     return document;
 
 error_free:
 
+    if (previous != NULL) {
+        epdf_document_free(previous);
+    }
+
     if (file != NULL) {
         g_object_unref(file);
     }
 
+    if (mapping != NULL) {
+        g_mapped_file_unref(mapping);
+    }
+
     g_free(real_path);
 
     if (document != NULL) {
@@ -184,6 +649,20 @@ error_free:
     return NULL;
 }
 
+epdf_document_t*
+epdf_document_ref(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return NULL;
+    }
+
+    g_mutex_lock(&registry_lock);
+    document->ref_count++;
+    g_mutex_unlock(&registry_lock);
+
+    return document;
+}
+
 epdf_error_t
 epdf_document_free(epdf_document_t* document)
 {
@@ -191,6 +670,44 @@ epdf_document_free(epdf_document_t* document)
         return EPDF_ERROR_INVALID_ARGUMENTS;
     }
 
+    /* drop the reference and unregister the document with the last one */
+    g_mutex_lock(&registry_lock);
+    if (document->ref_count > 1) {
+        document->ref_count--;
+        g_mutex_unlock(&registry_lock);
+        return EPDF_ERROR_OK;
+    }
+    if (registry != NULL && g_hash_table_lookup(registry, document->file_path) == document) {
+        g_hash_table_remove(registry, document->file_path);
+    }
+    g_mutex_unlock(&registry_lock);
+
+    /* a view only owns its page objects and view state */
+    if (document->source != NULL) {
+        epdf_document_t* source = document->source;
+
+        if (document->pages != NULL) {
+            for (unsigned int page_id = 0; page_id < document->number_of_pages; page_id++) {
+                epdf_page_free(document->pages[page_id]);
+            }
+            free(document->pages);
+        }
+
+        g_free(document->file_path);
+        g_free(document->uri);
+        g_free(document->basename);
+        g_free(document->password);
+        g_free(document);
+
+        return epdf_document_free(source);
+    }
+
+    /* no more change notifications for this document */
+    epdf_file_watch_free(document->watch);
+    document->watch = NULL;
+
+    epdf_render_cache_purge(document);
+
     if (document->pages != NULL) {
         /* free pages */
         for (unsigned int page_id = 0; page_id < document->number_of_pages; page_id++) {
@@ -209,13 +726,117 @@ epdf_document_free(epdf_document_t* document)
         error = functions->document_free(document, document->data);
     }
 
+    /* the backend may read from the mapping until it freed the document */
+    if (document->mapping != NULL) {
+        g_mapped_file_unref(document->mapping);
+    }
+
     g_free(document->file_path);
     g_free(document->uri);
     g_free(document->basename);
+    g_free(document->password);
+    g_free(document->render_costs);
 
     g_free(document);
 
-    return error;
+    return error;
+}
+
+void
+epdf_document_copy_view(epdf_document_t* document, epdf_document_t* source)
+{
+    if (document == NULL || source == NULL) {
+        return;
+    }
+
+    document->current_page_number = document->number_of_pages > 0 ?
+        MIN(source->current_page_number, document->number_of_pages - 1) : 0;
+    document->zoom              = source->zoom;
+    document->rotate            = source->rotate;
+    document->adjust_mode       = source->adjust_mode;
+    document->page_offset       = source->page_offset;
+    document->view_width        = source->view_width;
+    document->view_height       = source->view_height;
+    document->view_ppi          = source->view_ppi;
+    document->device_factors    = source->device_factors;
+    document->pages_per_row     = source->pages_per_row;
+    document->first_page_column = source->first_page_column;
+    document->page_padding      = source->page_padding;
+    document->position_x        = source->position_x;
+    document->position_y        = source->position_y;
+    document->recolor           = source->recolor;
+
+    for (unsigned int page_id = 0; page_id < document->number_of_pages; page_id++) {
+        epdf_page_t* page     = document->pages[page_id];
+        epdf_page_t* old_page = epdf_document_get_page(source, page_id);
+        if (page != NULL && old_page != NULL) {
+            page->visible = old_page->visible;
+        }
+    }
+
+    document_bump_generation(document);
+}
+
+int
+epdf_document_update(epdf_document_t* document, epdf_error_t* error)
+{
+    if (document == NULL) {
+        check_set_error(error, EPDF_ERROR_INVALID_ARGUMENTS);
+        return -1;
+    }
+
+    if (document->complete == true && document->ready_pages == document->number_of_pages) {
+        return 0;
+    }
+
+    /* without notifications the file is checked on every call */
+    if (document->watch != NULL && g_atomic_int_compare_and_exchange(&document->file_changed, 1, 0) == FALSE) {
+        return 0;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_update == NULL) {
+        check_set_error(error, EPDF_ERROR_NOT_IMPLEMENTED);
+        return -1;
+    }
+
+    const unsigned int allocated = document->number_of_pages;
+    epdf_error_t int_error = functions->document_update(document, document->data, &document->complete);
+    if (int_error == EPDF_ERROR_OK) {
+        int_error = document_grow_pages(document, allocated);
+    }
+    if (int_error != EPDF_ERROR_OK) {
+        check_set_error(error, int_error);
+        return -1;
+    }
+
+    const unsigned int ready = document->ready_pages;
+    int_error = document_load_pages(document);
+    if (int_error != EPDF_ERROR_OK) {
+        check_set_error(error, int_error);
+        return -1;
+    }
+
+    if (document->complete == true && document->ready_pages == document->number_of_pages &&
+        document->open_options.progressive == true) {
+        /* the registry compares revisions by file, refresh it to the final one */
+        document_refresh_file_state(document);
+
+        epdf_file_watch_free(document->watch);
+        document->watch = NULL;
+    }
+
+    return document->ready_pages - ready;
+}
+
+unsigned int
+epdf_document_get_ready_pages(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return 0;
+    }
+
+    return document->ready_pages;
 }
 
 const char*
@@ -238,6 +859,20 @@ epdf_document_get_hash(epdf_document_t* document)
     return document->hash_sha256;
 }
 
+const char*
+epdf_document_get_mapping(epdf_document_t* document, size_t* size)
+{
+    if (document == NULL || document->mapping == NULL) {
+        return NULL;
+    }
+
+    if (size != NULL) {
+        *size = g_mapped_file_get_length(document->mapping);
+    }
+
+    return g_mapped_file_get_contents(document->mapping);
+}
+
 const char*
 epdf_document_get_uri(epdf_document_t* document)
 {
@@ -258,6 +893,16 @@ epdf_document_get_basename(epdf_document_t* document)
     return document->basename;
 }
 
+epdf_document_t*
+epdf_document_get_source(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return NULL;
+    }
+
+    return document->source != NULL ? document->source : document;
+}
+
 const char*
 epdf_document_get_password(epdf_document_t* document)
 {
@@ -298,6 +943,16 @@ epdf_document_set_data(epdf_document_t* document, void* data)
     document->data = data;
 }
 
+epdf_plugin_t*
+epdf_document_get_plugin(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return NULL;
+    }
+
+    return document->plugin;
+}
+
 unsigned int
 epdf_document_get_number_of_pages(epdf_document_t* document)
 {
@@ -367,6 +1022,7 @@ epdf_document_set_position_x(epdf_document_t* document, double position_x)
     }
 
     document->position_x = position_x;
+    document_bump_generation(document);
 }
 
 void
@@ -377,6 +1033,7 @@ epdf_document_set_position_y(epdf_document_t* document, double position_y)
     }
 
     document->position_y = position_y;
+    document_bump_generation(document);
 }
 
 double
@@ -397,6 +1054,7 @@ epdf_document_set_zoom(epdf_document_t* document, double zoom)
     }
 
     document->zoom = zoom;
+    document_bump_generation(document);
 }
 
 double
@@ -416,6 +1074,72 @@ epdf_document_get_scale(epdf_document_t* document)
     return document->zoom * ppi / 72.0;
 }
 
+bool
+epdf_document_get_render_cost(epdf_document_t* document, unsigned int index, epdf_render_cost_t* cost)
+{
+    /* costs are learned for the pages of all openers */
+    document = epdf_document_get_source(document);
+
+    if (document == NULL || document->render_costs == NULL ||
+        index >= document->number_of_pages || cost == NULL) {
+        return false;
+    }
+
+    G_LOCK(render_costs);
+    *cost = document->render_costs[index];
+    G_UNLOCK(render_costs);
+
+    return cost->renders > 0;
+}
+
+void
+epdf_document_add_render_cost(epdf_document_t* document, unsigned int index,
+                              double milliseconds, uint64_t objects, double scale)
+{
+    document = epdf_document_get_source(document);
+
+    if (document == NULL || document->render_costs == NULL || index >= document->number_of_pages) {
+        return;
+    }
+
+    G_LOCK(render_costs);
+
+    epdf_render_cost_t* cost = &document->render_costs[index];
+    if (cost->renders == 0) {
+        cost->milliseconds = milliseconds;
+    } else {
+        cost->milliseconds = 0.7 * cost->milliseconds + 0.3 * milliseconds;
+    }
+    cost->objects = objects;
+    cost->scale   = scale;
+    cost->renders++;
+
+    G_UNLOCK(render_costs);
+}
+
+unsigned int
+epdf_document_get_generation(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return 0;
+    }
+
+    return g_atomic_int_get(&document->generation);
+}
+
+double
+epdf_document_get_device_scale(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return 0;
+    }
+
+    /* factors are equal in practice, never render below the larger one */
+    const double factor = MAX(document->device_factors.x, document->device_factors.y);
+
+    return epdf_document_get_scale(document) * factor;
+}
+
 unsigned int
 epdf_document_get_rotation(epdf_document_t* document)
 {
@@ -443,6 +1167,8 @@ epdf_document_set_rotation(epdf_document_t* document, unsigned int rotation)
     } else {
         document->rotate = 270;
     }
+
+    document_bump_generation(document);
 }
 
 epdf_adjust_mode_t
@@ -492,6 +1218,7 @@ epdf_document_set_viewport_width(epdf_document_t* document, unsigned int width)
         return;
     }
     document->view_width = width;
+    document_bump_generation(document);
 }
 
 void
@@ -501,6 +1228,7 @@ epdf_document_set_viewport_height(epdf_document_t* document, unsigned int height
         return;
     }
     document->view_height = height;
+    document_bump_generation(document);
 }
 
 void
@@ -510,6 +1238,7 @@ epdf_document_set_viewport_ppi(epdf_document_t* document, double ppi)
         return;
     }
     document->view_ppi = ppi;
+    document_bump_generation(document);
 }
 
 void
@@ -538,12 +1267,12 @@ epdf_document_set_device_factors(epdf_document_t* document,
         return;
     }
     if (fabs(x_factor) < DBL_EPSILON || fabs(y_factor) < DBL_EPSILON) {
-        x_factor, y_factor);
-    return;
-}
+        return;
+    }
 
-document->device_factors.x = x_factor;
-document->device_factors.y = y_factor;
+    document->device_factors.x = x_factor;
+    document->device_factors.y = y_factor;
+    document_bump_generation(document);
 }
 
 epdf_device_factors_t
@@ -557,6 +1286,53 @@ epdf_document_get_device_factors(epdf_document_t* document)
     return document->device_factors;
 }
 
+void
+epdf_document_set_recolor(epdf_document_t* document, const epdf_recolor_t* recolor)
+{
+    if (document == NULL) {
+        return;
+    }
+
+    if (recolor == NULL) {
+        epdf_recolor_init(&document->recolor);
+    } else {
+        document->recolor = *recolor;
+    }
+    document_bump_generation(document);
+}
+
+const epdf_recolor_t*
+epdf_document_get_recolor(epdf_document_t* document)
+{
+    if (document == NULL) {
+        return NULL;
+    }
+
+    return &document->recolor;
+}
+
+/* Size of a page cell in pixels at the current scale, swapped if rotate is set
+ * and the document is rotated by 90 or 270 degrees */
+static double
+page_calc_height_width(epdf_document_t* document, double height, double width,
+                       unsigned int* page_height, unsigned int* page_width, bool rotate)
+{
+    g_return_val_if_fail(document != NULL && page_height != NULL && page_width != NULL, 0.0);
+
+    double scale = epdf_document_get_scale(document);
+    if (rotate == true && epdf_document_get_rotation(document) % 180 != 0) {
+        *page_width  = round(height * scale);
+        *page_height = round(width * scale);
+        scale        = MAX(*page_width / height, *page_height / width);
+    } else {
+        *page_width  = round(width * scale);
+        *page_height = round(height * scale);
+        scale        = MAX(*page_width / width, *page_height / height);
+    }
+
+    return scale;
+}
+
 void
 epdf_document_get_cell_size(epdf_document_t* document,
                             unsigned int* height, unsigned int* width)
@@ -638,7 +1414,128 @@ epdf_document_get_first_page_column(epdf_document_t* document)
 }
 
 epdf_error_t
-epdf_document_save_as(epdf_document_t* document, const char* path)
+epdf_document_get_memory_stats(epdf_document_t* document, epdf_memory_stats_t* stats)
+{
+    if (document == NULL || document->plugin == NULL || stats == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_get_memory_stats == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return functions->document_get_memory_stats(document, document->data, stats);
+}
+
+epdf_error_t
+epdf_document_set_memory_limit(epdf_document_t* document, uint64_t limit)
+{
+    if (document == NULL || document->plugin == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_set_memory_limit == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return functions->document_set_memory_limit(document, document->data, limit);
+}
+
+epdf_error_t
+epdf_document_get_store_stats(epdf_document_t* document, epdf_store_stats_t* stats)
+{
+    if (document == NULL || document->plugin == NULL || stats == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_get_store_stats == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return functions->document_get_store_stats(document, document->data, stats);
+}
+
+epdf_error_t
+epdf_document_shrink_store(epdf_document_t* document, unsigned int percent)
+{
+    if (document == NULL || document->plugin == NULL || percent > 100) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_shrink_store == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return functions->document_shrink_store(document, document->data, percent);
+}
+
+void
+epdf_document_set_global_store_limit(uint64_t limit)
+{
+    g_mutex_lock(&registry_lock);
+    global_store_limit = limit;
+    g_mutex_unlock(&registry_lock);
+}
+
+void
+epdf_document_balance_stores(void)
+{
+    g_mutex_lock(&registry_lock);
+
+    const uint64_t limit = global_store_limit;
+    GPtrArray* documents = g_ptr_array_new();
+    if (limit != 0 && registry != NULL) {
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, registry);
+        while (g_hash_table_iter_next(&iter, NULL, &value) == TRUE) {
+            epdf_document_t* document = value;
+            document->ref_count++;
+            g_ptr_array_add(documents, document);
+        }
+    }
+
+    g_mutex_unlock(&registry_lock);
+
+    /* halve the largest store until everything fits, at most a few rounds */
+    for (unsigned int round = 0; round < 8 && documents->len > 0; round++) {
+        uint64_t total = 0;
+        uint64_t largest_size = 0;
+        epdf_document_t* largest = NULL;
+
+        for (unsigned int i = 0; i < documents->len; i++) {
+            epdf_store_stats_t stats = { 0 };
+            if (epdf_document_get_store_stats(documents->pdata[i], &stats) != EPDF_ERROR_OK) {
+                continue;
+            }
+
+            total += stats.allocated;
+            if (stats.allocated > largest_size) {
+                largest_size = stats.allocated;
+                largest      = documents->pdata[i];
+            }
+        }
+
+        if (total <= limit || largest == NULL) {
+            break;
+        }
+
+        epdf_document_shrink_store(largest, 50);
+    }
+
+    for (unsigned int i = 0; i < documents->len; i++) {
+        epdf_document_free(documents->pdata[i]);
+    }
+    g_ptr_array_unref(documents);
+}
+
+epdf_error_t
+epdf_document_save_as(epdf_document_t* document, const char* path,
+                      const epdf_save_options_t* options)
 {
     if (document == NULL || document->plugin == NULL || path == NULL) {
         return EPDF_ERROR_UNKNOWN;
@@ -649,7 +1546,176 @@ epdf_document_save_as(epdf_document_t* document, const char* path)
         return EPDF_ERROR_NOT_IMPLEMENTED;
     }
 
-    return functions->document_save_as(document, document->data, path);
+    epdf_save_options_t save_options = { 0 };
+    if (options != NULL) {
+        save_options = *options;
+    }
+
+    /* appending to a file that has been changed by someone else since would
+     * corrupt it, the document is then written in full */
+    epdf_document_t* source = epdf_document_get_source(document);
+    if (save_options.incremental == true && document_file_current(source) == false) {
+        save_options.incremental = false;
+    }
+
+    epdf_error_t error = functions->document_save_as(document, document->data, path, &save_options);
+
+    /* the saved file is the revision later opens and saves compare with */
+    if (error == EPDF_ERROR_OK) {
+        GFile* saved = g_file_new_for_path(path);
+        GFile* own   = g_file_new_for_path(source->file_path);
+        if (g_file_equal(saved, own) == TRUE) {
+            document_refresh_file_state(source);
+            if (document != source) {
+                document->file_size  = source->file_size;
+                document->file_mtime = source->file_mtime;
+                memcpy(document->hash_sha256, source->hash_sha256, sizeof(document->hash_sha256));
+            }
+        }
+        g_object_unref(saved);
+        g_object_unref(own);
+    }
+
+    return error;
+}
+
+typedef struct export_job_s
+{
+    epdf_document_t* document;
+    char* path;
+    epdf_export_options_t options;
+    epdf_export_callback_t callback;
+    void* data;
+} export_job_t;
+
+static gpointer
+document_export_thread(gpointer data)
+{
+    export_job_t* job = data;
+    epdf_document_t* document = job->document;
+    epdf_export_result_t result = { 0 };
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+
+    const gint64 start = g_get_monotonic_time();
+    result.error       = functions->document_export(document, document->data, job->path, &job->options);
+    result.elapsed     = (g_get_monotonic_time() - start) / (double) G_USEC_PER_SEC;
+    result.input_size  = document->file_size;
+
+    GStatBuf st;
+    if (result.error == EPDF_ERROR_OK && g_stat(job->path, &st) == 0) {
+        result.output_size = st.st_size;
+    }
+
+    if (job->callback != NULL) {
+        job->callback(document, &result, job->data);
+    }
+
+    epdf_document_free(document);
+    g_free(job->path);
+    g_free(job);
+
+    return NULL;
+}
+
+epdf_error_t
+epdf_document_export(epdf_document_t* document, const char* path,
+                     const epdf_export_options_t* options, epdf_export_callback_t callback,
+                     void* data)
+{
+    if (document == NULL || document->plugin == NULL || path == NULL || options == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_export == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    export_job_t* job = g_try_malloc0(sizeof(export_job_t));
+    if (job == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    epdf_document_ref(document);
+
+    job->document = document;
+    job->path     = g_strdup(path);
+    job->options  = *options;
+    job->callback = callback;
+    job->data     = data;
+
+    GThread* thread = g_thread_try_new("epdf-export", document_export_thread, job, NULL);
+    if (thread == NULL) {
+        epdf_document_free(document);
+        g_free(job->path);
+        g_free(job);
+        return EPDF_ERROR_UNKNOWN;
+    }
+
+    g_thread_unref(thread);
+
+    return EPDF_ERROR_OK;
+}
+
+GArray*
+epdf_document_chapters_get(epdf_document_t* document, epdf_error_t* error)
+{
+    if (document == NULL || document->plugin == NULL) {
+        check_set_error(error, EPDF_ERROR_INVALID_ARGUMENTS);
+        return NULL;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_chapters_get == NULL) {
+        check_set_error(error, EPDF_ERROR_NOT_IMPLEMENTED);
+        return NULL;
+    }
+
+    GArray* chapters = g_array_new(FALSE, FALSE, sizeof(unsigned int));
+    epdf_error_t ret = functions->document_chapters_get(document, document->data, chapters);
+    if (ret != EPDF_ERROR_OK) {
+        check_set_error(error, ret);
+        g_array_unref(chapters);
+        return NULL;
+    }
+
+    return chapters;
+}
+
+static void
+attachment_free(gpointer data)
+{
+    epdf_attachment_t* attachment = data;
+
+    g_free(attachment->name);
+    g_free(attachment->filename);
+    g_free(attachment);
+}
+
+GPtrArray*
+epdf_document_attachments_get(epdf_document_t* document, epdf_error_t* error)
+{
+    if (document == NULL || document->plugin == NULL) {
+        check_set_error(error, EPDF_ERROR_INVALID_ARGUMENTS);
+        return NULL;
+    }
+
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(document->plugin);
+    if (functions->document_attachments_get == NULL) {
+        check_set_error(error, EPDF_ERROR_NOT_IMPLEMENTED);
+        return NULL;
+    }
+
+    GPtrArray* attachments = g_ptr_array_new_with_free_func(attachment_free);
+    epdf_error_t ret = functions->document_attachments_get(document, document->data, attachments);
+    if (ret != EPDF_ERROR_OK) {
+        check_set_error(error, ret);
+        g_ptr_array_unref(attachments);
+        return NULL;
+    }
+
+    return attachments;
 }
 
 epdf_error_t
@@ -667,3 +1733,66 @@ epdf_document_attachment_save(epdf_document_t* document, const char* attachment,
     return functions->document_attachment_save(document, document->data, attachment, file);
 }
 
+typedef struct attachment_job_s
+{
+    epdf_document_t* document;
+    char* attachment;
+    char* file;
+    epdf_attachment_callback_t callback;
+    void* data;
+} attachment_job_t;
+
+static gpointer
+document_attachment_thread(gpointer data)
+{
+    attachment_job_t* job = data;
+    epdf_document_t* document = job->document;
+
+    epdf_error_t error = epdf_document_attachment_save(document, job->attachment, job->file);
+    if (job->callback != NULL) {
+        job->callback(document, error, job->data);
+    }
+
+    epdf_document_free(document);
+    g_free(job->attachment);
+    g_free(job->file);
+    g_free(job);
+
+    return NULL;
+}
+
+epdf_error_t
+epdf_document_attachment_save_async(epdf_document_t* document, const char* attachment,
+                                    const char* file, epdf_attachment_callback_t callback,
+                                    void* data)
+{
+    if (document == NULL || document->plugin == NULL || attachment == NULL || file == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    attachment_job_t* job = g_try_malloc0(sizeof(attachment_job_t));
+    if (job == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    epdf_document_ref(document);
+
+    job->document   = document;
+    job->attachment = g_strdup(attachment);
+    job->file       = g_strdup(file);
+    job->callback   = callback;
+    job->data       = data;
+
+    GThread* thread = g_thread_try_new("epdf-attachment", document_attachment_thread, job, NULL);
+    if (thread == NULL) {
+        epdf_document_free(document);
+        g_free(job->attachment);
+        g_free(job->file);
+        g_free(job);
+        return EPDF_ERROR_UNKNOWN;
+    }
+
+    g_thread_unref(thread);
+
+    return EPDF_ERROR_OK;
+}
@@ -4,23 +4,43 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "macros.h"
 #include "types.h"
 
 /**
  * Open the document
  *
+ * Open documents are shared process-wide: if the file at path is already open,
+ * did not change since and is opened with the same password and options, the
+ * caller gets its own view of it (zoom, position, current page, viewport,
+ * recoloring and page visibility) over the parsed document, its pages and
+ * their renderings instead of parsing it again. Otherwise a new document is
+ * opened and, if a previous revision is still open, only the pages whose
+ * content differs are marked as changed (see epdf_page_get_changed). Every
+ * successful call has to be balanced by epdf_document_free.
+ *
  * @param plugin_manager The epdf instance
  * @param path Path to the document
  * @param password Password of the document or NULL
+ * @param options Open options or NULL for the defaults
  * @param error Optional error parameter
  * @return The document object and NULL if an error occurs
  */
 epdf_document_t* epdf_document_open(epdf_t* epdf,
-    const char* path, const char *uri, const char* password, epdf_error_t*
-    error);
+    const char* path, const char *uri, const char* password,
+    const epdf_open_options_t* options, epdf_error_t* error);
 
 /**
- * Free the document
+ * Adds a reference to the document, to be dropped with epdf_document_free
+ *
+ * @param document The document
+ * @return The document
+ */
+EPDF_PLUGIN_API epdf_document_t* epdf_document_ref(epdf_document_t* document);
+
+/**
+ * Free the document. The document is only released once the last opener
+ * frees it.
  *
  * @param document
  * @return EPDF_ERROR_OK when no error occurred, otherwise see
@@ -28,6 +48,38 @@ epdf_document_t* epdf_document_open(epdf_t* epdf,
  */
 EPDF_PLUGIN_API epdf_error_t epdf_document_free(epdf_document_t* document);
 
+/**
+ * Copies the view of another revision of the document: current page, zoom,
+ * rotation, layout, viewport, position, recoloring and visible pages
+ *
+ * @param document The document
+ * @param source The previous revision
+ */
+EPDF_PLUGIN_API void epdf_document_copy_view(epdf_document_t* document, epdf_document_t* source);
+
+/**
+ * Loads the pages that have been written since a progressively opened
+ * document (see epdf_open_options_t) has been opened or last updated. The
+ * file is watched for changes, so calling this on a timer is cheap. Pages
+ * beyond epdf_document_get_ready_pages are NULL until they are loaded.
+ * Reflowed documents grow the same way while their chapters are laid out in
+ * the background; the number of pages increases with every counted chapter.
+ *
+ * @param document The document
+ * @param error Optional error parameter
+ * @return The number of pages that became ready or -1 if an error occurred
+ */
+EPDF_PLUGIN_API int epdf_document_update(epdf_document_t* document, epdf_error_t* error);
+
+/**
+ * Returns the number of leading pages that have been loaded. This is the
+ * number of pages unless the document has been opened progressively.
+ *
+ * @param document The document
+ * @return The number of ready pages
+ */
+EPDF_PLUGIN_API unsigned int epdf_document_get_ready_pages(epdf_document_t* document);
+
 /**
  * Returns the path of the document
  *
@@ -60,6 +112,26 @@ EPDF_PLUGIN_API const char* epdf_document_get_basename(epdf_document_t* document
  */
 EPDF_PLUGIN_API const uint8_t* epdf_document_get_hash(epdf_document_t* document);
 
+/**
+ * Returns the contents of the document's file if it has been mapped into
+ * memory (see epdf_open_options_t). The mapping stays valid until the
+ * document is freed.
+ *
+ * @param document The document
+ * @param size Set to the size of the mapping in bytes
+ * @return The mapped file or NULL if the file has been opened for reading
+ */
+EPDF_PLUGIN_API const char* epdf_document_get_mapping(epdf_document_t* document, size_t* size);
+
+/**
+ * Returns the document owning the parsed document, pages and renderings that
+ * a view shares (see epdf_document_open)
+ *
+ * @param document The document
+ * @return The document itself, or the document the view has been created from
+ */
+EPDF_PLUGIN_API epdf_document_t* epdf_document_get_source(epdf_document_t* document);
+
 /**
  * Returns the password of the document
  *
@@ -164,6 +236,52 @@ EPDF_PLUGIN_API double epdf_document_get_zoom(epdf_document_t* document);
  */
 EPDF_PLUGIN_API double epdf_document_get_scale(epdf_document_t* document);
 
+/**
+ * Returns the measured render cost of a page
+ *
+ * @param document The document
+ * @param index Index of the page
+ * @param cost Set to the cost
+ * @return true if the page has been rendered and measured before
+ */
+EPDF_PLUGIN_API bool epdf_document_get_render_cost(epdf_document_t* document, unsigned int index,
+    epdf_render_cost_t* cost);
+
+/**
+ * Records the cost of rendering a page, called by the render scheduler
+ *
+ * @param document The document
+ * @param index Index of the page
+ * @param milliseconds Time spent rendering
+ * @param objects Objects processed
+ * @param scale Scale of the rendering
+ */
+EPDF_PLUGIN_API void epdf_document_add_render_cost(epdf_document_t* document, unsigned int index,
+    double milliseconds, uint64_t objects, double scale);
+
+/**
+ * Returns the view generation of the document. It changes whenever zoom,
+ * rotation, viewport, position, device factors or recoloring are set; render
+ * jobs submitted for an older generation may be dropped once they are
+ * obsolete.
+ *
+ * @param document The document
+ * @return The generation
+ */
+EPDF_PLUGIN_API unsigned int epdf_document_get_generation(epdf_document_t* document);
+
+/**
+ * Return the scale to render pages for the screen at native resolution:
+ * epdf_document_get_scale multiplied by the device factor. The resulting
+ * images are displayed at 1/factor of their pixel size. Render requests use
+ * this scale, so frames on monitors with different factors share cached pages
+ * whenever their device scale matches.
+ *
+ * @param document The document
+ * @return The device scale (pixels per point)
+ */
+EPDF_PLUGIN_API double epdf_document_get_device_scale(epdf_document_t* document);
+
 /**
  * Sets the new zoom value of the document
  *
@@ -236,6 +354,14 @@ EPDF_PLUGIN_API void* epdf_document_get_data(epdf_document_t* document);
  */
 EPDF_PLUGIN_API void epdf_document_set_data(epdf_document_t* document, void* data);
 
+/**
+ * Returns the backend the document has been opened with
+ *
+ * @param document The document
+ * @return The plugin or NULL
+ */
+EPDF_PLUGIN_API epdf_plugin_t* epdf_document_get_plugin(epdf_document_t* document);
+
 /**
  * Sets the width of the viewport in pixels.
  *
@@ -302,6 +428,24 @@ EPDF_PLUGIN_API epdf_document_set_device_factors(epdf_document_t* document,
 EPDF_PLUGIN_API epdf_device_factors_t
 epdf_document_get_device_factors(epdf_document_t* document);
 
+/**
+ * Sets how rendered pages of the document are recolored (e.g. inverted for a
+ * dark theme). Pages rendered before keep their colors in the render cache
+ * under the previous settings.
+ *
+ * @param document The document
+ * @param recolor The settings or NULL to show pages unchanged
+ */
+EPDF_PLUGIN_API void epdf_document_set_recolor(epdf_document_t* document, const epdf_recolor_t* recolor);
+
+/**
+ * Returns the recolor settings of the document
+ *
+ * @param document The document
+ * @return The settings or NULL if an error occurred
+ */
+EPDF_PLUGIN_API const epdf_recolor_t* epdf_document_get_recolor(epdf_document_t* document);
+
 /**
  * Return the size of a cell from the document's layout table in pixels. Assumes
  * that the table is homogeneous (i.e. every cell has the same dimensions). It
@@ -359,15 +503,138 @@ EPDF_PLUGIN_API unsigned int epdf_document_get_pages_per_row(epdf_document_t* do
  */
 EPDF_PLUGIN_API unsigned int epdf_document_get_first_page_column(epdf_document_t* document);
 
+/**
+ * Returns the memory statistics of the document
+ *
+ * @param document The document object
+ * @param stats Filled with the statistics
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_get_memory_stats(epdf_document_t* document,
+    epdf_memory_stats_t* stats);
+
+/**
+ * Sets the hard memory limit of the document. Allocations beyond the limit
+ * fail with EPDF_ERROR_OUT_OF_MEMORY once caches have been evicted.
+ *
+ * @param document The document object
+ * @param limit The limit in bytes or 0 for no limit
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_set_memory_limit(epdf_document_t* document, uint64_t limit);
+
+/**
+ * Returns the resource store statistics of the document
+ *
+ * @param document The document object
+ * @param stats Filled with the statistics
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_get_store_stats(epdf_document_t* document,
+    epdf_store_stats_t* stats);
+
+/**
+ * Evicts cached resources of the document, e.g. when Emacs goes idle or the
+ * buffer is buried.
+ *
+ * @param document The document object
+ * @param percent Percentage of the current store size to keep (0 empties the
+ *   store)
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_shrink_store(epdf_document_t* document, unsigned int percent);
+
+/**
+ * Sets the memory budget shared by the resource stores of all open
+ * documents. No store of a document opened afterwards is larger than the
+ * budget, and epdf_document_balance_stores shrinks stores until all documents
+ * together fit into it.
+ *
+ * @param limit The budget in bytes or 0 for no budget
+ */
+EPDF_PLUGIN_API void epdf_document_set_global_store_limit(uint64_t limit);
+
+/**
+ * Shrinks the stores of the largest open documents until the memory of all
+ * open documents fits into the global store budget.
+ */
+EPDF_PLUGIN_API void epdf_document_balance_stores(void);
+
 /**
  * Save the document
  *
+ * With options->incremental set, only objects changed since the document was
+ * opened are appended to a copy of the original file (or to the file itself
+ * if path is the document's path). Documents that can not be saved
+ * incrementally, whose file changed on disk since it has been opened or last
+ * saved, or that have been saved in full to their own file before are saved
+ * in full.
+ *
  * @param document The document object
  * @param path Path for the saved file
+ * @param options Save options or NULL for a full save
  * @return EPDF_ERROR_OK when no error occurred, otherwise see
  *    epdf_error_t
  */
-EPDF_PLUGIN_API epdf_error_t epdf_document_save_as(epdf_document_t* document, const char* path);
+EPDF_PLUGIN_API epdf_error_t epdf_document_save_as(epdf_document_t* document, const char* path,
+    const epdf_save_options_t* options);
+
+/**
+ * Callback invoked when an export finished
+ *
+ * @param document The exported document
+ * @param result The result of the export
+ * @param data Custom data
+ */
+typedef void (*epdf_export_callback_t)(epdf_document_t* document,
+    const epdf_export_result_t* result, void* data);
+
+/**
+ * Export an optimized copy of the document. The export runs on a worker
+ * thread, callback (and the progress callback of options) is invoked from
+ * that thread. The document is kept alive until the export finished. A
+ * private copy of the document, including changes that have not been saved,
+ * is exported, so the open document is left untouched.
+ *
+ * @param document The document object
+ * @param path Path for the exported file
+ * @param options Export options
+ * @param callback Callback invoked with the result or NULL
+ * @param data Custom data passed to callback
+ * @return EPDF_ERROR_OK if the export has been started, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_export(epdf_document_t* document, const char* path,
+    const epdf_export_options_t* options, epdf_export_callback_t callback, void* data);
+
+/**
+ * Returns the chapters of a reflowed document (see epdf_reflow_t) that have
+ * been laid out so far. Chapters may start beyond the ready pages until the
+ * next epdf_document_update.
+ *
+ * @param document The document object
+ * @param error Set to an error value (see \ref epdf_error_t) if an
+ *   error occurred
+ * @return Array of unsigned int with the first page of every chapter (free
+ *   with g_array_unref) or NULL if an error occurred
+ */
+EPDF_PLUGIN_API GArray* epdf_document_chapters_get(epdf_document_t* document, epdf_error_t* error);
+
+/**
+ * Returns the attachments of the document. Sizes are read from the document
+ * without decompressing the attached data.
+ *
+ * @param document The document object
+ * @param error Set to an error value (see \ref epdf_error_t) if an
+ *   error occurred
+ * @return Array of epdf_attachment_t (free with g_ptr_array_unref) or NULL if
+ *   an error occurred
+ */
+EPDF_PLUGIN_API GPtrArray* epdf_document_attachments_get(epdf_document_t* document, epdf_error_t* error);
 
 /**
  * Save document attachment
@@ -380,4 +647,28 @@ EPDF_PLUGIN_API epdf_error_t epdf_document_save_as(epdf_document_t* document, co
  */
 EPDF_PLUGIN_API epdf_error_t epdf_document_attachment_save(epdf_document_t* document, const char* attachment, const char* file);
 
+/**
+ * Callback invoked when an attachment has been saved
+ *
+ * @param document The document
+ * @param error EPDF_ERROR_OK if the attachment has been saved
+ * @param data Custom data
+ */
+typedef void (*epdf_attachment_callback_t)(epdf_document_t* document, epdf_error_t error, void* data);
+
+/**
+ * Save document attachment on a worker thread. The data is streamed to the
+ * file in chunks, callback is invoked from the worker thread.
+ *
+ * @param document The document objects
+ * @param attachment name of the attachment
+ * @param file the target filename
+ * @param callback Callback invoked when done or NULL
+ * @param data Custom data passed to callback
+ * @return EPDF_ERROR_OK if the extraction has been started, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_attachment_save_async(epdf_document_t* document,
+    const char* attachment, const char* file, epdf_attachment_callback_t callback, void* data);
+
 #endif // DOCUMENT_H
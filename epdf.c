@@ -22,6 +22,16 @@
 #include <stdlib.h>
 #include <emacs-module.h>
 
+#include "allocator.h"
+#include "document.h"
+#include "image.h"
+#include "metrics.h"
+#include "page-export.h"
+#include "plugin-manager.h"
+#include "recolor.h"
+#include "reload.h"
+#include "trace.h"
+
 #ifdef DEBUG
 #define DEBUG_TEST 1
 #else
@@ -226,6 +236,610 @@ Fmod_test_vector_eq (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
 }
 
 
+/* Helpers.  */
+
+/* Return a copy of the Lisp string VALUE, to be released with free, or
+   NULL with a pending non-local exit if VALUE is not a string.  */
+static char *
+copy_string (emacs_env *env, emacs_value value)
+{
+    ptrdiff_t size = 0;
+    env->copy_string_contents (env, value, NULL, &size);
+    if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+        return NULL;
+
+    char *string = malloc (size);
+    env->copy_string_contents (env, value, string, &size);
+    return string;
+}
+
+/* Signal ERROR, a symbol name, with DATA and return nil.  */
+static emacs_value
+signal_error (emacs_env *env, const char *error, emacs_value data)
+{
+    env->non_local_exit_signal (env, env->intern (env, error), data);
+    return env->intern (env, "nil");
+}
+
+
+/* Tracing.  */
+
+/* Enable tracing if ARG is non-nil, disable it otherwise.  */
+static emacs_value
+Fepdf_trace_enable (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                    void *data)
+{
+    assert (nargs == 1);
+    epdf_trace_set_enabled (env->is_not_nil (env, args[0]));
+    return env->intern (env, epdf_trace_get_enabled () ? "t" : "nil");
+}
+
+/* Return t if tracing is enabled.  */
+static emacs_value
+Fepdf_trace_enabled_p (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                       void *data)
+{
+    return env->intern (env, epdf_trace_get_enabled () ? "t" : "nil");
+}
+
+/* Write the recorded spans to the file in args[0] as Chrome trace
+   JSON.  */
+static emacs_value
+Fepdf_trace_dump (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                  void *data)
+{
+    assert (nargs == 1);
+
+    char *path = copy_string (env, args[0]);
+    if (path == NULL)
+        return env->intern (env, "nil");
+
+    bool written = epdf_trace_dump (path);
+    free (path);
+
+    if (!written)
+        return signal_error (env, "file-error", env->intern (env, "nil"));
+
+    return env->intern (env, "t");
+}
+
+/* Discard the recorded spans.  */
+static emacs_value
+Fepdf_trace_clear (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                   void *data)
+{
+    epdf_trace_clear ();
+    return env->intern (env, "t");
+}
+
+
+/* Metrics.  */
+
+/* Return the runtime metrics as a plist.  Counters and gauges map
+   their names as keywords to integers, :render-latency maps to a
+   vector holding one histogram vector per scale bucket.  */
+static emacs_value
+Fepdf_metrics (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+               void *data)
+{
+    epdf_metrics_t metrics;
+    epdf_metrics_get (&metrics);
+
+    emacs_value plist[2 * (EPDF_COUNTER_NUMBER + EPDF_GAUGE_NUMBER + 1)];
+    ptrdiff_t n = 0;
+    char keyword[64];
+
+    for (int i = 0; i < EPDF_COUNTER_NUMBER; i++)
+        {
+            snprintf (keyword, sizeof keyword, ":%s",
+                      epdf_metrics_counter_name (i));
+            plist[n++] = env->intern (env, keyword);
+            plist[n++] = env->make_integer (env, metrics.counters[i]);
+        }
+
+    for (int i = 0; i < EPDF_GAUGE_NUMBER; i++)
+        {
+            snprintf (keyword, sizeof keyword, ":%s",
+                      epdf_metrics_gauge_name (i));
+            plist[n++] = env->intern (env, keyword);
+            plist[n++] = env->make_integer (env, metrics.gauges[i]);
+        }
+
+    emacs_value Fvector = env->intern (env, "vector");
+    emacs_value buckets[EPDF_METRICS_SCALE_BUCKETS];
+    for (int s = 0; s < EPDF_METRICS_SCALE_BUCKETS; s++)
+        {
+            emacs_value bins[EPDF_METRICS_LATENCY_BINS];
+            for (int b = 0; b < EPDF_METRICS_LATENCY_BINS; b++)
+                bins[b] = env->make_integer (env, metrics.latency[s][b]);
+            buckets[s] = env->funcall (env, Fvector,
+                                       EPDF_METRICS_LATENCY_BINS, bins);
+        }
+    plist[n++] = env->intern (env, ":render-latency");
+    plist[n++] = env->funcall (env, Fvector,
+                               EPDF_METRICS_SCALE_BUCKETS, buckets);
+
+    return env->funcall (env, env->intern (env, "list"), n, plist);
+}
+
+
+/* Documents.  */
+
+/* Instance documents are opened with, created on first use.  */
+static epdf_t *epdf_instance;
+
+static epdf_t *
+get_epdf (void)
+{
+    if (epdf_instance == NULL)
+        epdf_instance = epdf_new ();
+    return epdf_instance;
+}
+
+/* Finalizer of document user pointers.  */
+static void
+document_finalize (void *document)
+{
+    epdf_document_free (document);
+}
+
+static emacs_value
+make_document (emacs_env *env, epdf_document_t *document)
+{
+    return env->make_user_ptr (env, document_finalize, document);
+}
+
+/* Return the document in VALUE or NULL with a pending signal if VALUE
+   is not a document.  */
+static epdf_document_t *
+get_document (emacs_env *env, emacs_value value)
+{
+    if (env->get_user_finalizer (env, value) != document_finalize)
+        {
+            if (env->non_local_exit_check (env) == emacs_funcall_exit_return)
+                signal_error (env, "wrong-type-argument", value);
+            return NULL;
+        }
+    return env->get_user_ptr (env, value);
+}
+
+/* Open the document in args[0] with the password in args[1], if any.
+   Signal file-error if it cannot be opened.  */
+static emacs_value
+Fepdf_open (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char *path = copy_string (env, args[0]);
+    if (path == NULL)
+        return env->intern (env, "nil");
+
+    char *password = NULL;
+    if (nargs > 1 && env->is_not_nil (env, args[1]))
+        {
+            password = copy_string (env, args[1]);
+            if (password == NULL)
+                {
+                    free (path);
+                    return env->intern (env, "nil");
+                }
+        }
+
+    epdf_t *epdf = get_epdf ();
+    epdf_document_t *document = NULL;
+    if (epdf != NULL)
+        document = epdf_document_open (epdf, path, NULL, password, NULL, NULL);
+    free (password);
+    free (path);
+
+    if (document == NULL)
+        return signal_error (env, "file-error", args[0]);
+
+    return make_document (env, document);
+}
+
+/* Open the file of the document in args[0] again.  Return the new
+   revision, or nil if the file has the same hash or cannot be
+   parsed.  */
+static emacs_value
+Fepdf_reload (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    assert (nargs == 1);
+
+    epdf_document_t *current = get_document (env, args[0]);
+    if (current == NULL)
+        return env->intern (env, "nil");
+
+    epdf_document_t *document = epdf_reload_open_revision (get_epdf (), current);
+    if (document == NULL)
+        return env->intern (env, "nil");
+
+    return make_document (env, document);
+}
+
+
+/* Page export.  */
+
+/* Export callback collecting the pages in the order they are
+   reported.  */
+static void
+export_pages_callback (unsigned int page, const char *path,
+                       epdf_error_t error, void *data)
+{
+    if (error == EPDF_ERROR_OK)
+        g_array_append_val ((GArray *) data, page);
+}
+
+/* Export the pages args[2] to args[3] of the document in args[0] to
+   files named args[1]-<number>.<format> at scale args[4].  args[5] is
+   the format, ppm or png (the default), args[6] reports pages in page
+   order if non-nil, args[7] is the number of workers.  Return the
+   indexes of the exported pages in the order they were reported.  */
+static emacs_value
+Fepdf_export_pages (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                    void *data)
+{
+    epdf_document_t *document = get_document (env, args[0]);
+    if (document == NULL)
+        return env->intern (env, "nil");
+
+    intmax_t first = env->extract_integer (env, args[2]);
+    intmax_t last = env->extract_integer (env, args[3]);
+    double scale = env->extract_float (env, args[4]);
+    intmax_t workers = nargs > 7 ? env->extract_integer (env, args[7]) : 0;
+    if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+        return env->intern (env, "nil");
+
+    if (first < 0 || last < first
+        || last >= epdf_document_get_number_of_pages (document))
+        return signal_error (env, "args-out-of-range", args[3]);
+    if (scale <= 0.0)
+        return signal_error (env, "args-out-of-range", args[4]);
+    if (workers < 0)
+        return signal_error (env, "args-out-of-range", args[7]);
+
+    char *prefix = copy_string (env, args[1]);
+    if (prefix == NULL)
+        return env->intern (env, "nil");
+
+    GArray *pages = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+    epdf_page_export_options_t options = {
+        .first_page = first,
+        .last_page = last,
+        .scale = scale,
+        .format = (nargs > 5
+                   && env->eq (env, args[5], env->intern (env, "ppm"))
+                   ? EPDF_PAGE_EXPORT_FORMAT_PPM
+                   : EPDF_PAGE_EXPORT_FORMAT_PNG),
+        .prefix = prefix,
+        .ordered = nargs > 6 && env->is_not_nil (env, args[6]),
+        .workers = workers,
+        .callback = export_pages_callback,
+        .data = pages
+    };
+
+    epdf_error_t error = epdf_document_export_pages (document, &options);
+    free (prefix);
+
+    emacs_value list = env->intern (env, "nil");
+    emacs_value Fcons = env->intern (env, "cons");
+    for (unsigned int i = pages->len; i > 0; i--)
+        {
+            emacs_value cons_args[] = {
+                env->make_integer (env,
+                                   g_array_index (pages, unsigned int, i - 1)),
+                list
+            };
+            list = env->funcall (env, Fcons, 2, cons_args);
+        }
+    g_array_free (pages, TRUE);
+
+    if (error != EPDF_ERROR_OK)
+        return signal_error (env, "file-error", args[1]);
+
+    return list;
+}
+
+
+/* Images.  */
+
+/* Return the dimension in VALUE, or 0 with a pending signal if it is
+   not a positive integer.  */
+static unsigned int
+get_dimension (emacs_env *env, emacs_value value)
+{
+    intmax_t dimension = env->extract_integer (env, value);
+    if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+        return 0;
+    if (dimension <= 0 || dimension > 65535)
+        {
+            signal_error (env, "args-out-of-range", value);
+            return 0;
+        }
+    return dimension;
+}
+
+/* Return an image of WIDTH and HEIGHT holding the RGB bytes in the
+   vector VALUE, or NULL with a pending signal.  */
+static epdf_image_buffer_t *
+get_image (emacs_env *env, emacs_value value, emacs_value width,
+           emacs_value height)
+{
+    unsigned int w = get_dimension (env, width);
+    unsigned int h = w == 0 ? 0 : get_dimension (env, height);
+    if (h == 0)
+        return NULL;
+
+    ptrdiff_t size = env->vec_size (env, value);
+    if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+        return NULL;
+    if (size != (ptrdiff_t) w * h * 3)
+        {
+            signal_error (env, "args-out-of-range", value);
+            return NULL;
+        }
+
+    epdf_image_buffer_t *image = epdf_image_buffer_create (w, h);
+    if (image == NULL)
+        {
+            signal_error (env, "error", value);
+            return NULL;
+        }
+
+    for (ptrdiff_t i = 0; i < size; i++)
+        {
+            emacs_value element = env->vec_get (env, value, i);
+            intmax_t byte = env->extract_integer (env, element);
+            if (env->non_local_exit_check (env) != emacs_funcall_exit_return
+                || byte < 0 || byte > 255)
+                {
+                    if (env->non_local_exit_check (env)
+                        == emacs_funcall_exit_return)
+                        signal_error (env, "args-out-of-range", element);
+                    epdf_image_buffer_free (image);
+                    return NULL;
+                }
+            image->data[i] = byte;
+        }
+
+    return image;
+}
+
+/* Return the RGB bytes of IMAGE as a vector.  */
+static emacs_value
+make_pixels (emacs_env *env, const epdf_image_buffer_t *image)
+{
+    size_t size = (size_t) image->rowstride * image->height;
+    emacs_value make_args[] = { env->make_integer (env, size),
+                                env->make_integer (env, 0) };
+    emacs_value vector = env->funcall (env, env->intern (env, "make-vector"),
+                                       2, make_args);
+    for (size_t i = 0; i < size; i++)
+        env->vec_set (env, vector, i, env->make_integer (env, image->data[i]));
+
+    return vector;
+}
+
+/* Scale the image of args[1] x args[2] pixels in the vector args[0]
+   of RGB bytes to args[3] x args[4] pixels.  Return the vector of RGB
+   bytes of the scaled image.  */
+static emacs_value
+Fepdf_image_scale (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                   void *data)
+{
+    assert (nargs == 5);
+
+    epdf_image_buffer_t *image = get_image (env, args[0], args[1], args[2]);
+    if (image == NULL)
+        return env->intern (env, "nil");
+
+    unsigned int width = get_dimension (env, args[3]);
+    unsigned int height = width == 0 ? 0 : get_dimension (env, args[4]);
+    if (height == 0)
+        {
+            epdf_image_buffer_free (image);
+            return env->intern (env, "nil");
+        }
+
+    epdf_image_buffer_t *scaled = epdf_image_buffer_scale (image, width,
+                                                           height);
+    epdf_image_buffer_free (image);
+    if (scaled == NULL)
+        return signal_error (env, "error", args[0]);
+
+    emacs_value vector = make_pixels (env, scaled);
+    epdf_image_buffer_free (scaled);
+
+    return vector;
+}
+
+/* Fill COLOR from the vector VALUE of three bytes.  Return false with
+   a pending signal if VALUE is not such a vector.  */
+static bool
+get_color (emacs_env *env, emacs_value value, uint8_t color[3])
+{
+    if (env->vec_size (env, value) != 3)
+        {
+            if (env->non_local_exit_check (env) == emacs_funcall_exit_return)
+                signal_error (env, "args-out-of-range", value);
+            return false;
+        }
+
+    for (ptrdiff_t i = 0; i < 3; i++)
+        {
+            emacs_value element = env->vec_get (env, value, i);
+            intmax_t byte = env->extract_integer (env, element);
+            if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+                return false;
+            if (byte < 0 || byte > 255)
+                {
+                    signal_error (env, "args-out-of-range", element);
+                    return false;
+                }
+            color[i] = byte;
+        }
+
+    return true;
+}
+
+/* Recolor the image of args[1] x args[2] pixels in the vector args[0]
+   of RGB bytes with the mode args[3]: nil, invert or two-color.
+   two-color maps black to the foreground args[4] and white to the
+   background args[5], both vectors of RGB bytes.  Return the vector of
+   RGB bytes of the recolored image.  */
+static emacs_value
+Fepdf_image_recolor (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                     void *data)
+{
+    epdf_recolor_t recolor;
+    epdf_recolor_init (&recolor);
+
+    if (env->eq (env, args[3], env->intern (env, "invert")))
+        recolor.mode = EPDF_RECOLOR_INVERT;
+    else if (env->eq (env, args[3], env->intern (env, "two-color")))
+        {
+            recolor.mode = EPDF_RECOLOR_TWO_COLOR;
+            if (nargs < 6)
+                return signal_error (env, "wrong-number-of-arguments",
+                                     env->make_integer (env, nargs));
+            if (!get_color (env, args[4], recolor.foreground)
+                || !get_color (env, args[5], recolor.background))
+                return env->intern (env, "nil");
+        }
+    else if (env->is_not_nil (env, args[3]))
+        return signal_error (env, "wrong-type-argument", args[3]);
+
+    epdf_image_buffer_t *image = get_image (env, args[0], args[1], args[2]);
+    if (image == NULL)
+        return env->intern (env, "nil");
+
+    epdf_recolor_apply (&recolor, image);
+
+    emacs_value vector = make_pixels (env, image);
+    epdf_image_buffer_free (image);
+
+    return vector;
+}
+
+/* Return the image of args[1] x args[2] pixels in the vector args[0]
+   of RGB bytes as a unibyte string holding binary PPM.  */
+static emacs_value
+Fepdf_image_ppm (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                 void *data)
+{
+    assert (nargs == 3);
+
+    epdf_image_buffer_t *image = get_image (env, args[0], args[1], args[2]);
+    if (image == NULL)
+        return env->intern (env, "nil");
+
+    size_t size = 0;
+    const unsigned char *ppm = epdf_image_buffer_get_ppm (image, &size);
+
+    emacs_value *bytes = malloc (size * sizeof (emacs_value));
+    if (bytes == NULL)
+        {
+            epdf_image_buffer_free (image);
+            return signal_error (env, "error", args[0]);
+        }
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = env->make_integer (env, ppm[i]);
+    epdf_image_buffer_free (image);
+
+    emacs_value string = env->funcall (env, env->intern (env, "unibyte-string"),
+                                       size, bytes);
+    free (bytes);
+
+    return string;
+}
+
+
+/* Memory.  */
+
+/* Return the memory statistics of the document in args[0] as a plist
+   mapping :live, :peak, :limit, :pooled, :allocations and :failed to
+   integers.  */
+static emacs_value
+Fepdf_memory_stats (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                    void *data)
+{
+    assert (nargs == 1);
+
+    epdf_document_t *document = get_document (env, args[0]);
+    if (document == NULL)
+        return env->intern (env, "nil");
+
+    epdf_memory_stats_t stats;
+    if (epdf_document_get_memory_stats (document, &stats) != EPDF_ERROR_OK)
+        return signal_error (env, "error", args[0]);
+
+    emacs_value plist[] = {
+        env->intern (env, ":live"), env->make_integer (env, stats.live),
+        env->intern (env, ":peak"), env->make_integer (env, stats.peak),
+        env->intern (env, ":limit"), env->make_integer (env, stats.limit),
+        env->intern (env, ":pooled"), env->make_integer (env, stats.pooled),
+        env->intern (env, ":allocations"),
+        env->make_integer (env, stats.allocations),
+        env->intern (env, ":failed"), env->make_integer (env, stats.failed)
+    };
+
+    return env->funcall (env, env->intern (env, "list"),
+                         sizeof plist / sizeof plist[0], plist);
+}
+
+/* Return the limit in VALUE, or -1 with a pending signal if it is
+   negative.  */
+static intmax_t
+get_memory_limit (emacs_env *env, emacs_value value)
+{
+    intmax_t limit = env->extract_integer (env, value);
+    if (env->non_local_exit_check (env) != emacs_funcall_exit_return)
+        return -1;
+    if (limit < 0)
+        {
+            signal_error (env, "args-out-of-range", value);
+            return -1;
+        }
+    return limit;
+}
+
+/* Set the memory limit of the document in args[0] to args[1] bytes,
+   0 for no limit.  */
+static emacs_value
+Fepdf_set_memory_limit (emacs_env *env, ptrdiff_t nargs, emacs_value args[],
+                        void *data)
+{
+    assert (nargs == 2);
+
+    epdf_document_t *document = get_document (env, args[0]);
+    if (document == NULL)
+        return env->intern (env, "nil");
+
+    intmax_t limit = get_memory_limit (env, args[1]);
+    if (limit < 0)
+        return env->intern (env, "nil");
+
+    if (epdf_document_set_memory_limit (document, limit) != EPDF_ERROR_OK)
+        return signal_error (env, "error", args[0]);
+
+    return env->intern (env, "t");
+}
+
+/* Set the memory limit of documents opened from now on to args[0]
+   bytes, 0 for no limit.  */
+static emacs_value
+Fepdf_set_default_memory_limit (emacs_env *env, ptrdiff_t nargs,
+                                emacs_value args[], void *data)
+{
+    assert (nargs == 1);
+
+    intmax_t limit = get_memory_limit (env, args[0]);
+    if (limit < 0)
+        return env->intern (env, "nil");
+
+    epdf_allocator_set_default_limit (limit);
+    return env->intern (env, "t");
+}
+
+
 /* Lisp utilities for easier readability (simple wrappers).  */
 
 /* Provide FEATURE to Emacs.  */
@@ -292,6 +906,53 @@ emacs_module_init (struct emacs_runtime *ert)
     DEFUN ("mod-test-vector-fill", Fmod_test_vector_fill, 2, 2, NULL, NULL);
     DEFUN ("mod-test-vector-eq", Fmod_test_vector_eq, 2, 2, NULL, NULL);
 
+    DEFUN ("epdf-trace-enable", Fepdf_trace_enable, 1, 1,
+           "Enable tracing if ARG is non-nil, disable it otherwise.", NULL);
+    DEFUN ("epdf-trace-enabled-p", Fepdf_trace_enabled_p, 0, 0,
+           "Return t if tracing is enabled.", NULL);
+    DEFUN ("epdf-trace-dump", Fepdf_trace_dump, 1, 1,
+           "Write the recorded trace to FILE as Chrome trace JSON.", NULL);
+    DEFUN ("epdf-trace-clear", Fepdf_trace_clear, 0, 0,
+           "Discard the recorded trace.", NULL);
+
+    DEFUN ("epdf-metrics", Fepdf_metrics, 0, 0,
+           "Return the runtime metrics as a plist.", NULL);
+
+    DEFUN ("epdf-open", Fepdf_open, 1, 2,
+           "Open the document FILE with PASSWORD, if any.", NULL);
+    DEFUN ("epdf-reload", Fepdf_reload, 1, 1,
+           "Open the file of DOCUMENT again.\n"
+           "Return the new revision, or nil if the file did not change.", NULL);
+
+    DEFUN ("epdf-export-pages", Fepdf_export_pages, 5, 8,
+           "Export the pages FIRST to LAST of DOCUMENT at SCALE to files\n"
+           "named PREFIX-<number>.<FORMAT>, where FORMAT is ppm or png.\n"
+           "Pages are reported in page order if ORDERED is non-nil.  WORKERS\n"
+           "is the number of threads.  Return the indexes of the exported\n"
+           "pages in the order they were reported.", NULL);
+
+    DEFUN ("epdf-image-scale", Fepdf_image_scale, 5, 5,
+           "Scale the WIDTH x HEIGHT image in the vector PIXELS of RGB bytes.\n"
+           "Return the RGB bytes of the NEW-WIDTH x NEW-HEIGHT image.", NULL);
+    DEFUN ("epdf-image-recolor", Fepdf_image_recolor, 4, 6,
+           "Recolor the WIDTH x HEIGHT image in the vector PIXELS of RGB bytes.\n"
+           "MODE is nil, invert or two-color, which maps black to FOREGROUND\n"
+           "and white to BACKGROUND.  Return the RGB bytes of the result.",
+           NULL);
+    DEFUN ("epdf-image-ppm", Fepdf_image_ppm, 3, 3,
+           "Return the WIDTH x HEIGHT image in the vector PIXELS of RGB bytes\n"
+           "as a unibyte string holding binary PPM.", NULL);
+
+    DEFUN ("epdf-memory-stats", Fepdf_memory_stats, 1, 1,
+           "Return the memory statistics of DOCUMENT as a plist.", NULL);
+    DEFUN ("epdf-set-memory-limit", Fepdf_set_memory_limit, 2, 2,
+           "Limit the memory of DOCUMENT to LIMIT bytes, 0 for no limit.",
+           NULL);
+    DEFUN ("epdf-set-default-memory-limit", Fepdf_set_default_memory_limit,
+           1, 1,
+           "Limit the memory of documents opened from now on to LIMIT bytes.\n"
+           "0 means no limit.", NULL);
+
 #undef DEFUN
 
     provide (env, "epdf");
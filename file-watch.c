@@ -0,0 +1,169 @@
+#include <string.h>
+#include <glib.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "file-watch.h"
+
+struct epdf_file_watch_s
+{
+    char* path;
+    char* basename;
+    int fd; /* inotify instance */
+    int wake[2]; /* pipe that stops the thread */
+    GThread* thread;
+    epdf_file_watch_callback_t callback;
+    void* data;
+};
+
+#ifdef __linux__
+
+#define FILE_WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+static void
+file_watch_dispatch(epdf_file_watch_t* watch, const struct inotify_event* event)
+{
+    if (event->len == 0 || strcmp(event->name, watch->basename) != 0) {
+        return;
+    }
+
+    if ((event->mask & IN_MODIFY) != 0) {
+        watch->callback(watch->path, EPDF_FILE_EVENT_MODIFIED, watch->data);
+    }
+    if ((event->mask & IN_CLOSE_WRITE) != 0) {
+        watch->callback(watch->path, EPDF_FILE_EVENT_CLOSED, watch->data);
+    }
+    if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+        watch->callback(watch->path, EPDF_FILE_EVENT_REPLACED, watch->data);
+    }
+    if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+        watch->callback(watch->path, EPDF_FILE_EVENT_DELETED, watch->data);
+    }
+}
+
+static gpointer
+file_watch_thread(gpointer data)
+{
+    epdf_file_watch_t* watch = data;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        struct pollfd fds[2] = {
+            { .fd = watch->fd, .events = POLLIN },
+            { .fd = watch->wake[0], .events = POLLIN },
+        };
+
+        if (poll(fds, 2, -1) < 0) {
+            continue;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        const ssize_t length = read(watch->fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = (const struct inotify_event*) p;
+            file_watch_dispatch(watch, event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return NULL;
+}
+
+epdf_file_watch_t*
+epdf_file_watch_new(const char* path, epdf_file_watch_callback_t callback, void* data)
+{
+    if (path == NULL || callback == NULL) {
+        return NULL;
+    }
+
+    epdf_file_watch_t* watch = g_try_malloc0(sizeof(epdf_file_watch_t));
+    if (watch == NULL) {
+        return NULL;
+    }
+
+    watch->wake[0]  = -1;
+    watch->wake[1]  = -1;
+    watch->path     = g_strdup(path);
+    watch->basename = g_path_get_basename(path);
+    watch->callback = callback;
+    watch->data     = data;
+
+    watch->fd = inotify_init1(IN_CLOEXEC);
+    if (watch->fd < 0 || pipe(watch->wake) != 0) {
+        goto error_free;
+    }
+
+    char* directory = g_path_get_dirname(path);
+    const int wd    = inotify_add_watch(watch->fd, directory, FILE_WATCH_MASK);
+    g_free(directory);
+    if (wd < 0) {
+        goto error_free;
+    }
+
+    watch->thread = g_thread_try_new("epdf-file-watch", file_watch_thread, watch, NULL);
+    if (watch->thread == NULL) {
+        goto error_free;
+    }
+
+    return watch;
+
+error_free:
+
+    epdf_file_watch_free(watch);
+
+    return NULL;
+}
+
+void
+epdf_file_watch_free(epdf_file_watch_t* watch)
+{
+    if (watch == NULL) {
+        return;
+    }
+
+    if (watch->thread != NULL) {
+        const char stop = 0;
+        while (write(watch->wake[1], &stop, 1) != 1) {
+        }
+        g_thread_join(watch->thread);
+    }
+
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (watch->wake[i] >= 0) {
+            close(watch->wake[i]);
+        }
+    }
+
+    g_free(watch->path);
+    g_free(watch->basename);
+    g_free(watch);
+}
+
+#else
+
+epdf_file_watch_t*
+epdf_file_watch_new(const char* UNUSED(path), epdf_file_watch_callback_t UNUSED(callback),
+                    void* UNUSED(data))
+{
+    return NULL;
+}
+
+void
+epdf_file_watch_free(epdf_file_watch_t* UNUSED(watch))
+{
+}
+
+#endif
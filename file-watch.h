@@ -0,0 +1,47 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Changes reported for a watched file
+ */
+typedef enum epdf_file_event_e
+{
+    EPDF_FILE_EVENT_MODIFIED, /**< Data has been written to the file */
+    EPDF_FILE_EVENT_CLOSED, /**< A writer closed the file */
+    EPDF_FILE_EVENT_REPLACED, /**< The file has been created or another file has been moved over it */
+    EPDF_FILE_EVENT_DELETED /**< The file has been deleted or moved away */
+} epdf_file_event_t;
+
+/**
+ * Callback invoked from the thread of the watch
+ *
+ * @param path Path of the watched file
+ * @param event The change
+ * @param data Custom data
+ */
+typedef void (*epdf_file_watch_callback_t)(const char* path, epdf_file_event_t event, void* data);
+
+/**
+ * Watches a file for changes. The directory of the file is watched, so the
+ * watch keeps working when the file is replaced by a rename.
+ *
+ * @param path Path of the file
+ * @param callback Callback invoked for every change
+ * @param data Custom data passed to callback
+ * @return The watch or NULL if the platform has no file notifications
+ */
+EPDF_PLUGIN_API epdf_file_watch_t* epdf_file_watch_new(const char* path,
+    epdf_file_watch_callback_t callback, void* data);
+
+/**
+ * Stops and frees a watch. No callback runs once this returns; it must not be
+ * called from the callback.
+ *
+ * @param watch The watch
+ */
+EPDF_PLUGIN_API void epdf_file_watch_free(epdf_file_watch_t* watch);
+
+#endif // FILE_WATCH_H
@@ -0,0 +1,315 @@
+/* Synthetic PDF generator for reproducible benchmarks.
+
+   Usage: gen [-n PAGES] [-m a4|letter|a3|a5|mix] [-t LINES] [-v PATHS]
+              [-i IMAGES] [-o DEPTH] [-S SEED] OUTPUT.pdf
+
+   Writes a document with PAGES pages (1 to 100000) of the given size, or a
+   random mix of sizes. Every page carries LINES lines of text, PATHS stroked
+   vector paths and IMAGES placed images (drawn from a small shared pool).
+   The outline is DEPTH levels deep with four children per entry. The output
+   only depends on the options and SEED, so corpora can be regenerated on any
+   machine and fed to `bench run`. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "macros.h"
+
+#define GEN_MAX_PAGES 100000
+#define GEN_MAX_OUTLINE_DEPTH 6
+#define GEN_OUTLINE_CHILDREN 4
+#define GEN_IMAGE_POOL 8
+#define GEN_WORDS_PER_LINE 10
+
+typedef struct gen_size_s
+{
+    const char* name;
+    double width;
+    double height;
+} gen_size_t;
+
+static const gen_size_t sizes[] = {
+    { "a4",     595.0,  842.0 },
+    { "letter", 612.0,  792.0 },
+    { "a3",     842.0, 1191.0 },
+    { "a5",     420.0,  595.0 },
+};
+
+static const char* words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "the", "render", "page", "document",
+    "scale", "viewport", "cache", "glyph", "vector", "search", "outline", "stream",
+    "object", "font", "image", "latency", "memory", "worker", "budget",
+};
+
+typedef struct gen_options_s
+{
+    unsigned int pages;
+    int size; /* index into sizes, -1 for a mix */
+    unsigned int lines;
+    unsigned int paths;
+    unsigned int images;
+    unsigned int outline_depth;
+    guint32 seed;
+} gen_options_t;
+
+/* Pool of images shared by all pages, gradients with deterministic noise */
+static void
+gen_add_images(fz_context* ctx, pdf_document* doc, GRand* rand, pdf_obj* xobjects)
+{
+    for (unsigned int i = 0; i < GEN_IMAGE_POOL; i++) {
+        const int width  = 64 << (i % 3);
+        const int height = 48 << (i % 3);
+
+        fz_pixmap* pixmap = fz_new_pixmap(ctx, fz_device_rgb(ctx), width, height, NULL, 0);
+        unsigned char* samples = fz_pixmap_samples(ctx, pixmap);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                unsigned char* p = samples + (size_t) y * fz_pixmap_stride(ctx, pixmap) + 3 * x;
+                p[0] = x * 255 / width;
+                p[1] = y * 255 / height;
+                p[2] = g_rand_int_range(rand, 0, 256);
+            }
+        }
+
+        fz_image* image = fz_new_image_from_pixmap(ctx, pixmap, NULL);
+        pdf_obj* ref    = pdf_add_image(ctx, doc, image);
+
+        char name[16];
+        g_snprintf(name, sizeof(name), "Im%u", i);
+        pdf_dict_puts_drop(ctx, xobjects, name, ref);
+
+        fz_drop_image(ctx, image);
+        fz_drop_pixmap(ctx, pixmap);
+    }
+}
+
+static void
+gen_page_contents(fz_context* ctx, fz_buffer* buffer, GRand* rand, const gen_options_t* options,
+                  double width, double height)
+{
+    const double margin = 48.0;
+
+    /* vector paths below the text */
+    for (unsigned int i = 0; i < options->paths; i++) {
+        fz_append_printf(ctx, buffer, "%g %g %g RG %g w\n", g_rand_double(rand), g_rand_double(rand),
+                         g_rand_double(rand), 0.25 + g_rand_double(rand));
+        fz_append_printf(ctx, buffer, "%g %g m\n", g_rand_double_range(rand, 0, width),
+                         g_rand_double_range(rand, 0, height));
+        for (unsigned int segment = 0; segment < 16; segment++) {
+            fz_append_printf(ctx, buffer, "%g %g l\n", g_rand_double_range(rand, 0, width),
+                             g_rand_double_range(rand, 0, height));
+        }
+        fz_append_string(ctx, buffer, "S\n");
+    }
+
+    for (unsigned int i = 0; i < options->images; i++) {
+        const double w = g_rand_double_range(rand, 32, width / 3);
+        const double h = w * 0.75;
+        fz_append_printf(ctx, buffer, "q %g 0 0 %g %g %g cm /Im%d Do Q\n", w, h,
+                         g_rand_double_range(rand, 0, width - w), g_rand_double_range(rand, 0, height - h),
+                         g_rand_int_range(rand, 0, GEN_IMAGE_POOL));
+    }
+
+    if (options->lines == 0) {
+        return;
+    }
+
+    const double leading = MIN(14.0, (height - 2 * margin) / options->lines);
+    fz_append_printf(ctx, buffer, "BT /F1 %g Tf %g TL %g %g Td\n", leading * 0.8, leading, margin,
+                     height - margin);
+    for (unsigned int line = 0; line < options->lines; line++) {
+        fz_append_byte(ctx, buffer, '(');
+        for (unsigned int w = 0; w < GEN_WORDS_PER_LINE; w++) {
+            if (w > 0) {
+                fz_append_byte(ctx, buffer, ' ');
+            }
+            fz_append_string(ctx, buffer, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+        }
+        fz_append_string(ctx, buffer, ") '\n");
+    }
+    fz_append_string(ctx, buffer, "ET\n");
+}
+
+/* Adds the outline entries below parent covering count pages from first and
+ * returns the number of visible descendants */
+static int
+gen_outline(fz_context* ctx, pdf_document* doc, pdf_obj* parent, unsigned int depth,
+            unsigned int first, unsigned int count, const char* label)
+{
+    if (depth == 0 || count == 0) {
+        return 0;
+    }
+
+    const unsigned int children = MIN(GEN_OUTLINE_CHILDREN, count);
+    pdf_obj* previous = NULL;
+    int total = 0;
+
+    for (unsigned int i = 0; i < children; i++) {
+        const unsigned int start = first + (unsigned int) ((uint64_t) count * i / children);
+        const unsigned int end   = first + (unsigned int) ((uint64_t) count * (i + 1) / children);
+
+        char* title = g_strdup_printf("%s%s%u", label, *label != '\0' ? "." : "Chapter ", i + 1);
+
+        pdf_obj* item = pdf_add_new_dict(ctx, doc, 6);
+        pdf_dict_put_text_string(ctx, item, PDF_NAME(Title), title);
+        pdf_dict_put(ctx, item, PDF_NAME(Parent), parent);
+
+        pdf_obj* dest = pdf_dict_put_array(ctx, item, PDF_NAME(Dest), 2);
+        pdf_array_push(ctx, dest, pdf_lookup_page_obj(ctx, doc, start));
+        pdf_array_push(ctx, dest, PDF_NAME(Fit));
+
+        if (previous == NULL) {
+            pdf_dict_put(ctx, parent, PDF_NAME(First), item);
+        } else {
+            pdf_dict_put(ctx, previous, PDF_NAME(Next), item);
+            pdf_dict_put(ctx, item, PDF_NAME(Prev), previous);
+        }
+        pdf_dict_put(ctx, parent, PDF_NAME(Last), item);
+
+        const int descendants = gen_outline(ctx, doc, item, depth - 1, start, end - start, title);
+        if (descendants > 0) {
+            pdf_dict_put_int(ctx, item, PDF_NAME(Count), descendants);
+        }
+        total += 1 + descendants;
+
+        g_free(title);
+        pdf_drop_obj(ctx, previous);
+        previous = item;
+    }
+    pdf_drop_obj(ctx, previous);
+
+    return total;
+}
+
+static int
+gen_document(const gen_options_t* options, const char* path)
+{
+    fz_context* ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+    if (ctx == NULL) {
+        fprintf(stderr, "gen: can not create context\n");
+        return EXIT_FAILURE;
+    }
+
+    pdf_document* doc     = NULL;
+    fz_font* font         = NULL;
+    pdf_obj* resources    = NULL;
+    fz_buffer* contents   = NULL;
+    GRand* rand           = g_rand_new_with_seed(options->seed);
+    int ret               = EXIT_SUCCESS;
+
+    fz_var(doc);
+    fz_var(font);
+    fz_var(resources);
+    fz_var(contents);
+
+    fz_try (ctx) {
+        doc = pdf_create_document(ctx);
+
+        /* resources shared by all pages */
+        resources        = pdf_add_new_dict(ctx, doc, 2);
+        pdf_obj* fonts   = pdf_dict_put_dict(ctx, resources, PDF_NAME(Font), 1);
+        pdf_obj* xobject = pdf_dict_put_dict(ctx, resources, PDF_NAME(XObject), GEN_IMAGE_POOL);
+
+        font = fz_new_base14_font(ctx, "Helvetica");
+        pdf_dict_puts_drop(ctx, fonts, "F1", pdf_add_simple_font(ctx, doc, font, PDF_SIMPLE_ENCODING_LATIN));
+        if (options->images > 0) {
+            gen_add_images(ctx, doc, rand, xobject);
+        }
+
+        for (unsigned int i = 0; i < options->pages; i++) {
+            const gen_size_t* size = &sizes[options->size >= 0 ? options->size
+                                            : g_rand_int_range(rand, 0, G_N_ELEMENTS(sizes))];
+            const fz_rect mediabox = { 0, 0, size->width, size->height };
+
+            contents = fz_new_buffer(ctx, 4096);
+            gen_page_contents(ctx, contents, rand, options, size->width, size->height);
+
+            pdf_obj* page = pdf_add_page(ctx, doc, mediabox, 0, resources, contents);
+            pdf_insert_page(ctx, doc, -1, page);
+            pdf_drop_obj(ctx, page);
+
+            fz_drop_buffer(ctx, contents);
+            contents = NULL;
+        }
+
+        if (options->outline_depth > 0) {
+            pdf_obj* outlines = pdf_add_new_dict(ctx, doc, 4);
+            pdf_dict_put(ctx, outlines, PDF_NAME(Type), PDF_NAME(Outlines));
+            const int count = gen_outline(ctx, doc, outlines, options->outline_depth, 0, options->pages, "");
+            pdf_dict_put_int(ctx, outlines, PDF_NAME(Count), count);
+            pdf_dict_put_drop(ctx, pdf_dict_get(ctx, pdf_trailer(ctx, doc), PDF_NAME(Root)),
+                              PDF_NAME(Outlines), outlines);
+        }
+
+        pdf_write_options write_options = { 0 };
+        write_options.do_compress = 1;
+        write_options.do_garbage  = 1;
+        pdf_save_document(ctx, doc, path, &write_options);
+    } fz_always (ctx) {
+        fz_drop_buffer(ctx, contents);
+        pdf_drop_obj(ctx, resources);
+        fz_drop_font(ctx, font);
+        pdf_drop_document(ctx, doc);
+    } fz_catch (ctx) {
+        fprintf(stderr, "gen: %s\n", fz_caught_message(ctx));
+        ret = EXIT_FAILURE;
+    }
+
+    g_rand_free(rand);
+    fz_drop_context(ctx);
+
+    return ret;
+}
+
+int
+main(int argc, char* argv[])
+{
+    gen_options_t options = {
+        .pages         = 100,
+        .size          = 0,
+        .lines         = 40,
+        .paths         = 0,
+        .images        = 0,
+        .outline_depth = 2,
+        .seed          = 1,
+    };
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            options.pages = CLAMP(atoi(argv[++i]), 1, GEN_MAX_PAGES);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            options.size = -1;
+            for (unsigned int s = 0; s < G_N_ELEMENTS(sizes); s++) {
+                if (strcmp(sizes[s].name, name) == 0) {
+                    options.size = s;
+                }
+            }
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options.lines = MAX(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            options.paths = MAX(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            options.images = MAX(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options.outline_depth = CLAMP(atoi(argv[++i]), 0, GEN_MAX_OUTLINE_DEPTH);
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            options.seed = strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s [-n PAGES] [-m a4|letter|a3|a5|mix] [-t LINES] [-v PATHS]\n"
+                "          [-i IMAGES] [-o DEPTH] [-S SEED] OUTPUT.pdf\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return gen_document(&options, path);
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "image.h"
+
+/* Room for "P6\n<width> <height>\n255\n" with 10 digit dimensions */
+#define IMAGE_HEADER_SIZE 32
+
+epdf_image_buffer_t*
+epdf_image_buffer_create(unsigned int width, unsigned int height)
+{
+    if (width == 0 || height == 0 || width > G_MAXUINT / 3 / height) {
+        return NULL;
+    }
+
+    epdf_image_buffer_t* buffer = g_try_malloc0(sizeof(epdf_image_buffer_t));
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    buffer->memory = g_try_malloc(IMAGE_HEADER_SIZE + (gsize) width * height * 3);
+    if (buffer->memory == NULL) {
+        g_free(buffer);
+        return NULL;
+    }
+
+    /* the header ends right where the pixels start */
+    char header[IMAGE_HEADER_SIZE];
+    const int length = g_snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+
+    buffer->data      = buffer->memory + IMAGE_HEADER_SIZE;
+    buffer->ppm       = buffer->data - length;
+    buffer->width     = width;
+    buffer->height    = height;
+    buffer->rowstride = width * 3;
+    buffer->ref_count = 1;
+    memcpy(buffer->ppm, header, length);
+
+    return buffer;
+}
+
+epdf_image_buffer_t*
+epdf_image_buffer_ref(epdf_image_buffer_t* buffer)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    g_atomic_int_inc(&buffer->ref_count);
+
+    return buffer;
+}
+
+void
+epdf_image_buffer_free(epdf_image_buffer_t* buffer)
+{
+    if (buffer == NULL || g_atomic_int_dec_and_test(&buffer->ref_count) == FALSE) {
+        return;
+    }
+
+    g_free(buffer->memory);
+    g_free(buffer);
+}
+
+epdf_image_buffer_t*
+epdf_image_buffer_copy(const epdf_image_buffer_t* buffer)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    epdf_image_buffer_t* copy = epdf_image_buffer_create(buffer->width, buffer->height);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    for (unsigned int y = 0; y < buffer->height; y++) {
+        memcpy(copy->data + (size_t) y * copy->rowstride, buffer->data + (size_t) y * buffer->rowstride,
+               copy->rowstride);
+    }
+
+    return copy;
+}
+
+epdf_image_buffer_t*
+epdf_image_buffer_scale(const epdf_image_buffer_t* buffer, unsigned int width, unsigned int height)
+{
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    epdf_image_buffer_t* scaled = epdf_image_buffer_create(width, height);
+    if (scaled == NULL) {
+        return NULL;
+    }
+
+    /* bilinear, source coordinates in 16.16 fixed point */
+    const uint64_t step_x = ((uint64_t) buffer->width << 16) / width;
+    const uint64_t step_y = ((uint64_t) buffer->height << 16) / height;
+
+    for (unsigned int y = 0; y < height; y++) {
+        const uint64_t sy    = y * step_y;
+        const unsigned int y0 = MIN(sy >> 16, buffer->height - 1);
+        const unsigned int y1 = MIN(y0 + 1, buffer->height - 1);
+        const unsigned int fy = (sy >> 8) & 0xff;
+
+        const unsigned char* row0 = buffer->data + (size_t) y0 * buffer->rowstride;
+        const unsigned char* row1 = buffer->data + (size_t) y1 * buffer->rowstride;
+        unsigned char* out        = scaled->data + (size_t) y * scaled->rowstride;
+
+        for (unsigned int x = 0; x < width; x++) {
+            const uint64_t sx    = x * step_x;
+            const unsigned int x0 = MIN(sx >> 16, buffer->width - 1) * 3;
+            const unsigned int x1 = MIN((sx >> 16) + 1, buffer->width - 1) * 3;
+            const unsigned int fx = (sx >> 8) & 0xff;
+
+            for (unsigned int c = 0; c < 3; c++) {
+                const unsigned int top    = row0[x0 + c] * (256 - fx) + row0[x1 + c] * fx;
+                const unsigned int bottom = row1[x0 + c] * (256 - fx) + row1[x1 + c] * fx;
+                *out++ = (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+            }
+        }
+    }
+
+    return scaled;
+}
+
+const unsigned char*
+epdf_image_buffer_get_ppm(const epdf_image_buffer_t* buffer, size_t* size)
+{
+    if (buffer == NULL || size == NULL) {
+        return NULL;
+    }
+
+    *size = (buffer->data - buffer->ppm) + (size_t) buffer->rowstride * buffer->height;
+
+    return buffer->ppm;
+}
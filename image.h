@@ -0,0 +1,68 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Creates an image buffer. Rows are packed (rowstride is width * 3) and the
+ * allocation leaves room for a PPM header in front of the pixels, so the
+ * buffer can be handed out as a PPM image without copying.
+ *
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @return The image buffer or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_image_buffer_t* epdf_image_buffer_create(unsigned int width, unsigned int height);
+
+/**
+ * Takes a reference to the image buffer. Shared images must not be modified.
+ *
+ * @param buffer The image buffer
+ * @return The image buffer
+ */
+EPDF_PLUGIN_API epdf_image_buffer_t* epdf_image_buffer_ref(epdf_image_buffer_t* buffer);
+
+/**
+ * Drops a reference to the image buffer and frees it with the last one
+ *
+ * @param buffer The image buffer
+ */
+EPDF_PLUGIN_API void epdf_image_buffer_free(epdf_image_buffer_t* buffer);
+
+/**
+ * Creates an unshared copy of the image, e.g. to modify a cached image
+ *
+ * @param buffer The image buffer
+ * @return The copy or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_image_buffer_t* epdf_image_buffer_copy(const epdf_image_buffer_t* buffer);
+
+/**
+ * Creates a scaled copy of the image using bilinear filtering. Meant for
+ * previews, e.g. while a page is re-rendered at a new zoom level.
+ *
+ * @param buffer The image buffer
+ * @param width Width of the copy in pixels
+ * @param height Height of the copy in pixels
+ * @return The scaled image or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_image_buffer_t* epdf_image_buffer_scale(const epdf_image_buffer_t* buffer,
+    unsigned int width, unsigned int height);
+
+/**
+ * Returns the image as binary PPM (P6), which Emacs displays natively. The
+ * header is written in front of the pixels when the buffer is created, so
+ * nothing is encoded or copied and shared buffers are only read. The result
+ * stays valid until the buffer is freed.
+ *
+ * @param buffer The image buffer
+ * @param size Set to the size of the PPM data in bytes
+ * @return The PPM data or NULL if an error occurred
+ */
+EPDF_PLUGIN_API const unsigned char* epdf_image_buffer_get_ppm(const epdf_image_buffer_t* buffer,
+    size_t* size);
+
+#endif // IMAGE_H
@@ -0,0 +1,163 @@
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+
+#include "metrics.h"
+
+/* Counters and histograms of one thread. Only the owning thread writes, so
+ * updates are plain relaxed stores and readers merge all blocks. */
+typedef struct metrics_block_s
+{
+    uint64_t counters[EPDF_COUNTER_NUMBER];
+    uint64_t latency[EPDF_METRICS_SCALE_BUCKETS][EPDF_METRICS_LATENCY_BINS];
+} metrics_block_t;
+
+static const char* counter_names[EPDF_COUNTER_NUMBER] = {
+    [EPDF_COUNTER_PAGES_LOADED]        = "pages-loaded",
+    [EPDF_COUNTER_PAGES_EVICTED]       = "pages-evicted",
+    [EPDF_COUNTER_RENDER_CACHE_HITS]   = "render-cache-hits",
+    [EPDF_COUNTER_RENDER_CACHE_MISSES] = "render-cache-misses",
+    [EPDF_COUNTER_PREVIEW_HITS]        = "preview-hits",
+    [EPDF_COUNTER_RENDERS]             = "renders",
+    [EPDF_COUNTER_RENDERS_CANCELED]    = "renders-canceled",
+};
+
+static const char* gauge_names[EPDF_GAUGE_NUMBER] = {
+    [EPDF_GAUGE_PIXMAP_BYTES]    = "pixmap-bytes",
+    [EPDF_GAUGE_DISPLAY_LISTS]   = "display-lists",
+    [EPDF_GAUGE_TEXT_BYTES]      = "text-bytes",
+    [EPDF_GAUGE_QUEUE_VIEWPORT]  = "queue-viewport",
+    [EPDF_GAUGE_QUEUE_THUMBNAIL] = "queue-thumbnail",
+    [EPDF_GAUGE_QUEUE_SLOW]      = "queue-slow",
+    [EPDF_GAUGE_RENDERING]       = "rendering",
+};
+
+/* Gauges are set from under the locks of what they measure, so they are
+ * shared rather than per thread */
+static int64_t gauges[EPDF_GAUGE_NUMBER];
+
+/* Blocks of all threads that updated a metric, never freed */
+static GMutex blocks_lock;
+static GPtrArray* blocks = NULL;
+
+static __thread metrics_block_t* thread_block = NULL;
+
+static metrics_block_t*
+metrics_block_get(void)
+{
+    if (thread_block != NULL) {
+        return thread_block;
+    }
+
+    metrics_block_t* block = g_try_malloc0(sizeof(metrics_block_t));
+    if (block == NULL) {
+        return NULL;
+    }
+
+    g_mutex_lock(&blocks_lock);
+    if (blocks == NULL) {
+        blocks = g_ptr_array_new();
+    }
+    g_ptr_array_add(blocks, block);
+    g_mutex_unlock(&blocks_lock);
+
+    thread_block = block;
+
+    return block;
+}
+
+static inline void
+metrics_increment(uint64_t* value, uint64_t increment)
+{
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + increment, __ATOMIC_RELAXED);
+}
+
+void
+epdf_metrics_count(epdf_counter_t counter, uint64_t value)
+{
+    if (counter >= EPDF_COUNTER_NUMBER) {
+        return;
+    }
+
+    metrics_block_t* block = metrics_block_get();
+    if (block != NULL) {
+        metrics_increment(&block->counters[counter], value);
+    }
+}
+
+void
+epdf_metrics_gauge_set(epdf_gauge_t gauge, int64_t value)
+{
+    if (gauge < EPDF_GAUGE_NUMBER) {
+        __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+    }
+}
+
+void
+epdf_metrics_gauge_add(epdf_gauge_t gauge, int64_t delta)
+{
+    if (gauge < EPDF_GAUGE_NUMBER) {
+        __atomic_fetch_add(&gauges[gauge], delta, __ATOMIC_RELAXED);
+    }
+}
+
+void
+epdf_metrics_record_render(double scale, double milliseconds)
+{
+    metrics_block_t* block = metrics_block_get();
+    if (block == NULL) {
+        return;
+    }
+
+    unsigned int bucket = 0;
+    while (bucket + 1 < EPDF_METRICS_SCALE_BUCKETS && scale >= (double) (1u << bucket)) {
+        bucket++;
+    }
+
+    unsigned int bin = 0;
+    if (milliseconds >= 1.0) {
+        bin = MIN((unsigned int) log2(milliseconds) + 1, EPDF_METRICS_LATENCY_BINS - 1);
+    }
+
+    metrics_increment(&block->latency[bucket][bin], 1);
+}
+
+void
+epdf_metrics_get(epdf_metrics_t* metrics)
+{
+    if (metrics == NULL) {
+        return;
+    }
+
+    memset(metrics, 0, sizeof(epdf_metrics_t));
+
+    g_mutex_lock(&blocks_lock);
+    for (unsigned int i = 0; blocks != NULL && i < blocks->len; i++) {
+        metrics_block_t* block = g_ptr_array_index(blocks, i);
+        for (unsigned int c = 0; c < EPDF_COUNTER_NUMBER; c++) {
+            metrics->counters[c] += __atomic_load_n(&block->counters[c], __ATOMIC_RELAXED);
+        }
+        for (unsigned int s = 0; s < EPDF_METRICS_SCALE_BUCKETS; s++) {
+            for (unsigned int b = 0; b < EPDF_METRICS_LATENCY_BINS; b++) {
+                metrics->latency[s][b] += __atomic_load_n(&block->latency[s][b], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    g_mutex_unlock(&blocks_lock);
+
+    for (unsigned int g = 0; g < EPDF_GAUGE_NUMBER; g++) {
+        metrics->gauges[g] = __atomic_load_n(&gauges[g], __ATOMIC_RELAXED);
+    }
+}
+
+const char*
+epdf_metrics_counter_name(epdf_counter_t counter)
+{
+    return counter < EPDF_COUNTER_NUMBER ? counter_names[counter] : NULL;
+}
+
+const char*
+epdf_metrics_gauge_name(epdf_gauge_t gauge)
+{
+    return gauge < EPDF_GAUGE_NUMBER ? gauge_names[gauge] : NULL;
+}
@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+/**
+ * Monotonic counters, kept per thread and summed when read
+ */
+typedef enum epdf_counter_e
+{
+    EPDF_COUNTER_PAGES_LOADED, /**< Pages loaded by the backend */
+    EPDF_COUNTER_PAGES_EVICTED, /**< Pages released by the backend */
+    EPDF_COUNTER_RENDER_CACHE_HITS, /**< Requests served from the render cache when submitted */
+    EPDF_COUNTER_RENDER_CACHE_MISSES, /**< Requests queued because the render cache had no rendering */
+    EPDF_COUNTER_PREVIEW_HITS, /**< Previews scaled from a nearby cache entry */
+    EPDF_COUNTER_RENDERS, /**< Pages rendered */
+    EPDF_COUNTER_RENDERS_CANCELED, /**< Render jobs dropped or aborted */
+    EPDF_COUNTER_NUMBER /**< Number of counters */
+} epdf_counter_t;
+
+/**
+ * Gauges, the current value of a quantity
+ */
+typedef enum epdf_gauge_e
+{
+    EPDF_GAUGE_PIXMAP_BYTES, /**< Bytes of images held by the render cache */
+    EPDF_GAUGE_DISPLAY_LISTS, /**< Display lists held by loaded pages */
+    EPDF_GAUGE_TEXT_BYTES, /**< Bytes of extracted page text */
+    EPDF_GAUGE_QUEUE_VIEWPORT, /**< Jobs waiting in the viewport lane */
+    EPDF_GAUGE_QUEUE_THUMBNAIL, /**< Jobs waiting in the thumbnail lane */
+    EPDF_GAUGE_QUEUE_SLOW, /**< Jobs waiting for the worker for slow pages */
+    EPDF_GAUGE_RENDERING, /**< Jobs being rendered */
+    EPDF_GAUGE_NUMBER /**< Number of gauges */
+} epdf_gauge_t;
+
+/**
+ * Render latencies are bucketed by scale: below 1, below 2, below 4 and above
+ */
+#define EPDF_METRICS_SCALE_BUCKETS 4
+
+/**
+ * Latency bins double in width: below 1 ms, below 2 ms, ... and 1024 ms and above
+ */
+#define EPDF_METRICS_LATENCY_BINS 12
+
+/**
+ * Snapshot of all metrics
+ */
+typedef struct epdf_metrics_s
+{
+    uint64_t counters[EPDF_COUNTER_NUMBER]; /**< Counter values */
+    int64_t gauges[EPDF_GAUGE_NUMBER]; /**< Gauge values */
+    uint64_t latency[EPDF_METRICS_SCALE_BUCKETS][EPDF_METRICS_LATENCY_BINS]; /**< Render latency histograms */
+} epdf_metrics_t;
+
+/**
+ * Adds to a counter of the calling thread
+ *
+ * @param counter The counter
+ * @param value The increment
+ */
+EPDF_PLUGIN_API void epdf_metrics_count(epdf_counter_t counter, uint64_t value);
+
+/**
+ * Sets a gauge
+ *
+ * @param gauge The gauge
+ * @param value The value
+ */
+EPDF_PLUGIN_API void epdf_metrics_gauge_set(epdf_gauge_t gauge, int64_t value);
+
+/**
+ * Adds to a gauge
+ *
+ * @param gauge The gauge
+ * @param delta The difference, may be negative
+ */
+EPDF_PLUGIN_API void epdf_metrics_gauge_add(epdf_gauge_t gauge, int64_t delta);
+
+/**
+ * Records the latency of a rendering into the histogram of its scale
+ *
+ * @param scale The scale of the rendering
+ * @param milliseconds The time taken
+ */
+EPDF_PLUGIN_API void epdf_metrics_record_render(double scale, double milliseconds);
+
+/**
+ * Merges the metrics of all threads. Values of threads still running may be
+ * off by the updates made while reading.
+ *
+ * @param metrics Filled with the current values
+ */
+EPDF_PLUGIN_API void epdf_metrics_get(epdf_metrics_t* metrics);
+
+/**
+ * Returns the name of a counter
+ *
+ * @param counter The counter
+ * @return The name, e.g. "render-cache-hits", or NULL
+ */
+EPDF_PLUGIN_API const char* epdf_metrics_counter_name(epdf_counter_t counter);
+
+/**
+ * Returns the name of a gauge
+ *
+ * @param gauge The gauge
+ * @return The name, e.g. "pixmap-bytes", or NULL
+ */
+EPDF_PLUGIN_API const char* epdf_metrics_gauge_name(epdf_gauge_t gauge);
+
+#endif // METRICS_H
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <glib.h>
+
+#include "document.h"
+#include "image.h"
+#include "page-export.h"
+#include "page.h"
+#include "trace.h"
+
+/* Pages claimed but not yet reported, per worker */
+#define EXPORT_PAGES_PER_WORKER 2
+
+typedef struct export_result_s
+{
+    unsigned int page;
+    epdf_error_t error;
+    char* path; /* file output */
+    epdf_image_buffer_t* image; /* PPM stream output */
+    fz_buffer* png; /* PNG stream output */
+    fz_context* ctx; /* context png has been encoded with */
+} export_result_t;
+
+typedef struct export_job_s
+{
+    epdf_document_t* document;
+    const epdf_page_export_options_t* options;
+    int digits; /* width of the page numbers in file names */
+    GMutex lock;
+    GCond cond;
+    unsigned int next; /* next page to claim */
+    unsigned int reported; /* number of results handed to the callback */
+    unsigned int window; /* most pages claimed but not yet reported */
+    GQueue done; /* results not yet reported */
+    bool stop; /* a page failed, claim no more pages */
+} export_job_t;
+
+static void
+export_result_free(export_result_t* result)
+{
+    if (result->png != NULL) {
+        fz_drop_buffer(result->ctx, result->png);
+    }
+    epdf_image_buffer_free(result->image);
+    g_free(result->path);
+    g_free(result);
+}
+
+/* Throws on error */
+static fz_pixmap*
+export_pixmap(fz_context* ctx, epdf_image_buffer_t* image)
+{
+    return fz_new_pixmap_with_data(ctx, fz_device_rgb(ctx), image->width, image->height, NULL, 0,
+                                   image->rowstride, image->data);
+}
+
+static epdf_error_t
+export_write_png(fz_context* ctx, epdf_image_buffer_t* image, const char* path, fz_buffer** png)
+{
+    epdf_error_t error = EPDF_ERROR_OK;
+    fz_pixmap* pixmap  = NULL;
+
+    fz_var(pixmap);
+
+    fz_try (ctx) {
+        pixmap = export_pixmap(ctx, image);
+        if (path != NULL) {
+            fz_save_pixmap_as_png(ctx, pixmap, path);
+        } else {
+            *png = fz_new_buffer_from_pixmap_as_png(ctx, pixmap, fz_default_color_params);
+        }
+    } fz_always (ctx) {
+        fz_drop_pixmap(ctx, pixmap);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+/* Renders a page and writes its file, or encodes it for the stream */
+static export_result_t*
+export_page(export_job_t* job, fz_context* ctx, unsigned int index)
+{
+    EPDF_TRACE_SPAN("export_page");
+
+    const epdf_page_export_options_t* options = job->options;
+
+    export_result_t* result = g_malloc0(sizeof(export_result_t));
+    result->page            = index;
+    result->ctx             = ctx;
+
+    epdf_page_t* page          = epdf_document_get_page(job->document, index);
+    epdf_image_buffer_t* image = NULL;
+
+    if (page == NULL) {
+        result->error = EPDF_ERROR_INVALID_ARGUMENTS;
+    } else if (options->render != NULL) {
+        image = options->render(page, options->scale, options->rotation, options->render_data, &result->error);
+    } else {
+        image = epdf_page_render_image(page, options->scale, options->rotation, NULL, &result->error);
+    }
+
+    if (image == NULL) {
+        if (result->error == EPDF_ERROR_OK) {
+            result->error = EPDF_ERROR_UNKNOWN;
+        }
+        return result;
+    }
+
+    if (options->prefix != NULL) {
+        const char* extension = options->format == EPDF_PAGE_EXPORT_FORMAT_PNG ? "png" : "ppm";
+        result->path = g_strdup_printf("%s-%0*u.%s", options->prefix, job->digits, index + 1, extension);
+    }
+
+    if (options->format == EPDF_PAGE_EXPORT_FORMAT_PNG) {
+        result->error = export_write_png(ctx, image, result->path, &result->png);
+    } else if (result->path != NULL) {
+        size_t size              = 0;
+        const unsigned char* ppm = epdf_image_buffer_get_ppm(image, &size);
+        if (ppm == NULL || g_file_set_contents(result->path, (const gchar*) ppm, size, NULL) == FALSE) {
+            result->error = EPDF_ERROR_UNKNOWN;
+        }
+    } else {
+        /* written by the calling thread in page order */
+        result->image = epdf_image_buffer_ref(image);
+    }
+
+    epdf_image_buffer_free(image);
+
+    return result;
+}
+
+static gpointer
+export_worker(gpointer data)
+{
+    export_job_t* job                         = data;
+    const epdf_page_export_options_t* options = job->options;
+
+    /* PNG encoding only, pages are rendered from their own contexts */
+    fz_context* ctx = NULL;
+    if (options->format == EPDF_PAGE_EXPORT_FORMAT_PNG) {
+        ctx = fz_new_context(NULL, NULL, 0);
+    }
+
+    for (;;) {
+        g_mutex_lock(&job->lock);
+        while (job->stop == false && job->next <= options->last_page &&
+               job->next - options->first_page - job->reported >= job->window) {
+            g_cond_wait(&job->cond, &job->lock);
+        }
+        if (job->stop == true || job->next > options->last_page) {
+            g_mutex_unlock(&job->lock);
+            break;
+        }
+        const unsigned int index = job->next++;
+        g_mutex_unlock(&job->lock);
+
+        export_result_t* result = NULL;
+        if (options->format == EPDF_PAGE_EXPORT_FORMAT_PNG && ctx == NULL) {
+            result        = g_malloc0(sizeof(export_result_t));
+            result->page  = index;
+            result->error = EPDF_ERROR_OUT_OF_MEMORY;
+        } else {
+            result = export_page(job, ctx, index);
+        }
+
+        g_mutex_lock(&job->lock);
+        g_queue_push_tail(&job->done, result);
+        g_cond_broadcast(&job->cond);
+        g_mutex_unlock(&job->lock);
+    }
+
+    /* the buffers of the results encoded with ctx are freed by the calling
+     * thread, wait until it is done with all pages claimed */
+    g_mutex_lock(&job->lock);
+    while (job->reported < job->next - options->first_page) {
+        g_cond_wait(&job->cond, &job->lock);
+    }
+    g_mutex_unlock(&job->lock);
+
+    if (ctx != NULL) {
+        fz_drop_context(ctx);
+    }
+
+    return NULL;
+}
+
+/* Takes the next result to report, NULL if it is not there yet. Called with
+ * the job lock held. */
+static export_result_t*
+export_take_result(export_job_t* job)
+{
+    /* the stream is always written in page order */
+    if (job->options->ordered == false && job->options->prefix != NULL) {
+        return g_queue_pop_head(&job->done);
+    }
+
+    const unsigned int page = job->options->first_page + job->reported;
+    for (GList* link = job->done.head; link != NULL; link = link->next) {
+        export_result_t* result = link->data;
+        if (result->page == page) {
+            g_queue_delete_link(&job->done, link);
+            return result;
+        }
+    }
+
+    return NULL;
+}
+
+static epdf_error_t
+export_write_stream(FILE* stream, export_result_t* result)
+{
+    unsigned char* png         = NULL;
+    const unsigned char* bytes = NULL;
+    size_t size                = 0;
+
+    if (result->png != NULL) {
+        size  = fz_buffer_storage(result->ctx, result->png, &png);
+        bytes = png;
+    } else if (result->image != NULL) {
+        bytes = epdf_image_buffer_get_ppm(result->image, &size);
+    }
+
+    if (bytes == NULL || fwrite(bytes, 1, size, stream) != size) {
+        return EPDF_ERROR_UNKNOWN;
+    }
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+epdf_document_export_pages(epdf_document_t* document, const epdf_page_export_options_t* options)
+{
+    EPDF_TRACE_SPAN("document_export");
+
+    if (document == NULL || options == NULL || options->scale <= 0.0 ||
+        options->first_page > options->last_page ||
+        options->last_page >= epdf_document_get_number_of_pages(document) ||
+        (options->prefix == NULL && options->stream == NULL)) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const unsigned int number_of_pages = options->last_page - options->first_page + 1;
+    unsigned int workers               = options->workers != 0 ? options->workers : g_get_num_processors();
+    workers                            = MIN(workers, number_of_pages);
+
+    export_job_t job = {
+        .document = document,
+        .options  = options,
+        .digits   = 1,
+        .next     = options->first_page,
+        .window   = workers * EXPORT_PAGES_PER_WORKER,
+    };
+    for (unsigned int n = options->last_page + 1; n >= 10; n /= 10) {
+        job.digits++;
+    }
+    g_mutex_init(&job.lock);
+    g_cond_init(&job.cond);
+    g_queue_init(&job.done);
+
+    GPtrArray* threads = g_ptr_array_new();
+    for (unsigned int i = 0; i < workers; i++) {
+        GThread* thread = g_thread_try_new("epdf-export", export_worker, &job, NULL);
+        if (thread != NULL) {
+            g_ptr_array_add(threads, thread);
+        }
+    }
+
+    epdf_error_t error = threads->len == 0 ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_OK;
+
+    /* report until every claimed page has been reported */
+    g_mutex_lock(&job.lock);
+    while (threads->len > 0) {
+        const unsigned int claimed = job.stop == true ? job.next - options->first_page : number_of_pages;
+        if (job.reported >= claimed) {
+            break;
+        }
+
+        export_result_t* result = export_take_result(&job);
+        if (result == NULL) {
+            g_cond_wait(&job.cond, &job.lock);
+            continue;
+        }
+        g_mutex_unlock(&job.lock);
+
+        if (result->error == EPDF_ERROR_OK && options->prefix == NULL && options->stream != NULL) {
+            result->error = export_write_stream(options->stream, result);
+        }
+        if (options->callback != NULL) {
+            options->callback(result->page, result->path, result->error, options->data);
+        }
+
+        if (result->error != EPDF_ERROR_OK && error == EPDF_ERROR_OK) {
+            error = result->error;
+        }
+        /* before it counts as reported, its worker may drop the context then */
+        export_result_free(result);
+
+        g_mutex_lock(&job.lock);
+        job.stop = error != EPDF_ERROR_OK;
+        job.reported++;
+        g_cond_broadcast(&job.cond);
+    }
+    g_mutex_unlock(&job.lock);
+
+    for (unsigned int i = 0; i < threads->len; i++) {
+        g_thread_join(g_ptr_array_index(threads, i));
+    }
+    g_ptr_array_free(threads, TRUE);
+
+    g_cond_clear(&job.cond);
+    g_mutex_clear(&job.lock);
+
+    return error;
+}
@@ -0,0 +1,70 @@
+#ifndef PAGE_EXPORT_H
+#define PAGE_EXPORT_H
+
+#include <stdio.h>
+
+#include "macros.h"
+#include "render.h"
+#include "types.h"
+
+/**
+ * Image formats of exported pages
+ */
+typedef enum epdf_page_export_format_e
+{
+    EPDF_PAGE_EXPORT_FORMAT_PPM, /**< Binary PPM (P6), written without encoding */
+    EPDF_PAGE_EXPORT_FORMAT_PNG /**< PNG */
+} epdf_page_export_format_t;
+
+/**
+ * Callback invoked from the calling thread for every exported page
+ *
+ * @param page Index of the page
+ * @param path File the page has been written to, or NULL if it has been
+ *   written to the stream
+ * @param error EPDF_ERROR_OK if the page has been written
+ * @param data Custom data
+ */
+typedef void (*epdf_page_export_callback_t)(unsigned int page, const char* path, epdf_error_t error,
+    void* data);
+
+/**
+ * Options of a page range export
+ */
+typedef struct epdf_page_export_options_s
+{
+    unsigned int first_page; /**< Index of the first page */
+    unsigned int last_page; /**< Index of the last page, included */
+    double scale; /**< Scale in pixels per point */
+    unsigned int rotation; /**< Rotation (0, 90, 180 or 270) */
+    epdf_page_export_format_t format; /**< Image format */
+    const char* prefix; /**< Pages are written to <prefix>-<number>.<ext>, numbered from 1
+                             and zero-padded to the width of the last number; NULL to write
+                             them to stream instead */
+    FILE* stream; /**< Receives the images one after another in page order if prefix is
+                       NULL, e.g. a pipe into an OCR tool */
+    bool ordered; /**< Invoke callback in page order rather than as pages complete */
+    unsigned int workers; /**< Number of worker threads, 0 for one per core */
+    epdf_render_function_t render; /**< Render function or NULL for epdf_page_render_image */
+    void* render_data; /**< Custom data passed to render */
+    epdf_page_export_callback_t callback; /**< Invoked for every page, or NULL */
+    void* data; /**< Custom data passed to callback */
+} epdf_page_export_options_t;
+
+/**
+ * Renders a page range to image files or a stream using a pool of worker
+ * threads, and returns once all pages have been written. Workers encode and
+ * write the pages they rendered; at most two pages per worker are rendered
+ * ahead of the oldest page not yet reported, so memory stays bounded
+ * regardless of the size of the range. The export stops at the first page
+ * that fails.
+ *
+ * @param document The document
+ * @param options The options
+ * @return EPDF_ERROR_OK when all pages have been written, otherwise the
+ *    error of the first page that failed, see epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_document_export_pages(epdf_document_t* document,
+    const epdf_page_export_options_t* options);
+
+#endif // PAGE_EXPORT_H
@@ -2,11 +2,16 @@
 
 #include "document.h"
 #include "page.h"
+#include "plugin-manager.h"
+#include "render.h"
+#include "trace.h"
 #include "types.h"
 
 epdf_page_t*
 epdf_page_new(epdf_document_t* document, unsigned int index, epdf_error_t* error)
 {
+    EPDF_TRACE_SPAN("page_new");
+
     if (document == NULL) {
         if (error != NULL) {
             *error = EPDF_ERROR_INVALID_ARGUMENTS;
@@ -25,6 +30,7 @@ epdf_page_new(epdf_document_t* document, unsigned int index, epdf_error_t* error
 
     page->index    = index;
     page->visible  = false;
+    page->changed  = true;
     page->document = document;
 
     /* init plugin */
@@ -59,6 +65,30 @@ error_ret:
     return NULL;
 }
 
+epdf_page_t*
+epdf_page_new_view(epdf_document_t* document, epdf_page_t* source)
+{
+    if (document == NULL || source == NULL) {
+        return NULL;
+    }
+
+    epdf_page_t* page = g_try_malloc0(sizeof(epdf_page_t));
+    if (page == NULL) {
+        return NULL;
+    }
+
+    page->width    = source->width;
+    page->height   = source->height;
+    page->index    = source->index;
+    page->data     = source->data;
+    page->visible  = false;
+    page->changed  = source->changed;
+    page->document = document;
+    page->source   = epdf_page_get_source(source);
+
+    return page;
+}
+
 epdf_error_t
 epdf_page_free(epdf_page_t* page)
 {
@@ -71,6 +101,12 @@ epdf_page_free(epdf_page_t* page)
         return EPDF_ERROR_INVALID_ARGUMENTS;
     }
 
+    /* the backend data belongs to the source page */
+    if (page->source != NULL) {
+        g_free(page);
+        return EPDF_ERROR_OK;
+    }
+
     epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
     const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
     if (functions->page_clear == NULL) {
@@ -94,6 +130,16 @@ epdf_page_get_document(epdf_page_t* page)
     return page->document;
 }
 
+epdf_page_t*
+epdf_page_get_source(epdf_page_t* page)
+{
+    if (page == NULL) {
+        return NULL;
+    }
+
+    return page->source != NULL ? page->source : page;
+}
+
 unsigned int
 epdf_page_get_index(epdf_page_t* page)
 {
@@ -164,6 +210,60 @@ epdf_page_set_visibility(epdf_page_t* page, bool visibility)
     page->visible = visibility;
 }
 
+bool
+epdf_page_get_changed(epdf_page_t* page)
+{
+    if (page == NULL) {
+        return true;
+    }
+
+    return page->changed;
+}
+
+const uint8_t*
+epdf_page_get_fingerprint(epdf_page_t* page, epdf_error_t* error)
+{
+    if (page == NULL || page->document == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    /* computed once for all openers */
+    if (page->source != NULL) {
+        return epdf_page_get_fingerprint(page->source, error);
+    }
+
+    /* annotation and form changes alter the content */
+    const int revision = g_atomic_int_get(&page->annotations_revision);
+    if (page->has_fingerprint == true && page->fingerprint_revision == revision) {
+        return page->fingerprint;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_get_fingerprint == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+        return NULL;
+    }
+
+    epdf_error_t ret = functions->page_get_fingerprint(page, page->data, page->fingerprint);
+    if (ret != EPDF_ERROR_OK) {
+        if (error != NULL) {
+            *error = ret;
+        }
+        return NULL;
+    }
+
+    page->has_fingerprint      = true;
+    page->fingerprint_revision = revision;
+
+    return page->fingerprint;
+}
+
 void*
 epdf_page_get_data(epdf_page_t* page)
 {
@@ -228,6 +328,28 @@ epdf_page_get_text(epdf_page_t* page, epdf_rectangle_t rectangle, epdf_error_t*
     return functions->page_get_text(page, page->data, rectangle, error);
 }
 
+GPtrArray*
+epdf_page_search(epdf_page_t* page, const char* text, epdf_error_t* error)
+{
+    if (page == NULL || page->document == NULL || text == NULL) {
+        if (error) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_search_text == NULL) {
+        if (error) {
+            *error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+        return NULL;
+    }
+
+    return functions->page_search_text(page, page->data, text, error);
+}
+
 epdf_error_t
 epdf_page_render(epdf_page_t* page, cairo_t* cairo, bool printing)
 {
@@ -244,6 +366,40 @@ epdf_page_render(epdf_page_t* page, cairo_t* cairo, bool printing)
     return functions->page_render_cairo(page, page->data, cairo, printing);
 }
 
+epdf_image_buffer_t*
+epdf_page_render_image(epdf_page_t* page, double scale, unsigned int rotation, fz_cookie* cookie,
+                       epdf_error_t* error)
+{
+    EPDF_TRACE_SPAN("page_render_image");
+
+    if (page == NULL || page->document == NULL || scale <= 0.0) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_render_image == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+        return NULL;
+    }
+
+    epdf_image_buffer_t* image = NULL;
+    epdf_error_t ret = functions->page_render_image(page, page->data, scale, rotation, cookie, &image);
+    if (ret != EPDF_ERROR_OK) {
+        if (error != NULL) {
+            *error = ret;
+        }
+        return NULL;
+    }
+
+    return image;
+}
+
 char*
 epdf_page_get_label(epdf_page_t* page, epdf_error_t* error)
 {
@@ -274,3 +430,248 @@ epdf_page_get_label(epdf_page_t* page, epdf_error_t* error)
 
     return ret;
 }
+
+epdf_error_t
+epdf_page_render_region(epdf_page_t* page, double scale, unsigned int rotation,
+                        epdf_rectangle_t region, epdf_image_buffer_t* image, epdf_rectangle_t* pixels)
+{
+    if (page == NULL || page->document == NULL || scale <= 0.0 || image == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_render_region == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return functions->page_render_region(page, page->data, scale, rotation, region, image, pixels);
+}
+
+void
+epdf_annotation_free(void* data)
+{
+    epdf_annotation_t* annotation = data;
+    if (annotation == NULL) {
+        return;
+    }
+
+    g_free(annotation->contents);
+    g_free(annotation);
+}
+
+GPtrArray*
+epdf_page_get_annotations(epdf_page_t* page, epdf_error_t* error)
+{
+    if (page == NULL || page->document == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_annotations_get == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+        return NULL;
+    }
+
+    GPtrArray* annotations = g_ptr_array_new_with_free_func(epdf_annotation_free);
+    epdf_error_t ret = functions->page_annotations_get(page, page->data, annotations);
+    if (ret != EPDF_ERROR_OK) {
+        if (error != NULL) {
+            *error = ret;
+        }
+        g_ptr_array_unref(annotations);
+        return NULL;
+    }
+
+    return annotations;
+}
+
+epdf_error_t
+epdf_page_add_annotation(epdf_page_t* page, epdf_annotation_t* annotation, epdf_rectangle_t* dirty)
+{
+    if (page == NULL || page->document == NULL || annotation == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_annotation_add == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_rectangle_t area;
+    epdf_error_t ret = functions->page_annotation_add(page, page->data, annotation, &area);
+    if (ret != EPDF_ERROR_OK) {
+        return ret;
+    }
+
+    epdf_render_cache_invalidate(page, area);
+    if (dirty != NULL) {
+        *dirty = area;
+    }
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+epdf_page_update_annotation(epdf_page_t* page, const epdf_annotation_t* annotation, epdf_rectangle_t* dirty)
+{
+    if (page == NULL || page->document == NULL || annotation == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_annotation_update == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_rectangle_t area;
+    epdf_error_t ret = functions->page_annotation_update(page, page->data, annotation, &area);
+    if (ret != EPDF_ERROR_OK) {
+        return ret;
+    }
+
+    epdf_render_cache_invalidate(page, area);
+    if (dirty != NULL) {
+        *dirty = area;
+    }
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+epdf_page_remove_annotation(epdf_page_t* page, int id, epdf_rectangle_t* dirty)
+{
+    if (page == NULL || page->document == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_annotation_remove == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_rectangle_t area;
+    epdf_error_t ret = functions->page_annotation_remove(page, page->data, id, &area);
+    if (ret != EPDF_ERROR_OK) {
+        return ret;
+    }
+
+    epdf_render_cache_invalidate(page, area);
+    if (dirty != NULL) {
+        *dirty = area;
+    }
+
+    return EPDF_ERROR_OK;
+}
+
+void
+epdf_form_field_free(void* data)
+{
+    epdf_form_field_t* form_field = data;
+    if (form_field == NULL) {
+        return;
+    }
+
+    g_free(form_field->name);
+    g_free(form_field->value);
+    g_free(form_field);
+}
+
+GPtrArray*
+epdf_page_get_form_fields(epdf_page_t* page, epdf_error_t* error)
+{
+    if (page == NULL || page->document == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_form_fields_get == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+        return NULL;
+    }
+
+    GPtrArray* form_fields = g_ptr_array_new_with_free_func(epdf_form_field_free);
+    epdf_error_t ret = functions->page_form_fields_get(page, page->data, form_fields);
+    if (ret != EPDF_ERROR_OK) {
+        if (error != NULL) {
+            *error = ret;
+        }
+        g_ptr_array_unref(form_fields);
+        return NULL;
+    }
+
+    return form_fields;
+}
+
+epdf_form_field_t*
+epdf_page_get_form_field_at(epdf_page_t* page, double x, double y, epdf_error_t* error)
+{
+    if (page == NULL || page->document == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_form_field_at == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+        return NULL;
+    }
+
+    epdf_form_field_t* form_field = NULL;
+    epdf_error_t ret = functions->page_form_field_at(page, page->data, x, y, &form_field);
+    if (ret != EPDF_ERROR_OK) {
+        if (error != NULL) {
+            *error = ret;
+        }
+        return NULL;
+    }
+
+    return form_field;
+}
+
+epdf_error_t
+epdf_page_set_form_field_value(epdf_page_t* page, int id, const char* value, epdf_rectangle_t* dirty)
+{
+    if (page == NULL || page->document == NULL || value == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_plugin_t* plugin = epdf_document_get_plugin(page->document);
+    const epdf_plugin_functions_t* functions = epdf_plugin_get_functions(plugin);
+    if (functions->page_form_field_set_value == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_rectangle_t area;
+    epdf_error_t ret = functions->page_form_field_set_value(page, page->data, id, value, &area);
+    if (ret != EPDF_ERROR_OK) {
+        return ret;
+    }
+
+    epdf_render_cache_invalidate(page, area);
+    if (dirty != NULL) {
+        *dirty = area;
+    }
+
+    return EPDF_ERROR_OK;
+}
@@ -16,6 +16,16 @@
 EPDF_PLUGIN_API epdf_page_t* epdf_page_new(epdf_document_t* document, unsigned int
     index, epdf_error_t* error);
 
+/**
+ * Creates the page of another opener's view of a document. It shares the
+ * backend data of source and keeps its own visibility.
+ *
+ * @param document The view the page belongs to
+ * @param source The page of the document the view has been created from
+ * @return Page object or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_page_t* epdf_page_new_view(epdf_document_t* document, epdf_page_t* source);
+
 /**
  * Frees the page object
  *
@@ -34,6 +44,15 @@ EPDF_PLUGIN_API epdf_error_t epdf_page_free(epdf_page_t* page);
  */
 EPDF_PLUGIN_API epdf_document_t* epdf_page_get_document(epdf_page_t* page);
 
+/**
+ * Returns the page that owns the backend data of the page: the page itself,
+ * or the page of the document a view has been created from
+ *
+ * @param page The page object
+ * @return The page owning the backend data
+ */
+EPDF_PLUGIN_API epdf_page_t* epdf_page_get_source(epdf_page_t* page);
+
 /**
  * Returns the set id of the page
  *
@@ -93,6 +112,29 @@ EPDF_PLUGIN_API bool epdf_page_get_visibility(epdf_page_t* page);
  */
 EPDF_PLUGIN_API void epdf_page_set_visibility(epdf_page_t* page, bool visibility);
 
+/**
+ * Returns whether the page content differs from the revision of the same file
+ * that was open before this document was opened. Only pages that had cached
+ * renderings in the previous revision are compared; all other pages, and the
+ * pages of a document without a previous revision, are reported as changed.
+ *
+ * @param page The page object
+ * @return true if the page has to be rendered again
+ */
+EPDF_PLUGIN_API bool epdf_page_get_changed(epdf_page_t* page);
+
+/**
+ * Returns the fingerprint of the page, a SHA256 hash over the objects that
+ * make up its content. It is computed on first use and again once its
+ * annotations or form fields changed.
+ *
+ * @param page The page object
+ * @param error Set to an error value (see \ref epdf_error_t) if an
+ *   error occurred
+ * @return The 32 byte fingerprint or NULL if an error occurred
+ */
+EPDF_PLUGIN_API const uint8_t* epdf_page_get_fingerprint(epdf_page_t* page, epdf_error_t* error);
+
 /**
  * Returns the custom data
  *
@@ -130,6 +172,18 @@ EPDF_PLUGIN_API cairo_surface_t* epdf_page_image_get_cairo(epdf_page_t* page, ep
  */
 EPDF_PLUGIN_API char* epdf_page_get_text(epdf_page_t* page, epdf_rectangle_t rectangle, epdf_error_t* error);
 
+/**
+ * Search page for text
+ *
+ * @param page Page
+ * @param text Text to search
+ * @param error Set to an error value (see \ref epdf_error_t) if an error
+ * occurred
+ * @return Array of epdf_rectangle_t with the hits (free with
+ *    g_ptr_array_free) or NULL if an error occurred
+ */
+EPDF_PLUGIN_API GPtrArray* epdf_page_search(epdf_page_t* page, const char* text, epdf_error_t* error);
+
 /**
  * Render page
  *
@@ -141,6 +195,145 @@ EPDF_PLUGIN_API char* epdf_page_get_text(epdf_page_t* page, epdf_rectangle_t rec
  */
 EPDF_PLUGIN_API epdf_error_t epdf_page_render(epdf_page_t* page, cairo_t* cairo, bool printing);
 
+/**
+ * Render page into an image buffer. May be called from any thread.
+ *
+ * @param page The page object
+ * @param scale The scale in pixels per point
+ * @param rotation The rotation (0, 90, 180 or 270)
+ * @param cookie Cookie to abort the rendering from another thread, or NULL
+ * @param error Set to an error value (see \ref epdf_error_t) if an
+ *   error occurred, EPDF_ERROR_CANCELED if it has been aborted
+ * @return The image (free with epdf_image_buffer_free) or NULL if an error
+ *   occurred
+ */
+EPDF_PLUGIN_API epdf_image_buffer_t* epdf_page_render_image(epdf_page_t* page, double scale,
+    unsigned int rotation, fz_cookie* cookie, epdf_error_t* error);
+
+/**
+ * Draws a region of the page again into an image previously rendered with the
+ * same scale and rotation, e.g. after an annotation changed. The image is
+ * modified in place and must not be shared.
+ *
+ * @param page The page object
+ * @param scale The scale of the image
+ * @param rotation The rotation of the image
+ * @param region The region in page coordinates (points)
+ * @param image The image
+ * @param pixels Set to the area of the image that has been drawn, in pixels,
+ *   or NULL
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_page_render_region(epdf_page_t* page, double scale,
+    unsigned int rotation, epdf_rectangle_t region, epdf_image_buffer_t* image, epdf_rectangle_t* pixels);
+
+/**
+ * Frees an annotation
+ *
+ * @param annotation The annotation (epdf_annotation_t)
+ */
+EPDF_PLUGIN_API void epdf_annotation_free(void* annotation);
+
+/**
+ * Lists the annotations of the page
+ *
+ * @param page Page
+ * @param error Set to an error value (see \ref epdf_error_t) if an error
+ *    occurred
+ * @return Array of epdf_annotation_t (free with g_ptr_array_unref) or NULL if
+ *    an error occurred
+ */
+EPDF_PLUGIN_API GPtrArray* epdf_page_get_annotations(epdf_page_t* page, epdf_error_t* error);
+
+/**
+ * Adds an annotation to the page. Annotations are drawn as a layer over the
+ * page contents; only the area of the annotation is drawn again in the cached
+ * renderings of the page. Changes are kept by epdf_document_save_as, which can
+ * append them incrementally.
+ *
+ * @param page Page
+ * @param annotation The annotation, its id is set on success
+ * @param dirty Set to the area of the page that changed, or NULL
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_page_add_annotation(epdf_page_t* page, epdf_annotation_t* annotation,
+    epdf_rectangle_t* dirty);
+
+/**
+ * Changes an annotation of the page, identified by its id. The type can not
+ * be changed.
+ *
+ * @param page Page
+ * @param annotation The annotation
+ * @param dirty Set to the area of the page that changed, or NULL
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_page_update_annotation(epdf_page_t* page,
+    const epdf_annotation_t* annotation, epdf_rectangle_t* dirty);
+
+/**
+ * Removes an annotation from the page
+ *
+ * @param page Page
+ * @param id Identifier of the annotation
+ * @param dirty Set to the area of the page that changed, or NULL
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_page_remove_annotation(epdf_page_t* page, int id, epdf_rectangle_t* dirty);
+
+/**
+ * Frees a form field
+ *
+ * @param form_field The form field (epdf_form_field_t)
+ */
+EPDF_PLUGIN_API void epdf_form_field_free(void* form_field);
+
+/**
+ * Lists the form field widgets of the page, ordered by their top edge
+ *
+ * @param page Page
+ * @param error Set to an error value (see \ref epdf_error_t) if an error
+ *    occurred
+ * @return Array of epdf_form_field_t (free with g_ptr_array_unref) or NULL if
+ *    an error occurred
+ */
+EPDF_PLUGIN_API GPtrArray* epdf_page_get_form_fields(epdf_page_t* page, epdf_error_t* error);
+
+/**
+ * Finds the form field widget at a point, e.g. under the mouse. The widgets
+ * of a page are indexed once, so this takes logarithmic time in the number
+ * of widgets.
+ *
+ * @param page Page
+ * @param x The x coordinate in page coordinates (points)
+ * @param y The y coordinate in page coordinates (points)
+ * @param error Set to an error value (see \ref epdf_error_t) if an error
+ *    occurred
+ * @return The form field (free with epdf_form_field_free) or NULL if there is
+ *    none or an error occurred
+ */
+EPDF_PLUGIN_API epdf_form_field_t* epdf_page_get_form_field_at(epdf_page_t* page, double x, double y,
+    epdf_error_t* error);
+
+/**
+ * Sets the value of a form field. Check boxes and radio buttons take "Off" or
+ * any other value to turn them on. Only the widgets of the field are drawn
+ * again in the cached renderings of the page.
+ *
+ * @param page Page
+ * @param id Identifier of the widget
+ * @param value The value
+ * @param dirty Set to the area of the page that changed, or NULL
+ * @return EPDF_ERROR_OK when no error occurred, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_page_set_form_field_value(epdf_page_t* page, int id, const char* value,
+    epdf_rectangle_t* dirty);
+
 /**
  * Get page label. Note that the page label might not exist, in this case NULL
  * is returned.
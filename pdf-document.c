@@ -2,12 +2,514 @@
 #include <mupdf/pdf.h>
 
 #include <glib-2.0/glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "macros.h"
+#include "allocator.h"
+#include "document.h"
+#include "plugin.h"
+#include "trace.h"
 #include "types.h"
 
+static void
+mupdf_lock(void* user, int lock)
+{
+    mupdf_document_t* mupdf_document = user;
+    g_mutex_lock(&mupdf_document->locks[lock]);
+}
+
+static void
+mupdf_unlock(void* user, int lock)
+{
+    mupdf_document_t* mupdf_document = user;
+    g_mutex_unlock(&mupdf_document->locks[lock]);
+}
+
+/* Bytes at the end of a file searched for the end-of-file marker */
+#define PROGRESSIVE_TAIL_SIZE 32
+
+/* State of a stream over a file that is still being written. Reading beyond
+ * the bytes written so far throws FZ_ERROR_TRYLATER, which mupdf reports as
+ * the document or page not being ready rather than broken. */
+struct mupdf_progressive_s
+{
+    int fd;
+    int64_t length; /* bytes written, updated while the document is read */
+    int complete; /* the file ends in %%EOF, reads past length are the end */
+    unsigned char buffer[4096];
+};
+
+/* Refreshes length and complete from the file */
+static void
+progressive_refresh(mupdf_progressive_t* state)
+{
+    struct stat st;
+    if (fstat(state->fd, &st) != 0) {
+        return;
+    }
+
+    const int64_t length = st.st_size;
+    bool complete        = false;
+
+    char tail[PROGRESSIVE_TAIL_SIZE + 1] = { 0 };
+    const int64_t offset = MAX(0, length - PROGRESSIVE_TAIL_SIZE);
+    const ssize_t read   = pread(state->fd, tail, length - offset, offset);
+    if (read > 0) {
+        /* binary data may precede the marker */
+        for (ssize_t i = 0; i < read; i++) {
+            if (tail[i] == '\0') {
+                tail[i] = ' ';
+            }
+        }
+        tail[read] = '\0';
+        complete   = g_strrstr(tail, "%%EOF") != NULL;
+    }
+
+    __atomic_store_n(&state->length, length, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->complete, complete == true ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+static int
+progressive_next(fz_context* ctx, fz_stream* stm, size_t max)
+{
+    mupdf_progressive_t* state = stm->state;
+
+    const int complete   = __atomic_load_n(&state->complete, __ATOMIC_ACQUIRE);
+    const int64_t length = __atomic_load_n(&state->length, __ATOMIC_RELAXED);
+    if (stm->pos >= length) {
+        if (complete != 0) {
+            return EOF;
+        }
+        fz_throw(ctx, FZ_ERROR_TRYLATER, "data not written yet");
+    }
+
+    const size_t size = MIN(MIN(max, sizeof(state->buffer)), (size_t) (length - stm->pos));
+    const ssize_t n   = pread(state->fd, state->buffer, size, stm->pos);
+    if (n < 0) {
+        fz_throw(ctx, FZ_ERROR_GENERIC, "read error: %s", strerror(errno));
+    }
+    if (n == 0) {
+        return EOF;
+    }
+
+    stm->rp   = state->buffer;
+    stm->wp   = state->buffer + n;
+    stm->pos += n;
+
+    return *stm->rp++;
+}
+
+static void
+progressive_seek(fz_context* ctx, fz_stream* stm, int64_t offset, int whence)
+{
+    mupdf_progressive_t* state = stm->state;
+
+    if (whence == SEEK_END) {
+        offset += __atomic_load_n(&state->length, __ATOMIC_RELAXED);
+    } else if (whence == SEEK_CUR) {
+        offset += stm->pos - (stm->wp - stm->rp);
+    }
+
+    stm->pos = MAX(0, offset);
+    stm->rp  = state->buffer;
+    stm->wp  = state->buffer;
+}
+
+static void
+progressive_drop(fz_context* ctx, void* data)
+{
+    mupdf_progressive_t* state = data;
+    close(state->fd);
+    fz_free(ctx, state);
+}
+
+/* Opens a progressive stream over path and returns its state in progressive */
+static fz_stream*
+progressive_open(fz_context* ctx, const char* path, mupdf_progressive_t** progressive)
+{
+    const int fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        fz_throw(ctx, FZ_ERROR_GENERIC, "cannot open %s: %s", path, strerror(errno));
+    }
+
+    mupdf_progressive_t* state = NULL;
+    fz_try (ctx) {
+        state = fz_malloc_struct(ctx, mupdf_progressive_t);
+    } fz_catch (ctx) {
+        close(fd);
+        fz_rethrow(ctx);
+    }
+
+    state->fd = fd;
+    progressive_refresh(state);
+
+    fz_stream* stream  = fz_new_stream(ctx, state, progressive_next, progressive_drop);
+    stream->seek        = progressive_seek;
+    stream->progressive = 1;
+
+    *progressive = state;
+
+    return stream;
+}
+
+/* Recent mupdf lays out reflowable documents one chapter at a time when its
+ * pages are counted or loaded; older versions lay out the whole document at
+ * once and have no chapters */
+#if FZ_VERSION_MAJOR > 1 || FZ_VERSION_MINOR >= 18
+#define MUPDF_LAZY_LAYOUT 1
+#define MUPDF_COUNT_CHAPTERS(ctx, document) fz_count_chapters(ctx, document)
+#define MUPDF_COUNT_CHAPTER_PAGES(ctx, document, chapter) fz_count_chapter_pages(ctx, document, chapter)
+#else
+#define MUPDF_LAZY_LAYOUT 0
+#define MUPDF_COUNT_CHAPTERS(ctx, document) 1
+#define MUPDF_COUNT_CHAPTER_PAGES(ctx, document, chapter) fz_count_pages(ctx, document)
+#endif
+
+/* Default font size of mupdf's layout */
+#define REFLOW_DEFAULT_EM 12.0
+
+/* Layouts kept by the process-wide cache */
+#define REFLOW_CACHE_SIZE 32
+
+/* Chapter map of a reflowed document. The pages of every chapter are counted
+ * by a thread; first[0..counted] is final once counted has been published,
+ * so readers only need the atomic load. */
+struct mupdf_reflow_s
+{
+    epdf_reflow_t layout;
+    uint8_t hash[32]; /* of the file, key of the cache */
+    fz_context* ctx; /* clone used by the thread */
+    GThread* thread;
+    int stop;
+    bool cached; /* first has been filled from the cache */
+    bool failed; /* a chapter could not be laid out, not cached */
+    int chapters;
+    unsigned int* first; /* first page of every chapter, the number of pages at [chapters] */
+    int counted; /* chapters whose pages have been counted */
+};
+
+typedef struct reflow_cache_entry_s
+{
+    uint8_t hash[32];
+    epdf_reflow_t layout;
+    int chapters;
+    unsigned int* first;
+} reflow_cache_entry_t;
+
+/* Most recently used first */
+static GMutex reflow_cache_lock;
+static GQueue reflow_cache = G_QUEUE_INIT;
+
+static bool
+reflow_cache_matches(const reflow_cache_entry_t* entry, const mupdf_reflow_t* reflow)
+{
+    return memcmp(entry->hash, reflow->hash, sizeof(entry->hash)) == 0 &&
+           entry->layout.width == reflow->layout.width && entry->layout.height == reflow->layout.height &&
+           entry->layout.em == reflow->layout.em && entry->chapters == reflow->chapters;
+}
+
+/* Fills the chapter map from a previous layout of the same file */
+static bool
+reflow_cache_lookup(mupdf_reflow_t* reflow)
+{
+    bool found = false;
+
+    g_mutex_lock(&reflow_cache_lock);
+    for (GList* link = reflow_cache.head; link != NULL; link = link->next) {
+        reflow_cache_entry_t* entry = link->data;
+        if (reflow_cache_matches(entry, reflow) == true) {
+            memcpy(reflow->first, entry->first, (reflow->chapters + 1) * sizeof(unsigned int));
+            g_queue_unlink(&reflow_cache, link);
+            g_queue_push_head_link(&reflow_cache, link);
+            found = true;
+            break;
+        }
+    }
+    g_mutex_unlock(&reflow_cache_lock);
+
+    return found;
+}
+
+static void
+reflow_cache_insert(const mupdf_reflow_t* reflow)
+{
+    reflow_cache_entry_t* entry = g_try_malloc0(sizeof(reflow_cache_entry_t));
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->first = g_try_new(unsigned int, reflow->chapters + 1);
+    if (entry->first == NULL) {
+        g_free(entry);
+        return;
+    }
+
+    memcpy(entry->first, reflow->first, (reflow->chapters + 1) * sizeof(unsigned int));
+    memcpy(entry->hash, reflow->hash, sizeof(entry->hash));
+    entry->layout   = reflow->layout;
+    entry->chapters = reflow->chapters;
+
+    g_mutex_lock(&reflow_cache_lock);
+    g_queue_push_head(&reflow_cache, entry);
+    while (g_queue_get_length(&reflow_cache) > REFLOW_CACHE_SIZE) {
+        reflow_cache_entry_t* last = g_queue_pop_tail(&reflow_cache);
+        g_free(last->first);
+        g_free(last);
+    }
+    g_mutex_unlock(&reflow_cache_lock);
+}
+
+/* Counts the pages chapter by chapter, taking the document lock for each one
+ * so renders of the chapters counted so far go on in between */
+static gpointer
+reflow_thread(gpointer data)
+{
+    EPDF_TRACE_SPAN("reflow_layout");
+
+    mupdf_document_t* mupdf_document = data;
+    mupdf_reflow_t* reflow           = mupdf_document->reflow;
+    fz_context* ctx                  = reflow->ctx;
+
+#if MUPDF_LAZY_LAYOUT == 0
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        fz_layout_document(ctx, mupdf_document->document, reflow->layout.width, reflow->layout.height,
+                           reflow->layout.em);
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        reflow->failed = true;
+    }
+#endif
+
+    for (int chapter = 0; chapter < reflow->chapters; chapter++) {
+        if (__atomic_load_n(&reflow->stop, __ATOMIC_ACQUIRE) != 0) {
+            return NULL;
+        }
+
+        if (reflow->cached == false) {
+            int pages = 0;
+
+            g_mutex_lock(&mupdf_document->lock);
+            fz_try (ctx) {
+                pages = MUPDF_COUNT_CHAPTER_PAGES(ctx, mupdf_document->document, chapter);
+            } fz_always (ctx) {
+                g_mutex_unlock(&mupdf_document->lock);
+            } fz_catch (ctx) {
+                /* a broken chapter has no pages, like in mupdf's own count */
+                pages = 0;
+                reflow->failed = true;
+            }
+
+            reflow->first[chapter + 1] = reflow->first[chapter] + MAX(pages, 0);
+        }
+
+        __atomic_store_n(&reflow->counted, chapter + 1, __ATOMIC_RELEASE);
+    }
+
+    if (reflow->cached == false && reflow->failed == false) {
+        reflow_cache_insert(reflow);
+    }
+
+    return NULL;
+}
+
+static bool
+reflow_requested(const epdf_open_options_t* options)
+{
+    return options->progressive == false && options->reflow.width > 0.0 && options->reflow.height > 0.0;
+}
+
+/* Lays out the document with the requested page and font size and starts
+ * counting its pages, unless a previous layout of the file is cached. Throws
+ * on error. */
+static void
+reflow_start(fz_context* ctx, epdf_document_t* document, mupdf_document_t* mupdf_document)
+{
+    mupdf_reflow_t* reflow = fz_malloc_struct(ctx, mupdf_reflow_t);
+    mupdf_document->reflow = reflow;
+
+    reflow->layout = document->open_options.reflow;
+    if (reflow->layout.em <= 0.0) {
+        reflow->layout.em = REFLOW_DEFAULT_EM;
+    }
+    memcpy(reflow->hash, epdf_document_get_hash(document), sizeof(reflow->hash));
+
+#if MUPDF_LAZY_LAYOUT == 1
+    /* only records the layout, chapters are laid out as they are counted */
+    fz_layout_document(ctx, mupdf_document->document, reflow->layout.width, reflow->layout.height,
+                       reflow->layout.em);
+#endif
+
+    reflow->chapters = MUPDF_COUNT_CHAPTERS(ctx, mupdf_document->document);
+    reflow->first    = fz_calloc(ctx, reflow->chapters + 1, sizeof(unsigned int));
+    reflow->cached   = reflow_cache_lookup(reflow);
+
+    /* nothing left to lay out */
+    if (reflow->cached == true && MUPDF_LAZY_LAYOUT == 1) {
+        reflow->counted = reflow->chapters;
+        return;
+    }
+
+    reflow->ctx = fz_clone_context(ctx);
+    if (reflow->ctx == NULL) {
+        fz_throw(ctx, FZ_ERROR_MEMORY, "cannot clone context");
+    }
+
+    reflow->thread = g_thread_try_new("epdf-reflow", reflow_thread, mupdf_document, NULL);
+    if (reflow->thread == NULL) {
+        fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start layout");
+    }
+}
+
+/* Returns the number of pages counted so far and if all chapters have been
+ * counted */
+static bool
+reflow_get_pages(mupdf_reflow_t* reflow, unsigned int* pages)
+{
+    const int counted = __atomic_load_n(&reflow->counted, __ATOMIC_ACQUIRE);
+    *pages = reflow->first[counted];
+
+    return counted == reflow->chapters;
+}
+
+static void
+reflow_free(fz_context* ctx, mupdf_reflow_t* reflow)
+{
+    if (reflow->thread != NULL) {
+        __atomic_store_n(&reflow->stop, 1, __ATOMIC_RELEASE);
+        g_thread_join(reflow->thread);
+    }
+    if (reflow->ctx != NULL) {
+        fz_drop_context(reflow->ctx);
+    }
+
+    fz_free(ctx, reflow->first);
+    fz_free(ctx, reflow);
+}
+
+fz_page*
+pdf_document_load_reflow_page(fz_context* ctx, mupdf_document_t* mupdf_document, unsigned int index)
+{
+#if MUPDF_LAZY_LAYOUT == 1
+    const mupdf_reflow_t* reflow = mupdf_document->reflow;
+
+    /* last chapter starting at or before index among the counted ones */
+    int low  = 0;
+    int high = __atomic_load_n(&reflow->counted, __ATOMIC_ACQUIRE);
+    while (high - low > 1) {
+        const int middle = low + (high - low) / 2;
+        if (reflow->first[middle] <= index) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return fz_load_chapter_page(ctx, mupdf_document->document, low, index - reflow->first[low]);
+#else
+    return fz_load_page(ctx, mupdf_document->document, index);
+#endif
+}
+
+static void
+mupdf_document_destroy(mupdf_document_t* mupdf_document)
+{
+    /* the layout thread uses the document */
+    if (mupdf_document->reflow != NULL) {
+        reflow_free(mupdf_document->ctx, mupdf_document->reflow);
+    }
+    if (mupdf_document->document != NULL) {
+        fz_drop_document(mupdf_document->ctx, mupdf_document->document);
+    }
+    if (mupdf_document->ctx != NULL) {
+        fz_drop_context(mupdf_document->ctx);
+    }
+
+    for (int i = 0; i < FZ_LOCK_MAX; i++) {
+        g_mutex_clear(&mupdf_document->locks[i]);
+    }
+    g_mutex_clear(&mupdf_document->lock);
+
+    epdf_allocator_free(mupdf_document->allocator);
+    free(mupdf_document);
+}
+
+/* Registered with the plugin manager; mupdf picks the handler from the file
+ * name and contents */
+static const char* const content_types[] = {
+    "application/pdf",
+    "application/oxps",
+    "application/vnd.ms-xpsdocument",
+    "application/epub+zip",
+    "application/x-fictionbook+xml",
+    "application/xhtml+xml",
+    "application/vnd.comicbook+zip",
+    "application/x-cbz",
+    "image/bmp",
+    "image/gif",
+    "image/jpeg",
+    "image/jp2",
+    "image/png",
+    "image/tiff",
+    "image/x-portable-anymap",
+    NULL
+};
+
+/* Formats by the name the handlers report for FZ_META_FORMAT */
+static const struct
+{
+    const char* name;
+    mupdf_format_t format;
+} format_names[] = {
+    { "XPS",          MUPDF_FORMAT_XPS },
+    { "OpenXPS",      MUPDF_FORMAT_XPS },
+    { "EPUB",         MUPDF_FORMAT_EPUB },
+    { "FictionBook2", MUPDF_FORMAT_EPUB },
+    { "XHTML",        MUPDF_FORMAT_EPUB },
+    { "HTML",         MUPDF_FORMAT_EPUB },
+    { "CBZ",          MUPDF_FORMAT_CBZ },
+    { "CBT",          MUPDF_FORMAT_CBZ },
+    { "Image",        MUPDF_FORMAT_IMAGE },
+};
+
+const char* const*
+pdf_plugin_get_content_types(void)
+{
+    return content_types;
+}
+
+/* Throws on error */
+static mupdf_format_t
+mupdf_format_detect(fz_context* ctx, fz_document* document)
+{
+    if (pdf_specifics(ctx, document) != NULL) {
+        return MUPDF_FORMAT_PDF;
+    }
+
+    char name[64] = "";
+    if (fz_lookup_metadata(ctx, document, FZ_META_FORMAT, name, sizeof(name)) > 0) {
+        for (size_t i = 0; i < G_N_ELEMENTS(format_names); i++) {
+            if (g_str_has_prefix(name, format_names[i].name) == TRUE) {
+                return format_names[i].format;
+            }
+        }
+    }
+
+    return fz_is_document_reflowable(ctx, document) != 0 ? MUPDF_FORMAT_EPUB : MUPDF_FORMAT_OTHER;
+}
+
 epdf_error_t
 pdf_document_open(epdf_document_t* document)
 {
+    EPDF_TRACE_SPAN("pdf_document_open");
+
     epdf_error_t error = EPDF_ERROR_OK;
     if (document == NULL) {
         error = EPDF_ERROR_INVALID_ARGUMENTS;
@@ -20,7 +522,30 @@ pdf_document_open(epdf_document_t* document)
         goto error_ret;
     }
 
-    mupdf_document->ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+    /* locks allow cloning the context for worker threads */
+    for (int i = 0; i < FZ_LOCK_MAX; i++) {
+        g_mutex_init(&mupdf_document->locks[i]);
+    }
+    g_mutex_init(&mupdf_document->lock);
+
+    mupdf_document->locks_context.user   = mupdf_document;
+    mupdf_document->locks_context.lock   = mupdf_lock;
+    mupdf_document->locks_context.unlock = mupdf_unlock;
+
+    /* accounts and limits the memory of this document */
+    mupdf_document->allocator = epdf_allocator_new(epdf_allocator_get_default_limit());
+    if (mupdf_document->allocator == NULL) {
+        error = EPDF_ERROR_OUT_OF_MEMORY;
+        goto error_free;
+    }
+
+    mupdf_document->store_size = document->open_options.store_size;
+    if (mupdf_document->store_size == 0) {
+        mupdf_document->store_size = FZ_STORE_DEFAULT;
+    }
+
+    mupdf_document->ctx = fz_new_context(epdf_allocator_get_context(mupdf_document->allocator),
+                                         &mupdf_document->locks_context, mupdf_document->store_size);
     if (mupdf_document->ctx == NULL) {
         error = EPDF_ERROR_UNKNOWN;
         goto error_free;
@@ -30,14 +555,51 @@ pdf_document_open(epdf_document_t* document)
     const char* path     = epdf_document_get_path(document);
     const char* password = epdf_document_get_password(document);
 
+    /* a mapped file is read through a stream over the mapping, without copies
+     * or read calls; the mapping outlives the mupdf document */
+    size_t mapping_size  = 0;
+    const char* mapping  = epdf_document_get_mapping(document, &mapping_size);
+    fz_stream* stream    = NULL;
+
+    fz_var(stream);
+
     fz_try(mupdf_document->ctx){
         fz_register_document_handlers(mupdf_document->ctx);
 
-        mupdf_document->document = fz_open_document(mupdf_document->ctx, path);
+        if (document->open_options.progressive == true) {
+            stream = progressive_open(mupdf_document->ctx, path, &mupdf_document->progressive);
+            mupdf_document->document = fz_open_document_with_stream(mupdf_document->ctx, path, stream);
+        } else if (mapping != NULL) {
+            stream = fz_open_memory(mupdf_document->ctx, (const unsigned char*) mapping, mapping_size);
+            mupdf_document->document = fz_open_document_with_stream(mupdf_document->ctx, path, stream);
+        } else {
+            mupdf_document->document = fz_open_document(mupdf_document->ctx, path);
+        }
+
+        if (mupdf_document->document != NULL) {
+            mupdf_document->format = mupdf_format_detect(mupdf_document->ctx, mupdf_document->document);
+
+            if (mupdf_document->format == MUPDF_FORMAT_EPUB && reflow_requested(&document->open_options) == true) {
+                reflow_start(mupdf_document->ctx, document, mupdf_document);
+            }
+        }
+    }
+    fz_always(mupdf_document->ctx){
+        fz_drop_stream(mupdf_document->ctx, stream);
     }
     fz_catch(mupdf_document->ctx){
-        error = EPDF_ERROR_UNKNOWN;
-        return error;
+        switch (fz_caught(mupdf_document->ctx)) {
+            case FZ_ERROR_MEMORY:
+                error = EPDF_ERROR_OUT_OF_MEMORY;
+                break;
+            case FZ_ERROR_TRYLATER:
+                error = EPDF_ERROR_TRY_LATER;
+                break;
+            default:
+                error = EPDF_ERROR_UNKNOWN;
+                break;
+        }
+        goto error_free;
     }
 
     if (mupdf_document->document == NULL) {
@@ -53,7 +615,14 @@ pdf_document_open(epdf_document_t* document)
         }
     }
 
-    epdf_document_set_number_of_pages(document, fz_count_pages(mupdf_document->ctx, mupdf_document->document));
+    /* a reflowed document grows while its chapters are counted */
+    if (mupdf_document->reflow != NULL) {
+        unsigned int number_of_pages = 0;
+        reflow_get_pages(mupdf_document->reflow, &number_of_pages);
+        epdf_document_set_number_of_pages(document, number_of_pages);
+    } else {
+        epdf_document_set_number_of_pages(document, fz_count_pages(mupdf_document->ctx, mupdf_document->document));
+    }
     epdf_document_set_data(document, mupdf_document);
 
     return EPDF_ERROR_OK;
@@ -61,14 +630,7 @@ pdf_document_open(epdf_document_t* document)
 error_free:
 
     if (mupdf_document != NULL) {
-        if (mupdf_document->document != NULL) {
-            fz_drop_document(mupdf_document->ctx, mupdf_document->document);
-        }
-        if (mupdf_document->ctx != NULL) {
-            fz_drop_context(mupdf_document->ctx);
-        }
-
-        free(mupdf_document);
+        mupdf_document_destroy(mupdf_document);
     }
 
     epdf_document_set_data(document, NULL);
@@ -87,29 +649,740 @@ pdf_document_free(epdf_document_t* document, void* data)
         return EPDF_ERROR_INVALID_ARGUMENTS;
     }
 
-    fz_drop_document(mupdf_document->ctx, mupdf_document->document);
-    fz_drop_context(mupdf_document->ctx);
-    free(mupdf_document);
+    mupdf_document_destroy(mupdf_document);
     epdf_document_set_data(document, NULL);
 
     return EPDF_ERROR_OK;
 }
 
 epdf_error_t
-pdf_document_save_as(epdf_document_t* document, void* data, const char* path)
+pdf_document_update(epdf_document_t* document, void* data, bool* complete)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || complete == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    if (mupdf_document->reflow != NULL) {
+        unsigned int number_of_pages = 0;
+        *complete = reflow_get_pages(mupdf_document->reflow, &number_of_pages);
+        epdf_document_set_number_of_pages(document, number_of_pages);
+        return EPDF_ERROR_OK;
+    }
+
+    if (mupdf_document->progressive == NULL) {
+        *complete = true;
+        return EPDF_ERROR_OK;
+    }
+
+    /* pages mupdf could not load before are retried by the caller */
+    g_mutex_lock(&mupdf_document->lock);
+    progressive_refresh(mupdf_document->progressive);
+    *complete = __atomic_load_n(&mupdf_document->progressive->complete, __ATOMIC_ACQUIRE) != 0;
+    g_mutex_unlock(&mupdf_document->lock);
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+pdf_document_chapters_get(epdf_document_t* document, void* data, GArray* chapters)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || chapters == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    if (mupdf_document->reflow == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    const int counted = __atomic_load_n(&mupdf_document->reflow->counted, __ATOMIC_ACQUIRE);
+    g_array_append_vals(chapters, mupdf_document->reflow->first, counted);
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+pdf_document_get_memory_stats(epdf_document_t* document, void* data, epdf_memory_stats_t* stats)
 {
     mupdf_document_t* mupdf_document = data;
 
-    if (document == NULL || mupdf_document == NULL || path == NULL) {
+    if (document == NULL || mupdf_document == NULL || stats == NULL) {
         return EPDF_ERROR_INVALID_ARGUMENTS;
     }
 
-    fz_try (mupdf_document->ctx) {
-        pdf_save_document(mupdf_document->ctx, (pdf_document*) mupdf_document->document, path, NULL);
-    } fz_catch (mupdf_document->ctx) {
+    /* mupdf calls the allocator with FZ_LOCK_ALLOC held */
+    g_mutex_lock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+    epdf_allocator_get_stats(mupdf_document->allocator, stats);
+    g_mutex_unlock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+pdf_document_set_memory_limit(epdf_document_t* document, void* data, uint64_t limit)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    g_mutex_lock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+    epdf_allocator_set_limit(mupdf_document->allocator, limit);
+    g_mutex_unlock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+pdf_document_get_store_stats(epdf_document_t* document, void* data, epdf_store_stats_t* stats)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || stats == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    /* mupdf does not expose the fill level of the store, the allocator's live
+     * bytes are its upper bound */
+    epdf_memory_stats_t memory = { 0 };
+
+    g_mutex_lock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+    epdf_allocator_get_stats(mupdf_document->allocator, &memory);
+    stats->max       = mupdf_document->store_size;
+    stats->allocated = memory.live;
+    stats->shrinks   = mupdf_document->store_shrinks;
+    stats->released  = mupdf_document->store_released;
+    stats->refused   = memory.failed;
+    g_mutex_unlock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+
+    return EPDF_ERROR_OK;
+}
+
+epdf_error_t
+pdf_document_shrink_store(epdf_document_t* document, void* data, unsigned int percent)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    epdf_memory_stats_t before = { 0 };
+    epdf_memory_stats_t after  = { 0 };
+
+    g_mutex_lock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+    epdf_allocator_get_stats(mupdf_document->allocator, &before);
+    g_mutex_unlock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+
+    /* takes the store locks itself */
+    if (percent == 0) {
+        fz_empty_store(ctx);
+    } else {
+        fz_shrink_store(ctx, percent);
+    }
+
+    g_mutex_lock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+    epdf_allocator_get_stats(mupdf_document->allocator, &after);
+    mupdf_document->store_shrinks++;
+    if (before.live > after.live) {
+        mupdf_document->store_released += before.live - after.live;
+    }
+    g_mutex_unlock(&mupdf_document->locks[FZ_LOCK_ALLOC]);
+
+    fz_drop_context(ctx);
+
+    return EPDF_ERROR_OK;
+}
+
+/* Report progress every PROGRESS_STEP bytes */
+#define PROGRESS_STEP (4 * 1024 * 1024)
+
+/* fz_output forwarding to another output while reporting the progress */
+typedef struct progress_output_s
+{
+  fz_output* out; /**< Output the data is passed on to */
+  uint64_t written; /**< Bytes written so far */
+  uint64_t reported; /**< Bytes written at the last report */
+  uint64_t total; /**< Expected size of the output, 0 if unknown */
+  uint64_t done; /**< Bytes processed before the output, reported ahead of it */
+  epdf_progress_callback_t progress; /**< Progress callback */
+  void* progress_data; /**< Custom data passed to progress */
+} progress_output_t;
+
+static void
+progress_output_write(fz_context* ctx, void* opaque, const void* data, size_t size)
+{
+    progress_output_t* state = opaque;
+
+    fz_write_data(ctx, state->out, data, size);
+    state->written += size;
+
+    if (state->written - state->reported >= PROGRESS_STEP) {
+        state->reported = state->written;
+        state->progress(state->done + state->written, state->done + MAX(state->total, state->written),
+                        state->progress_data);
+    }
+}
+
+static void
+progress_output_seek(fz_context* ctx, void* opaque, int64_t offset, int whence)
+{
+    progress_output_t* state = opaque;
+    fz_seek_output(ctx, state->out, offset, whence);
+}
+
+static int64_t
+progress_output_tell(fz_context* ctx, void* opaque)
+{
+    progress_output_t* state = opaque;
+    return fz_tell_output(ctx, state->out);
+}
+
+static void
+progress_output_close(fz_context* ctx, void* opaque)
+{
+    progress_output_t* state = opaque;
+    fz_close_output(ctx, state->out);
+}
+
+/* Wraps state->out into an output reporting the progress; throws on error */
+static fz_output*
+progress_output_new(fz_context* ctx, progress_output_t* state)
+{
+    fz_output* out = fz_new_output(ctx, 0, state, progress_output_write, progress_output_close, NULL);
+    out->seek      = progress_output_seek;
+    out->tell      = progress_output_tell;
+
+    return out;
+}
+
+static void
+file_copy_progress(goffset current, goffset total, gpointer data)
+{
+    const epdf_save_options_t* options = data;
+    options->progress(current, total, options->progress_data);
+}
+
+/* Writes the whole document to a temporary file next to path and moves it into
+ * place, so the file the document is read from is never truncated while
+ * objects are still loaded from it. */
+static epdf_error_t
+pdf_document_save_full(fz_context* ctx, pdf_document* pdf, const char* path,
+                       const pdf_write_options* write_options, uint64_t expected_size,
+                       epdf_progress_callback_t progress, void* progress_data)
+{
+    char* tmp_path = g_strdup_printf("%s.XXXXXX", path);
+    int fd = g_mkstemp(tmp_path);
+    if (fd == -1) {
+        g_free(tmp_path);
         return EPDF_ERROR_UNKNOWN;
     }
+    close(fd);
+
+    GStatBuf st;
+    g_chmod(tmp_path, g_stat(path, &st) == 0 ? (st.st_mode & 07777) : 0644);
+
+    epdf_error_t error       = EPDF_ERROR_OK;
+    fz_output* file          = NULL;
+    fz_output* out           = NULL;
+    progress_output_t state  = { 0 };
+
+    fz_var(file);
+    fz_var(out);
+
+    fz_try (ctx) {
+        file = fz_new_output_with_path(ctx, tmp_path, 0);
+
+        if (progress != NULL) {
+            state.out           = file;
+            state.total         = expected_size;
+            state.progress      = progress;
+            state.progress_data = progress_data;
+
+            out = progress_output_new(ctx, &state);
+        }
+
+        pdf_write_document(ctx, pdf, out != NULL ? out : file, (pdf_write_options*) write_options);
+
+        if (out != NULL) {
+            fz_close_output(ctx, out);
+        } else {
+            fz_close_output(ctx, file);
+        }
+    } fz_always (ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_output(ctx, file);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    if (error == EPDF_ERROR_OK && g_rename(tmp_path, path) != 0) {
+        error = EPDF_ERROR_UNKNOWN;
+    }
+
+    if (error != EPDF_ERROR_OK) {
+        g_unlink(tmp_path);
+    } else if (progress != NULL) {
+        progress(state.written, state.written, progress_data);
+    }
+
+    g_free(tmp_path);
+
+    return error;
+}
+
+/* Appends the changed objects to path. If path is not the document's own file,
+ * the original is copied there first. Returns EPDF_ERROR_NOT_IMPLEMENTED if
+ * the document can not be saved incrementally. */
+static epdf_error_t
+pdf_document_save_incremental(epdf_document_t* document, mupdf_document_t* mupdf_document,
+                              pdf_document* pdf, const char* path, const epdf_save_options_t* options)
+{
+    fz_context* ctx = mupdf_document->ctx;
+
+    bool can_save = false;
+    bool changed  = false;
+    fz_try (ctx) {
+        can_save = pdf_can_be_saved_incrementally(ctx, pdf) != 0;
+        changed  = pdf_has_unsaved_changes(ctx, pdf) != 0;
+    } fz_catch (ctx) {
+        can_save = false;
+    }
+
+    /* the objects in memory no longer match the offsets of a rewritten file */
+    if (can_save == false || mupdf_document->rewritten == true) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    GFile* source = g_file_new_for_path(epdf_document_get_path(document));
+    GFile* target = g_file_new_for_path(path);
+    bool in_place = g_file_equal(source, target);
+    bool copied   = true;
+
+    if (in_place == false) {
+        copied = g_file_copy(source, target, G_FILE_COPY_OVERWRITE, NULL,
+                             options->progress != NULL ? file_copy_progress : NULL,
+                             (gpointer) options, NULL);
+    }
+
+    g_object_unref(source);
+    g_object_unref(target);
+
+    if (copied == false) {
+        return EPDF_ERROR_UNKNOWN;
+    }
+
+    /* the appended objects are reported after the copy; their size is not
+     * known up front, so the total grows with them */
+    progress_output_t state = { 0 };
+    state.done              = in_place == false ? (uint64_t) document->file_size : 0;
+    state.progress          = options->progress;
+    state.progress_data     = options->progress_data;
+
+    if (changed == true) {
+        pdf_write_options write_options = { 0 };
+        write_options.do_incremental = 1;
+
+        epdf_error_t error = EPDF_ERROR_OK;
+        fz_output* file    = NULL;
+        fz_output* out     = NULL;
+
+        fz_var(file);
+        fz_var(out);
+
+        fz_try (ctx) {
+            /* appends to the original */
+            file = fz_new_output_with_path(ctx, path, 1);
+            if (options->progress != NULL) {
+                state.out = file;
+                out       = progress_output_new(ctx, &state);
+            }
+
+            pdf_write_document(ctx, pdf, out != NULL ? out : file, &write_options);
+
+            if (out != NULL) {
+                fz_close_output(ctx, out);
+            } else {
+                fz_close_output(ctx, file);
+            }
+        } fz_always (ctx) {
+            fz_drop_output(ctx, out);
+            fz_drop_output(ctx, file);
+        } fz_catch (ctx) {
+            error = EPDF_ERROR_NOT_IMPLEMENTED;
+        }
+
+        if (error != EPDF_ERROR_OK) {
+            return error;
+        }
+    }
+
+    if (options->progress != NULL) {
+        options->progress(state.done + state.written, state.done + state.written, options->progress_data);
+    }
 
     return EPDF_ERROR_OK;
 }
 
+epdf_error_t
+pdf_document_save_as(epdf_document_t* document, void* data, const char* path,
+                     const epdf_save_options_t* options)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || path == NULL || options == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    pdf_document* pdf = pdf_specifics(mupdf_document->ctx, mupdf_document->document);
+    if (pdf == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    g_mutex_lock(&mupdf_document->lock);
+
+    epdf_error_t error = EPDF_ERROR_NOT_IMPLEMENTED;
+    if (options->incremental == true) {
+        error = pdf_document_save_incremental(document, mupdf_document, pdf, path, options);
+    }
+
+    /* full save, also the fallback for incremental saves */
+    if (error == EPDF_ERROR_NOT_IMPLEMENTED) {
+        pdf_write_options write_options = { 0 };
+        error = pdf_document_save_full(mupdf_document->ctx, pdf, path, &write_options,
+                                       document->file_size, options->progress, options->progress_data);
+
+        if (error == EPDF_ERROR_OK) {
+            GFile* source = g_file_new_for_path(epdf_document_get_path(document));
+            GFile* target = g_file_new_for_path(path);
+            if (g_file_equal(source, target) == TRUE) {
+                mupdf_document->rewritten = true;
+            }
+            g_object_unref(source);
+            g_object_unref(target);
+        }
+    }
+
+    g_mutex_unlock(&mupdf_document->lock);
+
+    return error;
+}
+
+/* Opens a private copy of the document. A document without unsaved changes
+ * is read again from its file, otherwise its current state is written to
+ * memory under the document lock and read from there, so edits are kept.
+ * Throws on error. */
+static pdf_document*
+pdf_document_open_copy(fz_context* ctx, mupdf_document_t* mupdf_document, const char* path)
+{
+    pdf_document* pdf  = pdf_specifics(ctx, mupdf_document->document);
+    pdf_document* copy = NULL;
+    fz_buffer* buffer  = NULL;
+    fz_output* out     = NULL;
+    fz_stream* stream  = NULL;
+
+    fz_var(copy);
+    fz_var(buffer);
+    fz_var(out);
+    fz_var(stream);
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        if (pdf_has_unsaved_changes(ctx, pdf) != 0) {
+            pdf_write_options write_options = { 0 };
+
+            buffer = fz_new_buffer(ctx, 0);
+            out    = fz_new_output_with_buffer(ctx, buffer);
+            pdf_write_document(ctx, pdf, out, &write_options);
+            fz_close_output(ctx, out);
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+        fz_drop_output(ctx, out);
+    } fz_catch (ctx) {
+        fz_drop_buffer(ctx, buffer);
+        fz_rethrow(ctx);
+    }
+
+    if (buffer == NULL) {
+        return pdf_open_document(ctx, path);
+    }
+
+    fz_try (ctx) {
+        stream = fz_open_buffer(ctx, buffer);
+        copy   = pdf_open_document_with_stream(ctx, stream);
+    } fz_always (ctx) {
+        fz_drop_stream(ctx, stream);
+        fz_drop_buffer(ctx, buffer);
+    } fz_catch (ctx) {
+        fz_rethrow(ctx);
+    }
+
+    return copy;
+}
+
+epdf_error_t
+pdf_document_export(epdf_document_t* document, void* data, const char* path,
+                    const epdf_export_options_t* options)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || path == NULL || options == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    if (mupdf_document->format != MUPDF_FORMAT_PDF) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    /* called from a worker thread */
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    /* garbage collection and linearization renumber and compact the xref in
+     * place, so a private copy of the document is rewritten instead of the
+     * open one, whose object numbers identify annotations and widgets. Only
+     * the resource store is shared, renders go on without the document lock. */
+    const char* password = epdf_document_get_password(document);
+    epdf_error_t error   = EPDF_ERROR_OK;
+    pdf_document* pdf    = NULL;
+
+    fz_var(pdf);
+
+    fz_try (ctx) {
+        pdf = pdf_document_open_copy(ctx, mupdf_document, epdf_document_get_path(document));
+        if (pdf_needs_password(ctx, pdf) != 0 &&
+            (password == NULL || pdf_authenticate_password(ctx, pdf, password) == 0)) {
+            error = EPDF_ERROR_INVALID_PASSWORD;
+        }
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    if (error == EPDF_ERROR_OK) {
+        pdf_write_options write_options = { 0 };
+
+        /* 2: drop unused objects and compact the xref, 4: also merge
+         * duplicate objects and streams */
+        if (options->deduplicate == true) {
+            write_options.do_garbage = 4;
+        } else if (options->garbage_collect == true) {
+            write_options.do_garbage = 2;
+        }
+
+        if (options->compress == true) {
+            write_options.do_compress        = 1;
+            write_options.do_compress_images = 1;
+            write_options.do_compress_fonts  = 1;
+        }
+
+        if (options->linearize == true) {
+            write_options.do_linear = 1;
+        }
+
+        error = pdf_document_save_full(ctx, pdf, path, &write_options, document->file_size,
+                                       options->progress, options->progress_data);
+    }
+
+    pdf_drop_document(ctx, pdf);
+    fz_drop_context(ctx);
+
+    return error;
+}
+
+/* Size of the chunks attachments are streamed in */
+#define ATTACHMENT_CHUNK_SIZE (256 * 1024)
+
+static pdf_obj*
+attachment_get_stream(fz_context* ctx, pdf_obj* filespec)
+{
+    pdf_obj* ef = pdf_dict_get(ctx, filespec, PDF_NAME(EF));
+    pdf_obj* stream = pdf_dict_get(ctx, ef, PDF_NAME(UF));
+    if (stream == NULL) {
+        stream = pdf_dict_get(ctx, ef, PDF_NAME(F));
+    }
+
+    return pdf_is_stream(ctx, stream) != 0 ? stream : NULL;
+}
+
+epdf_error_t
+pdf_document_attachments_get(epdf_document_t* document, void* data, GPtrArray* attachments)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || attachments == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+    pdf_obj* tree      = NULL;
+
+    fz_var(tree);
+
+    g_mutex_lock(&mupdf_document->lock);
+
+    pdf_document* pdf = pdf_specifics(ctx, mupdf_document->document);
+    if (pdf == NULL) {
+        error = EPDF_ERROR_NOT_IMPLEMENTED;
+        goto error_unlock;
+    }
+
+    fz_try (ctx) {
+        tree = pdf_load_name_tree(ctx, pdf, PDF_NAME(EmbeddedFiles));
+
+        const int n = pdf_dict_len(ctx, tree);
+        for (int i = 0; i < n; i++) {
+            pdf_obj* filespec = pdf_dict_get_val(ctx, tree, i);
+            pdf_obj* stream   = attachment_get_stream(ctx, filespec);
+            if (stream == NULL) {
+                continue;
+            }
+
+            epdf_attachment_t* attachment = g_malloc0(sizeof(epdf_attachment_t));
+            attachment->name = g_strdup(pdf_to_name(ctx, pdf_dict_get_key(ctx, tree, i)));
+
+            pdf_obj* filename = pdf_dict_get(ctx, filespec, PDF_NAME(UF));
+            if (filename == NULL) {
+                filename = pdf_dict_get(ctx, filespec, PDF_NAME(F));
+            }
+            attachment->filename = g_strdup(pdf_to_text_string(ctx, filename));
+
+            /* only the stream dictionaries are parsed, the data stays untouched */
+            pdf_obj* size = pdf_dict_getp(ctx, stream, "Params/Size");
+            attachment->size        = pdf_is_int(ctx, size) != 0 ? pdf_to_int64(ctx, size) : -1;
+            attachment->stored_size = pdf_to_int64(ctx, pdf_dict_get(ctx, stream, PDF_NAME(Length)));
+
+            g_ptr_array_add(attachments, attachment);
+        }
+    } fz_always (ctx) {
+        pdf_drop_obj(ctx, tree);
+    } fz_catch (ctx) {
+        error = EPDF_ERROR_UNKNOWN;
+    }
+
+error_unlock:
+
+    g_mutex_unlock(&mupdf_document->lock);
+    fz_drop_context(ctx);
+
+    return error;
+}
+
+epdf_error_t
+pdf_document_attachment_save(epdf_document_t* document, void* data, const char* attachment,
+                             const char* file)
+{
+    mupdf_document_t* mupdf_document = data;
+
+    if (document == NULL || mupdf_document == NULL || attachment == NULL || file == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    /* may be called from a worker thread */
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    epdf_error_t error  = EPDF_ERROR_OK;
+    pdf_obj* tree       = NULL;
+    fz_stream* stream   = NULL;
+    FILE* f             = NULL;
+    unsigned char* buf  = NULL;
+
+    fz_var(tree);
+    fz_var(stream);
+
+    g_mutex_lock(&mupdf_document->lock);
+
+    pdf_document* pdf = pdf_specifics(ctx, mupdf_document->document);
+    if (pdf == NULL) {
+        g_mutex_unlock(&mupdf_document->lock);
+        fz_drop_context(ctx);
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    fz_try (ctx) {
+        tree = pdf_load_name_tree(ctx, pdf, PDF_NAME(EmbeddedFiles));
+
+        pdf_obj* ef_stream = attachment_get_stream(ctx, pdf_dict_gets(ctx, tree, attachment));
+        if (ef_stream == NULL) {
+            fz_throw(ctx, FZ_ERROR_GENERIC, "no attachment named %s", attachment);
+        }
+
+        stream = pdf_open_stream(ctx, ef_stream);
+    } fz_always (ctx) {
+        pdf_drop_obj(ctx, tree);
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        fz_drop_context(ctx);
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    f   = g_fopen(file, "wb");
+    buf = g_try_malloc(ATTACHMENT_CHUNK_SIZE);
+    if (f == NULL || buf == NULL) {
+        error = f == NULL ? EPDF_ERROR_UNKNOWN : EPDF_ERROR_OUT_OF_MEMORY;
+        goto error_free;
+    }
+
+    /* The decoding filters read from the document's file at their own offset,
+     * so the lock is only held while reading a chunk. Renders can interleave
+     * with the extraction of large attachments. */
+    for (;;) {
+        size_t read = 0;
+
+        g_mutex_lock(&mupdf_document->lock);
+        fz_try (ctx) {
+            read = fz_read(ctx, stream, buf, ATTACHMENT_CHUNK_SIZE);
+        } fz_catch (ctx) {
+            error = EPDF_ERROR_UNKNOWN;
+        }
+        g_mutex_unlock(&mupdf_document->lock);
+
+        if (error != EPDF_ERROR_OK || read == 0) {
+            break;
+        }
+
+        if (fwrite(buf, 1, read, f) != read) {
+            error = EPDF_ERROR_UNKNOWN;
+            break;
+        }
+    }
+
+error_free:
+
+    if (f != NULL && fclose(f) != 0 && error == EPDF_ERROR_OK) {
+        error = EPDF_ERROR_UNKNOWN;
+    }
+
+    if (f != NULL && error != EPDF_ERROR_OK) {
+        g_unlink(file);
+    }
+
+    g_free(buf);
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_drop_stream(ctx, stream);
+    g_mutex_unlock(&mupdf_document->lock);
+
+    fz_drop_context(ctx);
+
+    return error;
+}
@@ -1,8 +1,22 @@
+#include "document.h"
+#include "metrics.h"
+#include "page.h"
+#include "plugin.h"
+#include "trace.h"
+#include "render.h"
 #include "types.h"
 
+/* Upper bound of search hits per page */
+#define PDF_SEARCH_MAX_HITS 512
+
+/* Pages of these formats consist of a single image */
+#define MUPDF_FORMAT_IS_IMAGE(format) ((format) == MUPDF_FORMAT_IMAGE || (format) == MUPDF_FORMAT_CBZ)
+
 epdf_error_t
 pdf_page_init(epdf_page_t* page)
 {
+    EPDF_TRACE_SPAN("pdf_page_init");
+
     if (page == NULL) {
         return EPDF_ERROR_INVALID_ARGUMENTS;
     }
@@ -12,6 +26,8 @@ pdf_page_init(epdf_page_t* page)
     mupdf_page_t* mupdf_page         = calloc(1, sizeof(mupdf_page_t));
     unsigned int index               = epdf_page_get_index(page);
 
+    epdf_error_t error               = EPDF_ERROR_UNKNOWN;
+
     if (mupdf_page == NULL) {
         return  EPDF_ERROR_OUT_OF_MEMORY;
     }
@@ -21,14 +37,30 @@ pdf_page_init(epdf_page_t* page)
         goto error_free;
     }
 
-    /* load page */
-    fz_try (mupdf_page->ctx) {
-        mupdf_page->page = fz_load_page(mupdf_document->ctx, mupdf_document->document, index);
-    } fz_catch (mupdf_page->ctx) {
-        goto error_free;
-    }
+    mupdf_page->index = index;
 
-    mupdf_page->bbox = fz_bound_page(mupdf_document->ctx, (fz_page*) mupdf_page->page);
+    /* pages of a reflowed document all have the layout's size, loading them
+     * would lay out their chapters */
+    if (mupdf_document->reflow != NULL) {
+        mupdf_page->bbox = fz_make_rect(0, 0, document->open_options.reflow.width,
+                                        document->open_options.reflow.height);
+    } else {
+        /* load page */
+        fz_try (mupdf_page->ctx) {
+            mupdf_page->page = fz_load_page(mupdf_document->ctx, mupdf_document->document, index);
+        } fz_catch (mupdf_page->ctx) {
+            if (fz_caught(mupdf_page->ctx) == FZ_ERROR_MEMORY) {
+                error = EPDF_ERROR_OUT_OF_MEMORY;
+            } else if (fz_caught(mupdf_page->ctx) == FZ_ERROR_TRYLATER) {
+                /* progressively opened file, the page has not been written yet */
+                error = EPDF_ERROR_TRY_LATER;
+            }
+            goto error_free;
+        }
+        epdf_metrics_count(EPDF_COUNTER_PAGES_LOADED, 1);
+
+        mupdf_page->bbox = fz_bound_page(mupdf_document->ctx, (fz_page*) mupdf_page->page);
+    }
 
     /* setup text */
     mupdf_page->extracted_text = false;
@@ -50,7 +82,7 @@ error_free:
 
     pdf_page_clear(page, mupdf_page);
 
-    return EPDF_ERROR_UNKNOWN;
+    return error;
 }
 
 epdf_error_t
@@ -65,12 +97,26 @@ pdf_page_clear(epdf_page_t* page, void* data)
     mupdf_document_t* mupdf_document = epdf_document_get_data(document);
 
     if (mupdf_page != NULL) {
+        if (mupdf_page->list != NULL) {
+            fz_drop_display_list(mupdf_page->ctx, mupdf_page->list);
+            epdf_metrics_gauge_add(EPDF_GAUGE_DISPLAY_LISTS, -1);
+        }
+
+        if (mupdf_page->annotations != NULL) {
+            fz_drop_display_list(mupdf_page->ctx, mupdf_page->annotations);
+            epdf_metrics_gauge_add(EPDF_GAUGE_DISPLAY_LISTS, -1);
+        }
+
+        g_free(mupdf_page->widgets);
+
         if (mupdf_page->text != NULL) {
             fz_drop_stext_page(mupdf_page->ctx, mupdf_page->text);
+            epdf_metrics_gauge_add(EPDF_GAUGE_TEXT_BYTES, -(int64_t) mupdf_page->text_size);
         }
 
         if (mupdf_page->page != NULL) {
             fz_drop_page(mupdf_document->ctx, mupdf_page->page);
+            epdf_metrics_count(EPDF_COUNTER_PAGES_EVICTED, 1);
         }
 
         free(mupdf_page);
@@ -79,3 +125,1314 @@ pdf_page_clear(epdf_page_t* page, void* data)
     return EPDF_ERROR_UNKNOWN;
 }
 
+/* Size of the chunks raw streams are hashed in */
+#define FINGERPRINT_CHUNK_SIZE 4096
+
+/* Feeds the object number, generation and undecoded bytes of a stream into
+ * checksum; anything else is skipped. Throws on error. */
+static void
+hash_raw_stream(fz_context* ctx, GChecksum* checksum, pdf_obj* obj)
+{
+    if (obj == NULL || pdf_is_stream(ctx, obj) == 0) {
+        return;
+    }
+
+    const int id[2] = { pdf_to_num(ctx, obj), pdf_to_gen(ctx, obj) };
+    g_checksum_update(checksum, (const guchar*) id, sizeof(id));
+
+    fz_stream* stream = NULL;
+
+    fz_var(stream);
+
+    fz_try (ctx) {
+        stream = pdf_open_raw_stream(ctx, obj);
+
+        unsigned char buffer[FINGERPRINT_CHUNK_SIZE];
+        size_t length = 0;
+        while ((length = fz_read(ctx, stream, buffer, sizeof(buffer))) > 0) {
+            g_checksum_update(checksum, buffer, length);
+        }
+    } fz_always (ctx) {
+        fz_drop_stream(ctx, stream);
+    } fz_catch (ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+/* Objects nested deeper than this are not descended into */
+#define FINGERPRINT_MAX_DEPTH 100
+
+static void
+hash_tag(GChecksum* checksum, char tag, const void* value, size_t size)
+{
+    g_checksum_update(checksum, (const guchar*) &tag, 1);
+    g_checksum_update(checksum, (const guchar*) &size, sizeof(size));
+    g_checksum_update(checksum, value, size);
+}
+
+/* Feeds obj and everything it references into checksum. An indirect object is
+ * descended into once, later references only feed its number, which also
+ * breaks cycles. Parent links and other pages, e.g. link destinations, lead
+ * out of the page and are only hashed by reference. Throws on error. */
+static void
+hash_object(fz_context* ctx, GChecksum* checksum, pdf_obj* obj, GHashTable* visited, int depth)
+{
+    if (depth > FINGERPRINT_MAX_DEPTH) {
+        return;
+    }
+
+    pdf_obj* ref = NULL;
+    if (pdf_is_indirect(ctx, obj) != 0) {
+        const int id[2] = { pdf_to_num(ctx, obj), pdf_to_gen(ctx, obj) };
+        hash_tag(checksum, 'R', id, sizeof(id));
+        if (g_hash_table_add(visited, GINT_TO_POINTER(id[0])) == FALSE) {
+            return;
+        }
+
+        ref = obj;
+        obj = pdf_resolve_indirect(ctx, obj);
+        if (depth > 0 && pdf_name_eq(ctx, pdf_dict_get(ctx, obj, PDF_NAME(Type)), PDF_NAME(Page)) != 0) {
+            return;
+        }
+    }
+
+    if (pdf_is_dict(ctx, obj) != 0) {
+        const int n = pdf_dict_len(ctx, obj);
+        hash_tag(checksum, 'd', &n, sizeof(n));
+        for (int i = 0; i < n; i++) {
+            pdf_obj* key = pdf_dict_get_key(ctx, obj, i);
+            const char* name = pdf_to_name(ctx, key);
+            hash_tag(checksum, 'n', name, strlen(name));
+            if (pdf_name_eq(ctx, key, PDF_NAME(Parent)) == 0 && pdf_name_eq(ctx, key, PDF_NAME(P)) == 0) {
+                hash_object(ctx, checksum, pdf_dict_get_val(ctx, obj, i), visited, depth + 1);
+            }
+        }
+
+        hash_raw_stream(ctx, checksum, ref);
+    } else if (pdf_is_array(ctx, obj) != 0) {
+        const int n = pdf_array_len(ctx, obj);
+        hash_tag(checksum, 'a', &n, sizeof(n));
+        for (int i = 0; i < n; i++) {
+            hash_object(ctx, checksum, pdf_array_get(ctx, obj, i), visited, depth + 1);
+        }
+    } else if (pdf_is_name(ctx, obj) != 0) {
+        const char* name = pdf_to_name(ctx, obj);
+        hash_tag(checksum, 'n', name, strlen(name));
+    } else if (pdf_is_string(ctx, obj) != 0) {
+        hash_tag(checksum, 's', pdf_to_str_buf(ctx, obj), pdf_to_str_len(ctx, obj));
+    } else if (pdf_is_int(ctx, obj) != 0) {
+        const int64_t value = pdf_to_int64(ctx, obj);
+        hash_tag(checksum, 'i', &value, sizeof(value));
+    } else if (pdf_is_real(ctx, obj) != 0) {
+        const float value = pdf_to_real(ctx, obj);
+        hash_tag(checksum, 'f', &value, sizeof(value));
+    } else if (pdf_is_bool(ctx, obj) != 0) {
+        const int value = pdf_to_bool(ctx, obj);
+        hash_tag(checksum, 'b', &value, sizeof(value));
+    } else {
+        hash_tag(checksum, 'z', NULL, 0);
+    }
+}
+
+epdf_error_t
+pdf_page_get_fingerprint(epdf_page_t* page, void* data, uint8_t* fingerprint)
+{
+    if (page == NULL || data == NULL || fingerprint == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_document_t* document        = epdf_page_get_document(page);
+    mupdf_document_t* mupdf_document = epdf_document_get_data(document);
+
+    /* only PDF exposes its content objects */
+    if (mupdf_document->format != MUPDF_FORMAT_PDF) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    /* reopens fingerprint the previous revision from the reload thread */
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    if (checksum == NULL) {
+        fz_drop_context(ctx);
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    GHashTable* visited = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    epdf_error_t error = EPDF_ERROR_OK;
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_document* pdf = pdf_specifics(ctx, mupdf_document->document);
+        pdf_obj* page_obj = pdf_lookup_page_obj(ctx, pdf, epdf_page_get_index(page));
+
+        /* geometry */
+        const double size[2] = { epdf_page_get_width(page), epdf_page_get_height(page) };
+        const int rotate = pdf_to_int(ctx, pdf_dict_get_inheritable(ctx, page_obj, PDF_NAME(Rotate)));
+        g_checksum_update(checksum, (const guchar*) size, sizeof(size));
+        g_checksum_update(checksum, (const guchar*) &rotate, sizeof(rotate));
+
+        /* the page with its contents, annotations and everything they use;
+         * resources may be inherited from the page tree */
+        hash_object(ctx, checksum, page_obj, visited, 0);
+        hash_object(ctx, checksum, pdf_dict_get_inheritable(ctx, page_obj, PDF_NAME(Resources)), visited, 1);
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = EPDF_ERROR_UNKNOWN;
+    }
+
+    if (error == EPDF_ERROR_OK) {
+        gsize size = 32;
+        g_checksum_get_digest(checksum, fingerprint, &size);
+    }
+
+    g_hash_table_destroy(visited);
+    g_checksum_free(checksum);
+    fz_drop_context(ctx);
+
+    return error;
+}
+
+/* Records the annotations and form widgets of a page into their own list, so
+ * they can be changed without recording the page contents again */
+static fz_display_list*
+pdf_page_new_annotation_list(fz_context* ctx, fz_page* page)
+{
+    fz_display_list* list = fz_new_display_list(ctx, fz_bound_page(ctx, page));
+    fz_device* device     = NULL;
+
+    fz_var(device);
+
+    fz_try (ctx) {
+        device = fz_new_list_device(ctx, list);
+        fz_run_page_annots(ctx, page, device, fz_identity, NULL);
+        fz_run_page_widgets(ctx, page, device, fz_identity, NULL);
+        fz_close_device(ctx, device);
+    } fz_always (ctx) {
+        fz_drop_device(ctx, device);
+    } fz_catch (ctx) {
+        fz_drop_display_list(ctx, list);
+        fz_rethrow(ctx);
+    }
+
+    return list;
+}
+
+static int
+widget_compare(const void* a, const void* b)
+{
+    const mupdf_widget_t* x = a;
+    const mupdf_widget_t* y = b;
+
+    return (x->rect.y0 > y->rect.y0) - (x->rect.y0 < y->rect.y0);
+}
+
+/* Builds the index of the page's widgets on first use: entries are sorted by
+ * their top edge and carry the largest bottom edge seen so far, so a hit-test
+ * is a binary search followed by a scan of the entries that can still reach
+ * the point. Called with the document lock held, throws on error. */
+static void
+pdf_page_index_widgets(fz_context* ctx, mupdf_page_t* mupdf_page)
+{
+    if (mupdf_page->indexed_widgets == true) {
+        return;
+    }
+
+    pdf_page* pdf_page = pdf_page_from_fz_page(ctx, mupdf_page->page);
+
+    unsigned int number = 0;
+    for (pdf_widget* widget = pdf_page != NULL ? pdf_first_widget(ctx, pdf_page) : NULL; widget != NULL;
+         widget = pdf_next_widget(ctx, widget)) {
+        number++;
+    }
+
+    mupdf_widget_t* widgets = NULL;
+    if (number > 0) {
+        widgets = g_try_malloc_n(number, sizeof(mupdf_widget_t));
+        if (widgets == NULL) {
+            fz_throw(ctx, FZ_ERROR_MEMORY, "cannot allocate widget index");
+        }
+
+        fz_try (ctx) {
+            unsigned int i = 0;
+            for (pdf_widget* widget = pdf_first_widget(ctx, pdf_page); widget != NULL;
+                 widget = pdf_next_widget(ctx, widget)) {
+                widgets[i].rect   = pdf_bound_widget(ctx, widget);
+                widgets[i].widget = widget;
+                i++;
+            }
+        } fz_catch (ctx) {
+            g_free(widgets);
+            fz_rethrow(ctx);
+        }
+
+        qsort(widgets, number, sizeof(mupdf_widget_t), widget_compare);
+
+        float bottom = widgets[0].rect.y1;
+        for (unsigned int i = 0; i < number; i++) {
+            bottom            = MAX(bottom, widgets[i].rect.y1);
+            widgets[i].bottom = bottom;
+        }
+    }
+
+    mupdf_page->widgets         = widgets;
+    mupdf_page->widgets_number  = number;
+    mupdf_page->indexed_widgets = true;
+}
+
+/* Loads the page of a reflowed document on first use. Called with the
+ * document lock held, throws on error. */
+static void
+pdf_page_load(fz_context* ctx, mupdf_document_t* mupdf_document, mupdf_page_t* mupdf_page)
+{
+    if (mupdf_page->page != NULL) {
+        return;
+    }
+
+    mupdf_page->page = pdf_document_load_reflow_page(ctx, mupdf_document, mupdf_page->index);
+    epdf_metrics_count(EPDF_COUNTER_PAGES_LOADED, 1);
+}
+
+/* Returns references to the page's display lists, the contents and the
+ * annotation layer drawn over them, recording them on first use. Display
+ * lists can be run concurrently from cloned contexts. */
+static bool
+pdf_page_get_display_lists(fz_context* ctx, mupdf_document_t* mupdf_document, mupdf_page_t* mupdf_page,
+                           fz_display_list** contents, fz_display_list** annotations)
+{
+    EPDF_TRACE_SPAN("display_list");
+
+    *contents    = NULL;
+    *annotations = NULL;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        if (mupdf_page->list == NULL) {
+            pdf_page_load(ctx, mupdf_document, mupdf_page);
+            mupdf_page->list = fz_new_display_list_from_page_contents(ctx, mupdf_page->page);
+            epdf_metrics_gauge_add(EPDF_GAUGE_DISPLAY_LISTS, 1);
+        }
+        /* only PDF has annotations and widgets */
+        if (mupdf_page->annotations == NULL && mupdf_document->format == MUPDF_FORMAT_PDF) {
+            mupdf_page->annotations = pdf_page_new_annotation_list(ctx, mupdf_page->page);
+            epdf_metrics_gauge_add(EPDF_GAUGE_DISPLAY_LISTS, 1);
+        }
+        /* index the widgets while the page is becoming visible */
+        pdf_page_index_widgets(ctx, mupdf_page);
+        *contents    = fz_keep_display_list(ctx, mupdf_page->list);
+        *annotations = fz_keep_display_list(ctx, mupdf_page->annotations);
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        fz_drop_display_list(ctx, *contents);
+        *contents = NULL;
+    }
+
+    return *contents != NULL;
+}
+
+/* Draws the contents and the annotation layer into the area of pixmap (device
+ * space); throws on error */
+static void
+pdf_page_draw(fz_context* ctx, fz_display_list* contents, fz_display_list* annotations,
+              fz_pixmap* pixmap, fz_matrix ctm, fz_irect area, fz_cookie* cookie)
+{
+    fz_device* device = NULL;
+
+    fz_var(device);
+
+    fz_try (ctx) {
+        device = fz_new_draw_device_with_bbox(ctx, fz_identity, pixmap, &area);
+        fz_run_display_list(ctx, contents, device, ctm, fz_rect_from_irect(area), cookie);
+        if (annotations != NULL) {
+            fz_run_display_list(ctx, annotations, device, ctm, fz_rect_from_irect(area), cookie);
+        }
+        fz_close_device(ctx, device);
+    } fz_always (ctx) {
+        fz_drop_device(ctx, device);
+    } fz_catch (ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+/* Records a display list of an image page for a single rendering. Running the
+ * page needs the document lock, the list only references the page's image and
+ * is drawn without it. Returns NULL on error. */
+static fz_display_list*
+pdf_page_new_direct_list(fz_context* ctx, mupdf_document_t* mupdf_document, mupdf_page_t* mupdf_page)
+{
+    fz_display_list* list = NULL;
+
+    fz_var(list);
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        list = fz_new_display_list_from_page(ctx, mupdf_page->page);
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        list = NULL;
+    }
+
+    return list;
+}
+
+/* Fills the page's structured text on first use. Called with the document
+ * lock held, throws on error. */
+static void
+pdf_page_extract_text(fz_context* ctx, mupdf_document_t* mupdf_document, mupdf_page_t* mupdf_page)
+{
+    EPDF_TRACE_SPAN("text_extract");
+
+    if (mupdf_page->extracted_text == true) {
+        return;
+    }
+
+    /* images carry no text, the page stays empty */
+    if (MUPDF_FORMAT_IS_IMAGE(mupdf_document->format)) {
+        mupdf_page->extracted_text = true;
+        return;
+    }
+
+    fz_device* device = NULL;
+
+    fz_var(device);
+
+    fz_try (ctx) {
+        pdf_page_load(ctx, mupdf_document, mupdf_page);
+
+        device = fz_new_stext_device(ctx, mupdf_page->text, NULL);
+        fz_run_page(ctx, mupdf_page->page, device, fz_identity, NULL);
+        fz_close_device(ctx, device);
+        mupdf_page->extracted_text = true;
+
+        mupdf_page->text_size = fz_pool_size(ctx, mupdf_page->text->pool);
+        epdf_metrics_gauge_add(EPDF_GAUGE_TEXT_BYTES, mupdf_page->text_size);
+    } fz_always (ctx) {
+        fz_drop_device(ctx, device);
+    } fz_catch (ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+char*
+pdf_page_get_text(epdf_page_t* page, void* data, epdf_rectangle_t rectangle, epdf_error_t* error)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_OUT_OF_MEMORY;
+        }
+        return NULL;
+    }
+
+    char* text   = NULL;
+    char* result = NULL;
+
+    fz_var(text);
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_page_extract_text(ctx, mupdf_document, mupdf_page);
+
+        const fz_point a = { rectangle.x1, rectangle.y1 };
+        const fz_point b = { rectangle.x2, rectangle.y2 };
+        text = fz_copy_selection(ctx, mupdf_page->text, a, b, 0);
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        if (error != NULL) {
+            *error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+        }
+    }
+
+    if (text != NULL) {
+        result = g_strdup(text);
+        fz_free(ctx, text);
+    }
+
+    fz_drop_context(ctx);
+
+    return result;
+}
+
+GPtrArray*
+pdf_page_search_text(epdf_page_t* page, void* data, const char* text, epdf_error_t* error)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || text == NULL || *text == '\0') {
+        if (error != NULL) {
+            *error = EPDF_ERROR_INVALID_ARGUMENTS;
+        }
+        return NULL;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+
+    fz_quad* hits       = g_try_new(fz_quad, PDF_SEARCH_MAX_HITS);
+    GPtrArray* results  = g_ptr_array_new_with_free_func(g_free);
+    fz_context* ctx     = fz_clone_context(mupdf_document->ctx);
+    int count           = 0;
+
+    if (hits == NULL || ctx == NULL) {
+        if (error != NULL) {
+            *error = EPDF_ERROR_OUT_OF_MEMORY;
+        }
+        goto error_free;
+    }
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_page_extract_text(ctx, mupdf_document, mupdf_page);
+#if FZ_VERSION_MAJOR > 1 || FZ_VERSION_MINOR >= 18
+        count = fz_search_stext_page(ctx, mupdf_page->text, text, NULL, hits, PDF_SEARCH_MAX_HITS);
+#else
+        count = fz_search_stext_page(ctx, mupdf_page->text, text, hits, PDF_SEARCH_MAX_HITS);
+#endif
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        if (error != NULL) {
+            *error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+        }
+        goto error_free;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const fz_rect rect = fz_rect_from_quad(hits[i]);
+
+        epdf_rectangle_t* rectangle = g_try_malloc(sizeof(epdf_rectangle_t));
+        if (rectangle == NULL) {
+            if (error != NULL) {
+                *error = EPDF_ERROR_OUT_OF_MEMORY;
+            }
+            goto error_free;
+        }
+
+        rectangle->x1 = rect.x0;
+        rectangle->y1 = rect.y0;
+        rectangle->x2 = rect.x1;
+        rectangle->y2 = rect.y1;
+        g_ptr_array_add(results, rectangle);
+    }
+
+    g_free(hits);
+    fz_drop_context(ctx);
+
+    return results;
+
+error_free:
+
+    g_ptr_array_free(results, TRUE);
+    g_free(hits);
+    if (ctx != NULL) {
+        fz_drop_context(ctx);
+    }
+
+    return NULL;
+}
+
+epdf_error_t
+pdf_page_render_image(epdf_page_t* page, void* data, double scale, unsigned int rotation,
+                      fz_cookie* cookie, epdf_image_buffer_t** image)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || image == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_document_t* document        = epdf_page_get_document(page);
+    mupdf_document_t* mupdf_document = epdf_document_get_data(document);
+
+    /* called from render workers */
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+
+    /* an image page is a single image that is immutable once the page has
+     * been loaded: a list recorded for this rendering only references it, and
+     * the draw device decodes it subsampled to about the target size, so
+     * keeping a list with the page gains nothing */
+    const bool direct = MUPDF_FORMAT_IS_IMAGE(mupdf_document->format);
+
+    fz_display_list* list        = NULL;
+    fz_display_list* annotations = NULL;
+    bool recorded                = false;
+    if (direct == true) {
+        list     = pdf_page_new_direct_list(ctx, mupdf_document, mupdf_page);
+        recorded = list != NULL;
+    } else {
+        recorded = pdf_page_get_display_lists(ctx, mupdf_document, mupdf_page, &list, &annotations);
+    }
+    if (recorded == false) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+        fz_drop_context(ctx);
+        return error;
+    }
+
+    epdf_image_buffer_t* buffer = NULL;
+    fz_pixmap* pixmap           = NULL;
+
+    fz_var(pixmap);
+
+    const fz_matrix ctm = fz_pre_rotate(fz_scale(scale, scale), rotation);
+    const fz_irect bbox = fz_round_rect(fz_transform_rect(fz_bound_display_list(ctx, list), ctm));
+
+    buffer = epdf_image_buffer_create(bbox.x1 - bbox.x0, bbox.y1 - bbox.y0);
+    if (buffer == NULL) {
+        error = EPDF_ERROR_OUT_OF_MEMORY;
+        goto error_free;
+    }
+
+    epdf_trace_span_t rasterize = epdf_trace_span_begin("rasterize");
+
+    /* draw straight into the buffer's memory */
+    fz_try (ctx) {
+        pixmap = fz_new_pixmap_with_bbox_and_data(ctx, fz_device_rgb(ctx), bbox, NULL, 0, buffer->data);
+        fz_clear_pixmap_with_value(ctx, pixmap, 0xff);
+
+        pdf_page_draw(ctx, list, annotations, pixmap, ctm, bbox, cookie);
+    } fz_always (ctx) {
+        fz_drop_pixmap(ctx, pixmap);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    epdf_trace_span_end(&rasterize);
+
+    /* the display list stops early when aborted, the image is incomplete */
+    if (error == EPDF_ERROR_OK && cookie != NULL && cookie->abort != 0) {
+        error = EPDF_ERROR_CANCELED;
+    }
+
+error_free:
+
+    if (error != EPDF_ERROR_OK) {
+        epdf_image_buffer_free(buffer);
+        buffer = NULL;
+    }
+
+    fz_drop_display_list(ctx, annotations);
+    fz_drop_display_list(ctx, list);
+    fz_drop_context(ctx);
+
+    *image = buffer;
+
+    return error;
+}
+
+epdf_error_t
+pdf_page_render_region(epdf_page_t* page, void* data, double scale, unsigned int rotation,
+                       epdf_rectangle_t region, epdf_image_buffer_t* image, epdf_rectangle_t* pixels)
+{
+    EPDF_TRACE_SPAN("render_region");
+
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || image == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_document_t* document        = epdf_page_get_document(page);
+    mupdf_document_t* mupdf_document = epdf_document_get_data(document);
+
+    fz_context* ctx = fz_clone_context(mupdf_document->ctx);
+    if (ctx == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    fz_display_list* list        = NULL;
+    fz_display_list* annotations = NULL;
+    if (pdf_page_get_display_lists(ctx, mupdf_document, mupdf_page, &list, &annotations) == false) {
+        fz_drop_context(ctx);
+        return EPDF_ERROR_UNKNOWN;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+    fz_pixmap* pixmap  = NULL;
+
+    fz_var(pixmap);
+
+    /* same geometry as pdf_page_render_image, the image has to match it */
+    const fz_matrix ctm = fz_pre_rotate(fz_scale(scale, scale), rotation);
+    const fz_irect bbox = fz_round_rect(fz_transform_rect(fz_bound_display_list(ctx, list), ctm));
+    const fz_rect rect  = { region.x1, region.y1, region.x2, region.y2 };
+
+    /* one pixel more on every side covers antialiasing at the edges */
+    fz_irect area = fz_round_rect(fz_transform_rect(rect, ctm));
+    area.x0 -= 1;
+    area.y0 -= 1;
+    area.x1 += 1;
+    area.y1 += 1;
+    area = fz_intersect_irect(area, bbox);
+
+    if ((unsigned int) (bbox.x1 - bbox.x0) != image->width || (unsigned int) (bbox.y1 - bbox.y0) != image->height) {
+        error = EPDF_ERROR_INVALID_ARGUMENTS;
+    } else if (fz_is_empty_irect(area) == 0) {
+        fz_try (ctx) {
+            pixmap = fz_new_pixmap_with_bbox_and_data(ctx, fz_device_rgb(ctx), bbox, NULL, 0, image->data);
+            fz_clear_pixmap_rect_with_value(ctx, pixmap, 0xff, area);
+
+            pdf_page_draw(ctx, list, annotations, pixmap, ctm, area, NULL);
+        } fz_always (ctx) {
+            fz_drop_pixmap(ctx, pixmap);
+        } fz_catch (ctx) {
+            error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+        }
+    }
+
+    if (pixels != NULL) {
+        pixels->x1 = fz_is_empty_irect(area) == 0 ? area.x0 - bbox.x0 : 0;
+        pixels->y1 = fz_is_empty_irect(area) == 0 ? area.y0 - bbox.y0 : 0;
+        pixels->x2 = fz_is_empty_irect(area) == 0 ? area.x1 - bbox.x0 : 0;
+        pixels->y2 = fz_is_empty_irect(area) == 0 ? area.y1 - bbox.y0 : 0;
+    }
+
+    fz_drop_display_list(ctx, annotations);
+    fz_drop_display_list(ctx, list);
+    fz_drop_context(ctx);
+
+    return error;
+}
+
+#if FZ_VERSION_MAJOR > 1 || FZ_VERSION_MINOR >= 18
+#define PDF_ANNOT_OBJ(ctx, annot) pdf_annot_obj(ctx, annot)
+#else
+#define PDF_ANNOT_OBJ(ctx, annot) ((annot)->obj)
+#endif
+
+static const struct
+{
+    enum pdf_annot_type pdf;
+    epdf_annotation_type_t type;
+} annotation_types[] = {
+    { PDF_ANNOT_TEXT,       EPDF_ANNOTATION_TEXT },
+    { PDF_ANNOT_FREE_TEXT,  EPDF_ANNOTATION_FREE_TEXT },
+    { PDF_ANNOT_HIGHLIGHT,  EPDF_ANNOTATION_HIGHLIGHT },
+    { PDF_ANNOT_UNDERLINE,  EPDF_ANNOTATION_UNDERLINE },
+    { PDF_ANNOT_STRIKE_OUT, EPDF_ANNOTATION_STRIKE_OUT },
+    { PDF_ANNOT_SQUARE,     EPDF_ANNOTATION_SQUARE },
+    { PDF_ANNOT_CIRCLE,     EPDF_ANNOTATION_CIRCLE },
+};
+
+static epdf_annotation_type_t
+annotation_type_from_pdf(enum pdf_annot_type type)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(annotation_types); i++) {
+        if (annotation_types[i].pdf == type) {
+            return annotation_types[i].type;
+        }
+    }
+
+    return EPDF_ANNOTATION_UNKNOWN;
+}
+
+/* Returns -1 for types that can not be created */
+static int
+annotation_type_to_pdf(epdf_annotation_type_t type)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(annotation_types); i++) {
+        if (annotation_types[i].type == type) {
+            return annotation_types[i].pdf;
+        }
+    }
+
+    return -1;
+}
+
+static epdf_rectangle_t
+annotation_rectangle(fz_rect rect)
+{
+    const epdf_rectangle_t rectangle = { rect.x0, rect.y0, rect.x1, rect.y1 };
+    return rectangle;
+}
+
+static pdf_annot*
+pdf_page_find_annot(fz_context* ctx, pdf_page* page, int id)
+{
+    for (pdf_annot* annot = pdf_first_annot(ctx, page); annot != NULL; annot = pdf_next_annot(ctx, annot)) {
+        if (pdf_to_num(ctx, PDF_ANNOT_OBJ(ctx, annot)) == id) {
+            return annot;
+        }
+    }
+
+    return NULL;
+}
+
+/* Throws on error */
+static epdf_annotation_t*
+pdf_annot_read(fz_context* ctx, pdf_annot* annot)
+{
+    int n          = 0;
+    float color[4] = { 0 };
+    pdf_annot_color(ctx, annot, &n, color);
+
+    const int id                      = pdf_to_num(ctx, PDF_ANNOT_OBJ(ctx, annot));
+    const epdf_annotation_type_t type = annotation_type_from_pdf(pdf_annot_type(ctx, annot));
+    const fz_rect rect                = pdf_bound_annot(ctx, annot);
+    const float opacity               = pdf_annot_opacity(ctx, annot);
+    const char* contents              = pdf_annot_contents(ctx, annot);
+
+    /* nothing throws from here on */
+    epdf_annotation_t* annotation = g_malloc0(sizeof(epdf_annotation_t));
+    annotation->id        = id;
+    annotation->type      = type;
+    annotation->rectangle = annotation_rectangle(rect);
+    annotation->opacity   = opacity;
+    annotation->contents  = g_strdup(contents);
+
+    for (unsigned int c = 0; c < 3; c++) {
+        if (n == 1) {
+            annotation->color[c] = color[0];
+        } else if (n == 3) {
+            annotation->color[c] = color[c];
+        } else if (n == 4) {
+            annotation->color[c] = 1.0f - MIN(1.0f, color[c] + color[3]);
+        }
+    }
+
+    return annotation;
+}
+
+/* Sets the properties of annotation on annot and regenerates its appearance;
+ * throws on error */
+static void
+pdf_annot_apply(fz_context* ctx, pdf_annot* annot, const epdf_annotation_t* annotation)
+{
+    const fz_rect rect = {
+        annotation->rectangle.x1, annotation->rectangle.y1,
+        annotation->rectangle.x2, annotation->rectangle.y2
+    };
+
+    switch (annotation->type) {
+        case EPDF_ANNOTATION_HIGHLIGHT:
+        case EPDF_ANNOTATION_UNDERLINE:
+        case EPDF_ANNOTATION_STRIKE_OUT: {
+            /* text markup covers quads, the rectangle follows from them */
+            const fz_quad quad = fz_quad_from_rect(rect);
+            pdf_set_annot_quad_points(ctx, annot, 1, &quad);
+            break;
+        }
+        default:
+            pdf_set_annot_rect(ctx, annot, rect);
+            break;
+    }
+
+    pdf_set_annot_color(ctx, annot, 3, annotation->color);
+    pdf_set_annot_opacity(ctx, annot, annotation->opacity);
+    pdf_set_annot_contents(ctx, annot, annotation->contents != NULL ? annotation->contents : "");
+    pdf_update_annot(ctx, annot);
+}
+
+/* The annotation layer is recorded again on the next render. Called with the
+ * document lock held. */
+static void
+pdf_page_annotations_changed(fz_context* ctx, epdf_page_t* page, mupdf_page_t* mupdf_page)
+{
+    if (mupdf_page->annotations != NULL) {
+        fz_drop_display_list(ctx, mupdf_page->annotations);
+        mupdf_page->annotations = NULL;
+        epdf_metrics_gauge_add(EPDF_GAUGE_DISPLAY_LISTS, -1);
+    }
+
+    /* shared by the views of all openers */
+    g_atomic_int_inc(&epdf_page_get_source(page)->annotations_revision);
+}
+
+epdf_error_t
+pdf_page_annotations_get(epdf_page_t* page, void* data, GPtrArray* annotations)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || annotations == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    pdf_page* pdf_page = pdf_page_from_fz_page(ctx, mupdf_page->page);
+    if (pdf_page == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        for (pdf_annot* annot = pdf_first_annot(ctx, pdf_page); annot != NULL; annot = pdf_next_annot(ctx, annot)) {
+            g_ptr_array_add(annotations, pdf_annot_read(ctx, annot));
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+epdf_error_t
+pdf_page_annotation_add(epdf_page_t* page, void* data, epdf_annotation_t* annotation,
+                        epdf_rectangle_t* dirty)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || annotation == NULL || dirty == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    const int type = annotation_type_to_pdf(annotation->type);
+    if (type < 0) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    pdf_page* pdf_page = pdf_page_from_fz_page(ctx, mupdf_page->page);
+    if (pdf_page == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+    pdf_annot* annot   = NULL;
+
+    fz_var(annot);
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        annot = pdf_create_annot(ctx, pdf_page, type);
+        pdf_annot_apply(ctx, annot, annotation);
+
+        annotation->id = pdf_to_num(ctx, PDF_ANNOT_OBJ(ctx, annot));
+        *dirty         = annotation_rectangle(pdf_bound_annot(ctx, annot));
+
+        pdf_page_annotations_changed(ctx, page, mupdf_page);
+    } fz_always (ctx) {
+#if FZ_VERSION_MAJOR > 1 || FZ_VERSION_MINOR >= 18
+        pdf_drop_annot(ctx, annot);
+#endif
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+epdf_error_t
+pdf_page_annotation_update(epdf_page_t* page, void* data, const epdf_annotation_t* annotation,
+                           epdf_rectangle_t* dirty)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || annotation == NULL || dirty == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    pdf_page* pdf_page = pdf_page_from_fz_page(ctx, mupdf_page->page);
+    if (pdf_page == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_annot* annot = pdf_page_find_annot(ctx, pdf_page, annotation->id);
+        if (annot == NULL) {
+            error = EPDF_ERROR_INVALID_ARGUMENTS;
+        } else if (annotation_type_from_pdf(pdf_annot_type(ctx, annot)) != annotation->type) {
+            error = EPDF_ERROR_INVALID_ARGUMENTS;
+        } else {
+            /* the old and the new appearance have to be redrawn */
+            const fz_rect before = pdf_bound_annot(ctx, annot);
+            pdf_annot_apply(ctx, annot, annotation);
+            *dirty = annotation_rectangle(fz_union_rect(before, pdf_bound_annot(ctx, annot)));
+
+            pdf_page_annotations_changed(ctx, page, mupdf_page);
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+epdf_error_t
+pdf_page_annotation_remove(epdf_page_t* page, void* data, int id, epdf_rectangle_t* dirty)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || dirty == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    pdf_page* pdf_page = pdf_page_from_fz_page(ctx, mupdf_page->page);
+    if (pdf_page == NULL) {
+        return EPDF_ERROR_NOT_IMPLEMENTED;
+    }
+
+    epdf_error_t error = EPDF_ERROR_OK;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_annot* annot = pdf_page_find_annot(ctx, pdf_page, id);
+        if (annot == NULL) {
+            error = EPDF_ERROR_INVALID_ARGUMENTS;
+        } else {
+            *dirty = annotation_rectangle(pdf_bound_annot(ctx, annot));
+            pdf_delete_annot(ctx, pdf_page, annot);
+
+            pdf_page_annotations_changed(ctx, page, mupdf_page);
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+static const struct
+{
+    enum pdf_widget_type pdf;
+    epdf_form_field_type_t type;
+} form_field_types[] = {
+    { PDF_WIDGET_TYPE_TEXT,        EPDF_FORM_FIELD_TEXT },
+    { PDF_WIDGET_TYPE_CHECKBOX,    EPDF_FORM_FIELD_CHECK_BOX },
+    { PDF_WIDGET_TYPE_RADIOBUTTON, EPDF_FORM_FIELD_RADIO_BUTTON },
+    { PDF_WIDGET_TYPE_COMBOBOX,    EPDF_FORM_FIELD_COMBO_BOX },
+    { PDF_WIDGET_TYPE_LISTBOX,     EPDF_FORM_FIELD_LIST_BOX },
+    { PDF_WIDGET_TYPE_BUTTON,      EPDF_FORM_FIELD_PUSH_BUTTON },
+    { PDF_WIDGET_TYPE_SIGNATURE,   EPDF_FORM_FIELD_SIGNATURE },
+};
+
+static epdf_form_field_type_t
+form_field_type_from_pdf(enum pdf_widget_type type)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(form_field_types); i++) {
+        if (form_field_types[i].pdf == type) {
+            return form_field_types[i].type;
+        }
+    }
+
+    return EPDF_FORM_FIELD_UNKNOWN;
+}
+
+/* The field a widget belongs to: the widget itself if it is a field of its
+ * own (has a name), otherwise its parent, which radio buttons share */
+static pdf_obj*
+pdf_widget_field(fz_context* ctx, pdf_widget* widget)
+{
+    pdf_obj* obj = PDF_ANNOT_OBJ(ctx, widget);
+
+    if (pdf_dict_get(ctx, obj, PDF_NAME(T)) == NULL && pdf_dict_get(ctx, obj, PDF_NAME(Parent)) != NULL) {
+        return pdf_dict_get(ctx, obj, PDF_NAME(Parent));
+    }
+
+    return obj;
+}
+
+/* Joins the partial names of the field and its ancestors; throws on error */
+static char*
+pdf_field_full_name(fz_context* ctx, pdf_obj* field)
+{
+    GString* name = g_string_new(NULL);
+
+    fz_try (ctx) {
+        /* bounded, parent chains may be cyclic in broken files */
+        for (unsigned int depth = 0; field != NULL && depth < 32; depth++) {
+            const char* partial = pdf_dict_get_text_string(ctx, field, PDF_NAME(T));
+            if (partial != NULL && partial[0] != '\0') {
+                if (name->len > 0) {
+                    g_string_prepend_c(name, '.');
+                }
+                g_string_prepend(name, partial);
+            }
+            field = pdf_dict_get(ctx, field, PDF_NAME(Parent));
+        }
+    } fz_catch (ctx) {
+        g_string_free(name, TRUE);
+        fz_rethrow(ctx);
+    }
+
+    return g_string_free(name, FALSE);
+}
+
+/* Returns the value of a field as text, NULL if it has none; throws on error */
+static char*
+pdf_field_value_text(fz_context* ctx, pdf_obj* field)
+{
+    pdf_obj* value = pdf_dict_get_inheritable(ctx, field, PDF_NAME(V));
+
+    /* multiple selections of list boxes are reported by the first */
+    if (pdf_is_array(ctx, value) != 0) {
+        value = pdf_array_get(ctx, value, 0);
+    }
+
+    if (pdf_is_name(ctx, value) != 0) {
+        return g_strdup(pdf_to_name(ctx, value));
+    } else if (pdf_is_string(ctx, value) != 0) {
+        return g_strdup(pdf_to_text_string(ctx, value));
+    }
+
+    return NULL;
+}
+
+/* Throws on error */
+static epdf_form_field_t*
+pdf_widget_read(fz_context* ctx, const mupdf_widget_t* entry)
+{
+    pdf_obj* field = pdf_widget_field(ctx, entry->widget);
+
+    const int id                      = pdf_to_num(ctx, PDF_ANNOT_OBJ(ctx, entry->widget));
+    const epdf_form_field_type_t type = form_field_type_from_pdf(pdf_widget_type(ctx, entry->widget));
+    const bool read_only              = (pdf_field_flags(ctx, field) & PDF_FIELD_IS_READ_ONLY) != 0;
+    char* name                        = pdf_field_full_name(ctx, field);
+    char* value                       = NULL;
+
+    fz_try (ctx) {
+        value = pdf_field_value_text(ctx, field);
+    } fz_catch (ctx) {
+        g_free(name);
+        fz_rethrow(ctx);
+    }
+
+    /* check boxes and radio buttons show their state, not the field value */
+    if (type == EPDF_FORM_FIELD_CHECK_BOX || type == EPDF_FORM_FIELD_RADIO_BUTTON) {
+        g_free(value);
+        value = NULL;
+
+        fz_try (ctx) {
+            pdf_obj* state = pdf_dict_get(ctx, PDF_ANNOT_OBJ(ctx, entry->widget), PDF_NAME(AS));
+            value          = g_strdup(pdf_is_name(ctx, state) != 0 ? pdf_to_name(ctx, state) : "Off");
+        } fz_catch (ctx) {
+            g_free(name);
+            fz_rethrow(ctx);
+        }
+    }
+
+    /* nothing throws from here on */
+    epdf_form_field_t* form_field = g_malloc0(sizeof(epdf_form_field_t));
+    form_field->id        = id;
+    form_field->type      = type;
+    form_field->rectangle = annotation_rectangle(entry->rect);
+    form_field->name      = name;
+    form_field->value     = value;
+    form_field->read_only = read_only;
+
+    return form_field;
+}
+
+epdf_error_t
+pdf_page_form_fields_get(epdf_page_t* page, void* data, GPtrArray* form_fields)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || form_fields == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    epdf_error_t error = EPDF_ERROR_OK;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_page_index_widgets(ctx, mupdf_page);
+        for (unsigned int i = 0; i < mupdf_page->widgets_number; i++) {
+            g_ptr_array_add(form_fields, pdf_widget_read(ctx, &mupdf_page->widgets[i]));
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+/* Returns the entry of the widget at the point or NULL. Called with the
+ * document lock held. */
+static const mupdf_widget_t*
+pdf_page_widget_at(mupdf_page_t* mupdf_page, fz_point point)
+{
+    /* first entry whose top edge is below the point */
+    unsigned int low  = 0;
+    unsigned int high = mupdf_page->widgets_number;
+    while (low < high) {
+        const unsigned int middle = low + (high - low) / 2;
+        if (mupdf_page->widgets[middle].rect.y0 <= point.y) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    /* entries before it start above the point; stop once none reaches down */
+    for (unsigned int i = low; i > 0 && mupdf_page->widgets[i - 1].bottom >= point.y; i--) {
+        const mupdf_widget_t* entry = &mupdf_page->widgets[i - 1];
+        if (fz_is_point_inside_rect(point, entry->rect) != 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+epdf_error_t
+pdf_page_form_field_at(epdf_page_t* page, void* data, double x, double y, epdf_form_field_t** form_field)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || form_field == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    epdf_error_t error = EPDF_ERROR_OK;
+    *form_field        = NULL;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_page_index_widgets(ctx, mupdf_page);
+        const mupdf_widget_t* entry = pdf_page_widget_at(mupdf_page, fz_make_point(x, y));
+        if (entry != NULL) {
+            *form_field = pdf_widget_read(ctx, entry);
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
+
+/* Sets the value of the widget's field and regenerates its appearance;
+ * returns false if the value can not be set. Throws on error. */
+static bool
+pdf_widget_set_value(fz_context* ctx, pdf_widget* widget, const char* value)
+{
+    pdf_obj* obj = PDF_ANNOT_OBJ(ctx, widget);
+
+    if ((pdf_field_flags(ctx, pdf_widget_field(ctx, widget)) & PDF_FIELD_IS_READ_ONLY) != 0) {
+        return false;
+    }
+
+    switch (pdf_widget_type(ctx, widget)) {
+        case PDF_WIDGET_TYPE_TEXT:
+            if (pdf_set_text_field_value(ctx, widget, value) == 0) {
+                return false;
+            }
+            break;
+        case PDF_WIDGET_TYPE_COMBOBOX:
+        case PDF_WIDGET_TYPE_LISTBOX:
+            if (pdf_set_choice_field_value(ctx, widget, value) == 0) {
+                return false;
+            }
+            break;
+        case PDF_WIDGET_TYPE_CHECKBOX:
+        case PDF_WIDGET_TYPE_RADIOBUTTON: {
+            /* any state but Off turns the widget on */
+            pdf_obj* state   = pdf_dict_get(ctx, obj, PDF_NAME(AS));
+            const bool on    = strcmp(value, "Off") != 0;
+            const bool is_on = state != NULL && pdf_name_eq(ctx, state, PDF_NAME(Off)) == 0;
+            if (on != is_on) {
+                pdf_toggle_widget(ctx, widget);
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+
+    pdf_update_annot(ctx, widget);
+
+    return true;
+}
+
+epdf_error_t
+pdf_page_form_field_set_value(epdf_page_t* page, void* data, int id, const char* value,
+                              epdf_rectangle_t* dirty)
+{
+    mupdf_page_t* mupdf_page = data;
+
+    if (page == NULL || mupdf_page == NULL || value == NULL || dirty == NULL) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    mupdf_document_t* mupdf_document = epdf_document_get_data(epdf_page_get_document(page));
+    fz_context* ctx                  = mupdf_document->ctx;
+
+    epdf_error_t error = EPDF_ERROR_OK;
+
+    g_mutex_lock(&mupdf_document->lock);
+    fz_try (ctx) {
+        pdf_page_index_widgets(ctx, mupdf_page);
+
+        const mupdf_widget_t* entry = NULL;
+        for (unsigned int i = 0; i < mupdf_page->widgets_number && entry == NULL; i++) {
+            if (pdf_to_num(ctx, PDF_ANNOT_OBJ(ctx, mupdf_page->widgets[i].widget)) == id) {
+                entry = &mupdf_page->widgets[i];
+            }
+        }
+
+        if (entry == NULL || pdf_widget_set_value(ctx, entry->widget, value) == false) {
+            error = EPDF_ERROR_INVALID_ARGUMENTS;
+        } else {
+            /* widgets of the same field (radio buttons, repeated fields) change
+             * along with it; everything else on the page stays as it is */
+            pdf_obj* field = pdf_widget_field(ctx, entry->widget);
+            fz_rect area   = fz_empty_rect;
+            for (unsigned int i = 0; i < mupdf_page->widgets_number; i++) {
+                if (pdf_widget_field(ctx, mupdf_page->widgets[i].widget) == field) {
+                    area = fz_union_rect(area, mupdf_page->widgets[i].rect);
+                }
+            }
+            *dirty = annotation_rectangle(area);
+
+            pdf_page_annotations_changed(ctx, page, mupdf_page);
+        }
+    } fz_always (ctx) {
+        g_mutex_unlock(&mupdf_document->lock);
+    } fz_catch (ctx) {
+        error = fz_caught(ctx) == FZ_ERROR_MEMORY ? EPDF_ERROR_OUT_OF_MEMORY : EPDF_ERROR_UNKNOWN;
+    }
+
+    return error;
+}
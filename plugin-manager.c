@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "plugin.h"
+#include "plugin-manager.h"
+
+/* Bytes read from the start of a file to sniff its content type */
+#define CONTENT_TYPE_SNIFF_SIZE 1024
+
+struct epdf_plugin_s
+{
+    char* name;
+    const char* const* content_types;
+    epdf_plugin_functions_t functions;
+};
+
+struct epdf_plugin_manager_s
+{
+    GPtrArray* plugins;
+    GPtrArray* content_types; /* NULL terminated, borrowed from the plugins */
+};
+
+struct epdf_content_type_context_s
+{
+    size_t sniff_size;
+};
+
+/* The mupdf backend is linked in rather than loaded */
+static const epdf_plugin_functions_t mupdf_functions = {
+    .document_open             = pdf_document_open,
+    .document_free             = pdf_document_free,
+    .document_update           = pdf_document_update,
+    .document_chapters_get     = pdf_document_chapters_get,
+    .document_save_as          = pdf_document_save_as,
+    .document_export           = pdf_document_export,
+    .document_attachments_get  = pdf_document_attachments_get,
+    .document_attachment_save  = pdf_document_attachment_save,
+    .document_get_memory_stats = pdf_document_get_memory_stats,
+    .document_set_memory_limit = pdf_document_set_memory_limit,
+    .document_get_store_stats  = pdf_document_get_store_stats,
+    .document_shrink_store     = pdf_document_shrink_store,
+    .page_init                 = pdf_page_init,
+    .page_clear                = pdf_page_clear,
+    .page_get_fingerprint      = pdf_page_get_fingerprint,
+    .page_get_text             = pdf_page_get_text,
+    .page_search_text          = pdf_page_search_text,
+    .page_render_image         = pdf_page_render_image,
+    .page_render_region        = pdf_page_render_region,
+    .page_annotations_get      = pdf_page_annotations_get,
+    .page_annotation_add       = pdf_page_annotation_add,
+    .page_annotation_update    = pdf_page_annotation_update,
+    .page_annotation_remove    = pdf_page_annotation_remove,
+    .page_form_fields_get      = pdf_page_form_fields_get,
+    .page_form_field_at        = pdf_page_form_field_at,
+    .page_form_field_set_value = pdf_page_form_field_set_value,
+};
+
+static void
+plugin_free(void* data)
+{
+    epdf_plugin_t* plugin = data;
+
+    g_free(plugin->name);
+    g_free(plugin);
+}
+
+epdf_t*
+epdf_new(void)
+{
+    epdf_t* epdf = g_try_malloc0(sizeof(epdf_t));
+    if (epdf == NULL) {
+        return NULL;
+    }
+
+    epdf->content_type_context = epdf_content_type_context_new();
+    epdf->plugins.manager      = epdf_plugin_manager_new();
+    if (epdf->content_type_context == NULL || epdf->plugins.manager == NULL) {
+        goto error_free;
+    }
+
+    if (epdf_plugin_manager_register(epdf->plugins.manager, "mupdf", pdf_plugin_get_content_types(),
+            &mupdf_functions) == NULL) {
+        goto error_free;
+    }
+
+    return epdf;
+
+error_free:
+
+    epdf_free(epdf);
+    return NULL;
+}
+
+void
+epdf_free(epdf_t* epdf)
+{
+    if (epdf == NULL) {
+        return;
+    }
+
+    epdf_content_type_context_free(epdf->content_type_context);
+    epdf_plugin_manager_free(epdf->plugins.manager);
+    g_free(epdf);
+}
+
+epdf_plugin_manager_t*
+epdf_plugin_manager_new(void)
+{
+    epdf_plugin_manager_t* manager = g_try_malloc0(sizeof(epdf_plugin_manager_t));
+    if (manager == NULL) {
+        return NULL;
+    }
+
+    manager->plugins       = g_ptr_array_new_with_free_func(plugin_free);
+    manager->content_types = g_ptr_array_new();
+    g_ptr_array_add(manager->content_types, NULL);
+
+    return manager;
+}
+
+void
+epdf_plugin_manager_free(epdf_plugin_manager_t* manager)
+{
+    if (manager == NULL) {
+        return;
+    }
+
+    g_ptr_array_free(manager->content_types, TRUE);
+    g_ptr_array_free(manager->plugins, TRUE);
+    g_free(manager);
+}
+
+epdf_plugin_t*
+epdf_plugin_manager_register(epdf_plugin_manager_t* manager, const char* name,
+                             const char* const* content_types, const epdf_plugin_functions_t* functions)
+{
+    if (manager == NULL || name == NULL || content_types == NULL || functions == NULL) {
+        return NULL;
+    }
+
+    epdf_plugin_t* plugin = g_try_malloc0(sizeof(epdf_plugin_t));
+    if (plugin == NULL) {
+        return NULL;
+    }
+
+    plugin->name          = g_strdup(name);
+    plugin->content_types = content_types;
+    plugin->functions     = *functions;
+    g_ptr_array_add(manager->plugins, plugin);
+
+    /* keep the array NULL terminated */
+    g_ptr_array_remove_index(manager->content_types, manager->content_types->len - 1);
+    for (const char* const* type = content_types; *type != NULL; type++) {
+        if (epdf_plugin_manager_get_plugin(manager, *type) == plugin) {
+            g_ptr_array_add(manager->content_types, (void*) *type);
+        }
+    }
+    g_ptr_array_add(manager->content_types, NULL);
+
+    return plugin;
+}
+
+epdf_plugin_t*
+epdf_plugin_manager_get_plugin(epdf_plugin_manager_t* manager, const char* content_type)
+{
+    if (manager == NULL || content_type == NULL) {
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < manager->plugins->len; i++) {
+        epdf_plugin_t* plugin = g_ptr_array_index(manager->plugins, i);
+        for (const char* const* type = plugin->content_types; *type != NULL; type++) {
+            if (g_strcmp0(*type, content_type) == 0) {
+                return plugin;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+const char* const*
+epdf_plugin_manager_get_content_types(epdf_plugin_manager_t* manager)
+{
+    if (manager == NULL) {
+        return NULL;
+    }
+
+    return (const char* const*) manager->content_types->pdata;
+}
+
+const epdf_plugin_functions_t*
+epdf_plugin_get_functions(const epdf_plugin_t* plugin)
+{
+    if (plugin == NULL) {
+        return NULL;
+    }
+
+    return &plugin->functions;
+}
+
+const char*
+epdf_plugin_get_name(const epdf_plugin_t* plugin)
+{
+    if (plugin == NULL) {
+        return NULL;
+    }
+
+    return plugin->name;
+}
+
+epdf_content_type_context_t*
+epdf_content_type_context_new(void)
+{
+    epdf_content_type_context_t* context = g_try_malloc0(sizeof(epdf_content_type_context_t));
+    if (context == NULL) {
+        return NULL;
+    }
+
+    context->sniff_size = CONTENT_TYPE_SNIFF_SIZE;
+
+    return context;
+}
+
+void
+epdf_content_type_context_free(epdf_content_type_context_t* context)
+{
+    g_free(context);
+}
+
+/* mupdf accepts PDF files with junk before the header, which defeats the
+ * shared-mime-info magic */
+static bool
+content_type_is_pdf(const guchar* data, size_t length)
+{
+    static const char header[] = "%PDF-";
+
+    for (size_t i = 0; i + sizeof(header) - 1 <= length; i++) {
+        if (memcmp(data + i, header, sizeof(header) - 1) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+char*
+epdf_content_type_guess(epdf_content_type_context_t* context, const char* path,
+                        const char* const* content_types)
+{
+    if (context == NULL || path == NULL) {
+        return NULL;
+    }
+
+    guchar* data = g_malloc(context->sniff_size);
+    size_t length = 0;
+
+    FILE* file = fopen(path, "rb");
+    if (file != NULL) {
+        length = fread(data, 1, context->sniff_size, file);
+        fclose(file);
+    }
+
+    if (content_type_is_pdf(data, length) == true) {
+        g_free(data);
+        return g_strdup("application/pdf");
+    }
+
+    char* guess = g_content_type_guess(path, data, length, NULL);
+    g_free(data);
+    if (guess == NULL) {
+        return NULL;
+    }
+
+    char* content_type = g_content_type_get_mime_type(guess);
+
+    /* map a subtype or alias onto the type the backend registered */
+    if (content_types != NULL) {
+        for (const char* const* type = content_types; *type != NULL; type++) {
+            if (g_strcmp0(content_type, *type) == 0) {
+                break;
+            }
+
+            char* registered = g_content_type_from_mime_type(*type);
+            bool is_a = registered != NULL && g_content_type_is_a(guess, registered) == TRUE;
+            g_free(registered);
+
+            if (is_a == true) {
+                g_free(content_type);
+                content_type = g_strdup(*type);
+                break;
+            }
+        }
+    }
+
+    g_free(guess);
+
+    return content_type;
+}
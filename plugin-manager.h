@@ -0,0 +1,178 @@
+#ifndef PLUGIN_MANAGER_H
+#define PLUGIN_MANAGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <cairo.h>
+#include <glib.h>
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Functions a backend implements. Unimplemented functions are NULL and the
+ * document and page functions return EPDF_ERROR_NOT_IMPLEMENTED for them.
+ */
+typedef struct epdf_plugin_functions_s
+{
+  epdf_error_t (*document_open)(epdf_document_t* document);
+  epdf_error_t (*document_free)(epdf_document_t* document, void* data);
+  epdf_error_t (*document_update)(epdf_document_t* document, void* data, bool* complete);
+  epdf_error_t (*document_chapters_get)(epdf_document_t* document, void* data, GArray* chapters);
+  epdf_error_t (*document_save_as)(epdf_document_t* document, void* data, const char* path,
+      const epdf_save_options_t* options);
+  epdf_error_t (*document_export)(epdf_document_t* document, void* data, const char* path,
+      const epdf_export_options_t* options);
+  epdf_error_t (*document_attachments_get)(epdf_document_t* document, void* data, GPtrArray* attachments);
+  epdf_error_t (*document_attachment_save)(epdf_document_t* document, void* data, const char* attachment,
+      const char* file);
+  epdf_error_t (*document_get_memory_stats)(epdf_document_t* document, void* data, epdf_memory_stats_t* stats);
+  epdf_error_t (*document_set_memory_limit)(epdf_document_t* document, void* data, uint64_t limit);
+  epdf_error_t (*document_get_store_stats)(epdf_document_t* document, void* data, epdf_store_stats_t* stats);
+  epdf_error_t (*document_shrink_store)(epdf_document_t* document, void* data, unsigned int percent);
+  epdf_error_t (*page_init)(epdf_page_t* page);
+  epdf_error_t (*page_clear)(epdf_page_t* page, void* data);
+  epdf_error_t (*page_get_fingerprint)(epdf_page_t* page, void* data, uint8_t* fingerprint);
+  epdf_error_t (*page_get_label)(epdf_page_t* page, void* data, char** label);
+  char* (*page_get_text)(epdf_page_t* page, void* data, epdf_rectangle_t rectangle, epdf_error_t* error);
+  GPtrArray* (*page_search_text)(epdf_page_t* page, void* data, const char* text, epdf_error_t* error);
+  cairo_surface_t* (*page_image_get_cairo)(epdf_page_t* page, void* data, epdf_image_t* image,
+      epdf_error_t* error);
+  epdf_error_t (*page_render_cairo)(epdf_page_t* page, void* data, cairo_t* cairo, bool printing);
+  epdf_error_t (*page_render_image)(epdf_page_t* page, void* data, double scale, unsigned int rotation,
+      fz_cookie* cookie, epdf_image_buffer_t** image);
+  epdf_error_t (*page_render_region)(epdf_page_t* page, void* data, double scale, unsigned int rotation,
+      epdf_rectangle_t region, epdf_image_buffer_t* image, epdf_rectangle_t* pixels);
+  epdf_error_t (*page_annotations_get)(epdf_page_t* page, void* data, GPtrArray* annotations);
+  epdf_error_t (*page_annotation_add)(epdf_page_t* page, void* data, epdf_annotation_t* annotation,
+      epdf_rectangle_t* dirty);
+  epdf_error_t (*page_annotation_update)(epdf_page_t* page, void* data, const epdf_annotation_t* annotation,
+      epdf_rectangle_t* dirty);
+  epdf_error_t (*page_annotation_remove)(epdf_page_t* page, void* data, int id, epdf_rectangle_t* dirty);
+  epdf_error_t (*page_form_fields_get)(epdf_page_t* page, void* data, GPtrArray* form_fields);
+  epdf_error_t (*page_form_field_at)(epdf_page_t* page, void* data, double x, double y,
+      epdf_form_field_t** form_field);
+  epdf_error_t (*page_form_field_set_value)(epdf_page_t* page, void* data, int id, const char* value,
+      epdf_rectangle_t* dirty);
+} epdf_plugin_functions_t;
+
+typedef struct epdf_plugin_manager_s epdf_plugin_manager_t;
+typedef struct epdf_content_type_context_s epdf_content_type_context_t;
+
+/**
+ * An epdf instance: the backends documents are opened with
+ */
+struct epdf_s
+{
+  epdf_content_type_context_t* content_type_context; /**< Detects the content type of opened files */
+  struct {
+    epdf_plugin_manager_t* manager; /**< Registered backends */
+  } plugins;
+};
+
+/**
+ * Creates an epdf instance with the built-in mupdf backend registered
+ *
+ * @return The instance or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_t* epdf_new(void);
+
+/**
+ * Frees an epdf instance. Documents opened with it must have been freed.
+ *
+ * @param epdf The instance
+ */
+EPDF_PLUGIN_API void epdf_free(epdf_t* epdf);
+
+/**
+ * Creates an empty plugin manager
+ *
+ * @return The plugin manager or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_plugin_manager_t* epdf_plugin_manager_new(void);
+
+/**
+ * Frees a plugin manager and its plugins
+ *
+ * @param manager The plugin manager
+ */
+EPDF_PLUGIN_API void epdf_plugin_manager_free(epdf_plugin_manager_t* manager);
+
+/**
+ * Registers a backend. A content type that is already handled keeps its
+ * earlier backend.
+ *
+ * @param manager The plugin manager
+ * @param name Name of the backend
+ * @param content_types NULL terminated array of content types the backend
+ *   opens, it must stay valid as long as the manager
+ * @param functions The functions of the backend, copied
+ * @return The plugin or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_plugin_t* epdf_plugin_manager_register(epdf_plugin_manager_t* manager,
+    const char* name, const char* const* content_types, const epdf_plugin_functions_t* functions);
+
+/**
+ * Returns the backend that opens a content type
+ *
+ * @param manager The plugin manager
+ * @param content_type The content type
+ * @return The plugin or NULL if no backend opens content_type
+ */
+EPDF_PLUGIN_API epdf_plugin_t* epdf_plugin_manager_get_plugin(epdf_plugin_manager_t* manager,
+    const char* content_type);
+
+/**
+ * Returns the content types all registered backends open
+ *
+ * @param manager The plugin manager
+ * @return NULL terminated array of content types, valid until the next
+ *   backend is registered
+ */
+EPDF_PLUGIN_API const char* const* epdf_plugin_manager_get_content_types(epdf_plugin_manager_t* manager);
+
+/**
+ * Returns the functions of a backend
+ *
+ * @param plugin The plugin
+ * @return The functions
+ */
+EPDF_PLUGIN_API const epdf_plugin_functions_t* epdf_plugin_get_functions(const epdf_plugin_t* plugin);
+
+/**
+ * Returns the name of a backend
+ *
+ * @param plugin The plugin
+ * @return The name
+ */
+EPDF_PLUGIN_API const char* epdf_plugin_get_name(const epdf_plugin_t* plugin);
+
+/**
+ * Creates a content type context
+ *
+ * @return The context or NULL if an error occurred
+ */
+EPDF_PLUGIN_API epdf_content_type_context_t* epdf_content_type_context_new(void);
+
+/**
+ * Frees a content type context
+ *
+ * @param context The context
+ */
+EPDF_PLUGIN_API void epdf_content_type_context_free(epdf_content_type_context_t* context);
+
+/**
+ * Guesses the content type of a file from its name and its first bytes. A
+ * guess that is a subtype of one of content_types is mapped to it.
+ *
+ * @param context The context
+ * @param path Path of the file
+ * @param content_types NULL terminated array of preferred content types or
+ *   NULL
+ * @return The content type (free with g_free) or NULL if it could not be
+ *   determined
+ */
+EPDF_PLUGIN_API char* epdf_content_type_guess(epdf_content_type_context_t* context, const char* path,
+    const char* const* content_types);
+
+#endif // PLUGIN_MANAGER_H
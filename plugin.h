@@ -0,0 +1,302 @@
+#ifndef PDF_PLUGIN_H
+#define PDF_PLUGIN_H
+
+#include <glib.h>
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Open a PDF document
+ *
+ * @param document The document
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_open(epdf_document_t* document);
+
+/**
+ * Returns the content types the backend opens: PDF, XPS, EPUB, CBZ and
+ * images, all read through mupdf's document handlers
+ *
+ * @return NULL terminated array of content types
+ */
+EPDF_PLUGIN_API const char* const* pdf_plugin_get_content_types(void);
+
+/**
+ * Closes and frees the internal document structure
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_free(epdf_document_t* document, void* data);
+
+/**
+ * Picks up data appended to a progressively opened document
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @param complete Set to true once the file has been written completely
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_update(epdf_document_t* document, void* data, bool* complete);
+
+/**
+ * Returns the first page of every chapter of a reflowed document whose pages
+ * have been counted
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @param chapters Array of unsigned int the first pages are appended to
+ * @return EPDF_ERROR_OK if no error occurred, EPDF_ERROR_NOT_IMPLEMENTED if
+ *   the document is not reflowed
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_chapters_get(epdf_document_t* document, void* data, GArray* chapters);
+
+/**
+ * Loads a page of a reflowed document from its chapter. Called with the
+ * document lock held; throws on error.
+ *
+ * @param ctx The context
+ * @param mupdf_document The mupdf document
+ * @param index Index of a page that has been counted
+ * @return The page
+ */
+EPDF_PLUGIN_API fz_page* pdf_document_load_reflow_page(fz_context* ctx, mupdf_document_t* mupdf_document,
+    unsigned int index);
+
+/**
+ * Saves the document to the given path
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @param path The path
+ * @param options Save options or NULL for a full rewrite
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_save_as(epdf_document_t* document, void* data, const char* path,
+    const epdf_save_options_t* options);
+
+/**
+ * Exports an optimized copy of the document
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @param path The target path
+ * @param options Export options
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_export(epdf_document_t* document, void* data, const char* path,
+    const epdf_export_options_t* options);
+
+/**
+ * Lists the embedded files of the document
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @param attachments Array the epdf_attachment_t entries are added to
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_attachments_get(epdf_document_t* document, void* data,
+    GPtrArray* attachments);
+
+/**
+ * Saves an embedded file
+ *
+ * @param document The document
+ * @param data The mupdf document
+ * @param attachment Name of the attachment
+ * @param file Target path
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_attachment_save(epdf_document_t* document, void* data,
+    const char* attachment, const char* file);
+
+/**
+ * Returns the allocator statistics of the document
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_get_memory_stats(epdf_document_t* document, void* data,
+    epdf_memory_stats_t* stats);
+
+/**
+ * Sets the hard memory limit of the document
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_set_memory_limit(epdf_document_t* document, void* data,
+    uint64_t limit);
+
+/**
+ * Returns the resource store statistics of the document
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_get_store_stats(epdf_document_t* document, void* data,
+    epdf_store_stats_t* stats);
+
+/**
+ * Shrinks the resource store of the document to percent of its size
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_document_shrink_store(epdf_document_t* document, void* data,
+    unsigned int percent);
+
+/**
+ * Loads a page
+ *
+ * @param page The page
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_init(epdf_page_t* page);
+
+/**
+ * Frees the mupdf page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_clear(epdf_page_t* page, void* data);
+
+/**
+ * Computes the content fingerprint of a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param fingerprint Set to the 32 byte fingerprint
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_get_fingerprint(epdf_page_t* page, void* data, uint8_t* fingerprint);
+
+/**
+ * Returns the text in a rectangle of the page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param rectangle The selection
+ * @param error Set to an error value if an error occurred
+ * @return The text (free with g_free) or NULL if an error occurred
+ */
+EPDF_PLUGIN_API char* pdf_page_get_text(epdf_page_t* page, void* data, epdf_rectangle_t rectangle,
+    epdf_error_t* error);
+
+/**
+ * Searches the page for text
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param text The text to search
+ * @param error Set to an error value if an error occurred
+ * @return Array of epdf_rectangle_t hits or NULL if an error occurred
+ */
+EPDF_PLUGIN_API GPtrArray* pdf_page_search_text(epdf_page_t* page, void* data, const char* text,
+    epdf_error_t* error);
+
+/**
+ * Renders a page into a packed RGB image
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param scale The scale in pixels per point
+ * @param rotation The rotation
+ * @param cookie Cookie to abort the rendering or NULL
+ * @param image Set to the image
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_render_image(epdf_page_t* page, void* data, double scale,
+    unsigned int rotation, fz_cookie* cookie, epdf_image_buffer_t** image);
+
+/**
+ * Draws a region of a page again into an image rendered by
+ * pdf_page_render_image
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param scale The scale of the image
+ * @param rotation The rotation of the image
+ * @param region The region in page coordinates
+ * @param image The image, modified in place
+ * @param pixels Set to the area drawn in image pixels, or NULL
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_render_region(epdf_page_t* page, void* data, double scale,
+    unsigned int rotation, epdf_rectangle_t region, epdf_image_buffer_t* image, epdf_rectangle_t* pixels);
+
+/**
+ * Lists the annotations of a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param annotations Array the epdf_annotation_t entries are added to
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_annotations_get(epdf_page_t* page, void* data, GPtrArray* annotations);
+
+/**
+ * Adds an annotation to a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param annotation The annotation, its id is set
+ * @param dirty Set to the area of the page that changed
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_annotation_add(epdf_page_t* page, void* data,
+    epdf_annotation_t* annotation, epdf_rectangle_t* dirty);
+
+/**
+ * Changes an annotation of a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param annotation The annotation
+ * @param dirty Set to the area of the page that changed
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_annotation_update(epdf_page_t* page, void* data,
+    const epdf_annotation_t* annotation, epdf_rectangle_t* dirty);
+
+/**
+ * Removes an annotation from a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param id Identifier of the annotation
+ * @param dirty Set to the area of the page that changed
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_annotation_remove(epdf_page_t* page, void* data, int id,
+    epdf_rectangle_t* dirty);
+
+/**
+ * Lists the form field widgets of a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param form_fields Array the epdf_form_field_t entries are added to
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_form_fields_get(epdf_page_t* page, void* data, GPtrArray* form_fields);
+
+/**
+ * Finds the form field widget at a point of a page
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param x The x coordinate in page coordinates
+ * @param y The y coordinate in page coordinates
+ * @param form_field Set to the widget or NULL if there is none
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_form_field_at(epdf_page_t* page, void* data, double x, double y,
+    epdf_form_field_t** form_field);
+
+/**
+ * Sets the value of a form field
+ *
+ * @param page The page
+ * @param data The mupdf page
+ * @param id Identifier of the widget
+ * @param value The value
+ * @param dirty Set to the area of the page that changed
+ * @return EPDF_ERROR_OK if no error occurred
+ */
+EPDF_PLUGIN_API epdf_error_t pdf_page_form_field_set_value(epdf_page_t* page, void* data, int id,
+    const char* value, epdf_rectangle_t* dirty);
+
+#endif // PDF_PLUGIN_H
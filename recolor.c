@@ -0,0 +1,289 @@
+#include <math.h>
+#include <string.h>
+
+#include "recolor.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RECOLOR_X86 1
+#include <immintrin.h>
+#endif
+
+void
+epdf_recolor_init(epdf_recolor_t* recolor)
+{
+    if (recolor == NULL) {
+        return;
+    }
+
+    memset(recolor, 0, sizeof(epdf_recolor_t));
+    recolor->mode     = EPDF_RECOLOR_NONE;
+    recolor->gamma    = 1.0;
+    recolor->contrast = 1.0;
+    memset(recolor->background, 0xff, sizeof(recolor->background));
+}
+
+static bool
+has_tone_curve(const epdf_recolor_t* recolor)
+{
+    return fabs(recolor->gamma - 1.0) > 1e-6 || fabs(recolor->contrast - 1.0) > 1e-6;
+}
+
+bool
+epdf_recolor_is_identity(const epdf_recolor_t* recolor)
+{
+    return recolor == NULL || (recolor->mode == EPDF_RECOLOR_NONE && has_tone_curve(recolor) == false);
+}
+
+bool
+epdf_recolor_equal(const epdf_recolor_t* a, const epdf_recolor_t* b)
+{
+    if (epdf_recolor_is_identity(a) == true || epdf_recolor_is_identity(b) == true) {
+        return epdf_recolor_is_identity(a) == epdf_recolor_is_identity(b);
+    }
+
+    if (a->mode != b->mode || fabs(a->gamma - b->gamma) > 1e-6 || fabs(a->contrast - b->contrast) > 1e-6) {
+        return false;
+    }
+
+    return a->mode != EPDF_RECOLOR_TWO_COLOR ||
+        (memcmp(a->foreground, b->foreground, 3) == 0 && memcmp(a->background, b->background, 3) == 0);
+}
+
+/* x * bg + (255 - x) * fg, divided by 255 with rounding */
+static inline uint8_t
+two_color(uint8_t x, uint8_t foreground, uint8_t background)
+{
+    const unsigned int t = x * background + (255 - x) * foreground + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+/* Scalar kernels, also used for the tails of the vector kernels */
+
+static void
+invert_scalar(uint8_t* p, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p[i] ^= 0xff;
+    }
+}
+
+/* offset is the channel of p[0] */
+static void
+two_color_scalar(uint8_t* p, size_t n, const uint8_t* fg, const uint8_t* bg, unsigned int offset)
+{
+    for (size_t i = 0; i < n; i++) {
+        const unsigned int c = (offset + i) % 3;
+        p[i] = two_color(p[i], fg[c], bg[c]);
+    }
+}
+
+#ifdef RECOLOR_X86
+
+__attribute__((target("sse2"))) static size_t
+invert_sse2(uint8_t* p, size_t n)
+{
+    const __m128i ones = _mm_set1_epi8((char) 0xff);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+        _mm_storeu_si128((__m128i*) (p + i), _mm_xor_si128(v, ones));
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t
+invert_avx2(uint8_t* p, size_t n)
+{
+    const __m256i ones = _mm256_set1_epi8((char) 0xff);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+        _mm256_storeu_si256((__m256i*) (p + i), _mm256_xor_si256(v, ones));
+    }
+
+    return i;
+}
+
+/* The channel pattern repeats every 48 bytes, i.e. every three vectors of 16
+ * bytes. Each vector is widened to 16 bit lanes, blended and narrowed back. */
+
+__attribute__((target("sse2"))) static inline __m128i
+two_color_sse2_lanes(__m128i x, __m128i fg, __m128i bg)
+{
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, bg), _mm_mullo_epi16(_mm_sub_epi16(c255, x), fg));
+    t = _mm_add_epi16(t, c128);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2"))) static size_t
+two_color_sse2(uint8_t* p, size_t n, const uint8_t* fg, const uint8_t* bg)
+{
+    __m128i fg_lanes[3][2];
+    __m128i bg_lanes[3][2];
+    for (unsigned int v = 0; v < 3; v++) {
+        for (unsigned int half = 0; half < 2; half++) {
+            uint16_t f[8], b[8];
+            for (unsigned int j = 0; j < 8; j++) {
+                const unsigned int c = (16 * v + 8 * half + j) % 3;
+                f[j] = fg[c];
+                b[j] = bg[c];
+            }
+            fg_lanes[v][half] = _mm_loadu_si128((const __m128i*) f);
+            bg_lanes[v][half] = _mm_loadu_si128((const __m128i*) b);
+        }
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 48 <= n; i += 48) {
+        for (unsigned int v = 0; v < 3; v++) {
+            __m128i x  = _mm_loadu_si128((const __m128i*) (p + i + 16 * v));
+            __m128i lo = two_color_sse2_lanes(_mm_unpacklo_epi8(x, zero), fg_lanes[v][0], bg_lanes[v][0]);
+            __m128i hi = two_color_sse2_lanes(_mm_unpackhi_epi8(x, zero), fg_lanes[v][1], bg_lanes[v][1]);
+            _mm_storeu_si128((__m128i*) (p + i + 16 * v), _mm_packus_epi16(lo, hi));
+        }
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t
+two_color_avx2(uint8_t* p, size_t n, const uint8_t* fg, const uint8_t* bg)
+{
+    __m256i fg_lanes[3];
+    __m256i bg_lanes[3];
+    for (unsigned int v = 0; v < 3; v++) {
+        uint16_t f[16], b[16];
+        for (unsigned int j = 0; j < 16; j++) {
+            const unsigned int c = (16 * v + j) % 3;
+            f[j] = fg[c];
+            b[j] = bg[c];
+        }
+        fg_lanes[v] = _mm256_loadu_si256((const __m256i*) f);
+        bg_lanes[v] = _mm256_loadu_si256((const __m256i*) b);
+    }
+
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i c128 = _mm256_set1_epi16(128);
+
+    size_t i = 0;
+    for (; i + 48 <= n; i += 48) {
+        for (unsigned int v = 0; v < 3; v++) {
+            __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (p + i + 16 * v)));
+            __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, bg_lanes[v]),
+                                         _mm256_mullo_epi16(_mm256_sub_epi16(c255, x), fg_lanes[v]));
+            t = _mm256_add_epi16(t, c128);
+            t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+
+            __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1));
+            _mm_storeu_si128((__m128i*) (p + i + 16 * v), packed);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+static void
+apply_invert(uint8_t* p, size_t n)
+{
+    size_t done = 0;
+
+#ifdef RECOLOR_X86
+    if (__builtin_cpu_supports("avx2")) {
+        done = invert_avx2(p, n);
+    } else if (__builtin_cpu_supports("sse2")) {
+        done = invert_sse2(p, n);
+    }
+#endif
+
+    invert_scalar(p + done, n - done);
+}
+
+static void
+apply_two_color(uint8_t* p, size_t n, const uint8_t* fg, const uint8_t* bg)
+{
+    size_t done = 0;
+
+#ifdef RECOLOR_X86
+    if (__builtin_cpu_supports("avx2")) {
+        done = two_color_avx2(p, n, fg, bg);
+    } else if (__builtin_cpu_supports("sse2")) {
+        done = two_color_sse2(p, n, fg, bg);
+    }
+#endif
+
+    /* done is a multiple of 48, so p[done] is a red channel */
+    two_color_scalar(p + done, n - done, fg, bg, 0);
+}
+
+/* Mode, contrast and gamma composed into one table per channel */
+static void
+apply_tone_curve(const epdf_recolor_t* recolor, epdf_image_buffer_t* image)
+{
+    uint8_t lut[3][256];
+    for (unsigned int c = 0; c < 3; c++) {
+        for (unsigned int x = 0; x < 256; x++) {
+            unsigned int v = x;
+            if (recolor->mode == EPDF_RECOLOR_INVERT) {
+                v = 255 - x;
+            } else if (recolor->mode == EPDF_RECOLOR_TWO_COLOR) {
+                v = two_color(x, recolor->foreground[c], recolor->background[c]);
+            }
+
+            double f = (v / 255.0 - 0.5) * recolor->contrast + 0.5;
+            f = f < 0.0 ? 0.0 : (f > 1.0 ? 1.0 : f);
+            if (recolor->gamma > 0.0) {
+                f = pow(f, 1.0 / recolor->gamma);
+            }
+            lut[c][x] = (uint8_t) lround(f * 255.0);
+        }
+    }
+
+    for (unsigned int y = 0; y < image->height; y++) {
+        uint8_t* p = image->data + (size_t) y * image->rowstride;
+        for (unsigned int x = 0; x < image->width; x++, p += 3) {
+            p[0] = lut[0][p[0]];
+            p[1] = lut[1][p[1]];
+            p[2] = lut[2][p[2]];
+        }
+    }
+}
+
+void
+epdf_recolor_apply(const epdf_recolor_t* recolor, epdf_image_buffer_t* image)
+{
+    EPDF_TRACE_SPAN("recolor");
+
+    if (image == NULL || epdf_recolor_is_identity(recolor) == true) {
+        return;
+    }
+
+    if (has_tone_curve(recolor) == true) {
+        apply_tone_curve(recolor, image);
+        return;
+    }
+
+    /* packed rows are one run of bytes, views into larger images one run per row */
+    const bool packed = image->rowstride == image->width * 3;
+    const size_t n    = packed == true ? (size_t) image->rowstride * image->height : (size_t) image->width * 3;
+    const unsigned int runs = packed == true ? 1 : image->height;
+
+    for (unsigned int i = 0; i < runs; i++) {
+        uint8_t* data = image->data + (size_t) i * image->rowstride;
+        if (recolor->mode == EPDF_RECOLOR_INVERT) {
+            apply_invert(data, n);
+        } else if (recolor->mode == EPDF_RECOLOR_TWO_COLOR) {
+            apply_two_color(data, n, recolor->foreground, recolor->background);
+        }
+    }
+}
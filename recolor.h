@@ -0,0 +1,41 @@
+#ifndef RECOLOR_H
+#define RECOLOR_H
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Initializes recolor settings that leave images untouched
+ *
+ * @param recolor The settings
+ */
+EPDF_PLUGIN_API void epdf_recolor_init(epdf_recolor_t* recolor);
+
+/**
+ * Returns whether the settings leave images untouched
+ *
+ * @param recolor The settings
+ * @return true if epdf_recolor_apply would not change any pixel
+ */
+EPDF_PLUGIN_API bool epdf_recolor_is_identity(const epdf_recolor_t* recolor);
+
+/**
+ * Compares two recolor settings
+ *
+ * @param a,b The settings
+ * @return true if both produce the same images
+ */
+EPDF_PLUGIN_API bool epdf_recolor_equal(const epdf_recolor_t* a, const epdf_recolor_t* b);
+
+/**
+ * Applies the recolor settings to an image in place. Inverting and two-colour
+ * recoloring use SSE2 or AVX2 kernels where available; gamma and contrast are
+ * folded with the mode into one lookup table per channel.
+ *
+ * @param recolor The settings
+ * @param image The image, or a view of a region of an image (rowstride larger
+ *   than width * 3)
+ */
+EPDF_PLUGIN_API void epdf_recolor_apply(const epdf_recolor_t* recolor, epdf_image_buffer_t* image);
+
+#endif // RECOLOR_H
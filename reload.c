@@ -0,0 +1,216 @@
+#include <string.h>
+#include <glib.h>
+
+#include "document.h"
+#include "file-watch.h"
+#include "reload.h"
+#include "render.h"
+#include "trace.h"
+
+struct epdf_reload_s
+{
+    epdf_t* epdf;
+    epdf_document_t* document; /* most recent revision, guarded by lock */
+    unsigned int debounce; /* milliseconds */
+    epdf_reload_callback_t callback;
+    void* data;
+    epdf_file_watch_t* watch;
+    GThread* thread;
+    GMutex lock;
+    GCond cond;
+    gint64 last_write; /* monotonic time of the last change */
+    bool pending; /* the file changed since the last reload */
+    bool stop;
+};
+
+static void
+reload_file_changed(const char* UNUSED(path), epdf_file_event_t event, void* data)
+{
+    epdf_reload_t* reload = data;
+
+    if (event == EPDF_FILE_EVENT_DELETED) {
+        return;
+    }
+
+    g_mutex_lock(&reload->lock);
+    reload->last_write = g_get_monotonic_time();
+    reload->pending    = true;
+    g_cond_signal(&reload->cond);
+    g_mutex_unlock(&reload->lock);
+}
+
+epdf_document_t*
+epdf_reload_open_revision(epdf_t* epdf, epdf_document_t* current)
+{
+    if (epdf == NULL || current == NULL) {
+        return NULL;
+    }
+
+    epdf_document_t* document = epdf_document_open(epdf, epdf_document_get_path(current),
+        epdf_document_get_uri(current), epdf_document_get_password(current),
+        &current->open_options, NULL);
+    if (document == NULL) {
+        return NULL;
+    }
+
+    /* the registry hands out a new view of the current revision if the file
+     * did not change; a revision that could not be shared is compared by hash */
+    if (epdf_document_get_source(document) == epdf_document_get_source(current) ||
+        memcmp(epdf_document_get_hash(document), epdf_document_get_hash(current),
+               sizeof(current->hash_sha256)) == 0) {
+        epdf_document_free(document);
+        return NULL;
+    }
+
+    return document;
+}
+
+/* Opens the new revision and swaps it in */
+static void
+reload_run(epdf_reload_t* reload)
+{
+    EPDF_TRACE_SPAN("document_reload");
+
+    g_mutex_lock(&reload->lock);
+    epdf_document_t* current = epdf_document_ref(reload->document);
+    g_mutex_unlock(&reload->lock);
+
+    /* unchanged, or not parseable yet: retried with the next write */
+    epdf_document_t* document = epdf_reload_open_revision(reload->epdf, current);
+    if (document == NULL) {
+        epdf_document_free(current);
+        return;
+    }
+
+    epdf_document_copy_view(document, current);
+    epdf_render_cache_migrate(current, document);
+
+    g_mutex_lock(&reload->lock);
+    epdf_document_t* previous = reload->document;
+    reload->document          = document;
+    g_mutex_unlock(&reload->lock);
+
+    reload->callback(previous, document, reload->data);
+
+    epdf_document_free(previous);
+    epdf_document_free(current);
+}
+
+static gpointer
+reload_thread(gpointer data)
+{
+    epdf_reload_t* reload = data;
+
+    g_mutex_lock(&reload->lock);
+    for (;;) {
+        while (reload->pending == false && reload->stop == false) {
+            g_cond_wait(&reload->cond, &reload->lock);
+        }
+
+        /* wait until the writer has been quiet for the debounce period */
+        while (reload->stop == false) {
+            const gint64 deadline = reload->last_write + (gint64) reload->debounce * G_TIME_SPAN_MILLISECOND;
+            if (g_get_monotonic_time() >= deadline) {
+                break;
+            }
+            g_cond_wait_until(&reload->cond, &reload->lock, deadline);
+        }
+
+        if (reload->stop == true) {
+            break;
+        }
+
+        reload->pending = false;
+        g_mutex_unlock(&reload->lock);
+
+        reload_run(reload);
+
+        g_mutex_lock(&reload->lock);
+    }
+    g_mutex_unlock(&reload->lock);
+
+    return NULL;
+}
+
+epdf_reload_t*
+epdf_reload_new(epdf_t* epdf, epdf_document_t* document, unsigned int debounce,
+                epdf_reload_callback_t callback, void* data)
+{
+    if (epdf == NULL || document == NULL || callback == NULL) {
+        return NULL;
+    }
+
+    /* a file rewritten in place under a mapping faults on the next read */
+    if (document->open_options.mmap == true && document->open_options.progressive == false) {
+        return NULL;
+    }
+
+    epdf_reload_t* reload = g_try_malloc0(sizeof(epdf_reload_t));
+    if (reload == NULL) {
+        return NULL;
+    }
+
+    g_mutex_init(&reload->lock);
+    g_cond_init(&reload->cond);
+    reload->epdf     = epdf;
+    reload->document = epdf_document_ref(document);
+    reload->debounce = debounce != 0 ? debounce : EPDF_RELOAD_DEFAULT_DEBOUNCE;
+    reload->callback = callback;
+    reload->data     = data;
+
+    reload->thread = g_thread_try_new("epdf-reload", reload_thread, reload, NULL);
+    if (reload->thread == NULL) {
+        goto error_free;
+    }
+
+    reload->watch = epdf_file_watch_new(epdf_document_get_path(document), reload_file_changed, reload);
+    if (reload->watch == NULL) {
+        goto error_free;
+    }
+
+    return reload;
+
+error_free:
+
+    epdf_reload_free(reload);
+
+    return NULL;
+}
+
+epdf_document_t*
+epdf_reload_get_document(epdf_reload_t* reload)
+{
+    if (reload == NULL) {
+        return NULL;
+    }
+
+    g_mutex_lock(&reload->lock);
+    epdf_document_t* document = epdf_document_ref(reload->document);
+    g_mutex_unlock(&reload->lock);
+
+    return document;
+}
+
+void
+epdf_reload_free(epdf_reload_t* reload)
+{
+    if (reload == NULL) {
+        return;
+    }
+
+    /* no more events, then let the thread finish a running reload */
+    epdf_file_watch_free(reload->watch);
+
+    if (reload->thread != NULL) {
+        g_mutex_lock(&reload->lock);
+        reload->stop = true;
+        g_cond_signal(&reload->cond);
+        g_mutex_unlock(&reload->lock);
+        g_thread_join(reload->thread);
+    }
+
+    epdf_document_free(reload->document);
+    g_cond_clear(&reload->cond);
+    g_mutex_clear(&reload->lock);
+    g_free(reload);
+}
@@ -0,0 +1,72 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Delay after the last write before a changed file is reloaded, in
+ * milliseconds
+ */
+#define EPDF_RELOAD_DEFAULT_DEBOUNCE 300
+
+typedef struct epdf_reload_s epdf_reload_t;
+
+/**
+ * Callback invoked from the reload thread once a new revision has been loaded
+ *
+ * @param previous The document that has been replaced. It stays valid as long
+ *   as the caller holds references to it.
+ * @param document The new revision, with the view of previous. Take a
+ *   reference (epdf_document_ref) to keep it beyond the callback.
+ * @param data Custom data
+ */
+typedef void (*epdf_reload_callback_t)(epdf_document_t* previous, epdf_document_t* document, void* data);
+
+/**
+ * Reloads a document whenever its file changes. Writes are debounced until
+ * the file has been quiet for debounce milliseconds; a revision with the same
+ * hash is ignored. The new revision is opened in the background while the
+ * previous one keeps serving renders. It takes over the view (page, zoom,
+ * position, ...) and the cached renderings of all pages whose content did
+ * not change.
+ *
+ * @param epdf The epdf instance
+ * @param document The document to watch, the reload keeps a reference
+ * @param debounce Quiet period in milliseconds, 0 for
+ *   EPDF_RELOAD_DEFAULT_DEBOUNCE
+ * @param callback Invoked with every new revision
+ * @param data Custom data passed to callback
+ * @return The reload or NULL if the file can not be watched or the document
+ *   has been opened with the mmap option
+ */
+EPDF_PLUGIN_API epdf_reload_t* epdf_reload_new(epdf_t* epdf, epdf_document_t* document,
+    unsigned int debounce, epdf_reload_callback_t callback, void* data);
+
+/**
+ * Opens the file of a document again, as the reload does once it changed
+ *
+ * @param epdf The epdf instance
+ * @param current The current revision
+ * @return The new revision, or NULL if the file has the hash of current or
+ *   can not be opened
+ */
+EPDF_PLUGIN_API epdf_document_t* epdf_reload_open_revision(epdf_t* epdf, epdf_document_t* current);
+
+/**
+ * Returns the most recent revision
+ *
+ * @param reload The reload
+ * @return A new reference to the document, release it with epdf_document_free
+ */
+EPDF_PLUGIN_API epdf_document_t* epdf_reload_get_document(epdf_reload_t* reload);
+
+/**
+ * Stops watching and frees the reload. Waits for a running reload to finish;
+ * must not be called from the callback.
+ *
+ * @param reload The reload
+ */
+EPDF_PLUGIN_API void epdf_reload_free(epdf_reload_t* reload);
+
+#endif // RELOAD_H
@@ -0,0 +1,989 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "document.h"
+#include "metrics.h"
+#include "page.h"
+#include "recolor.h"
+#include "render.h"
+
+#define RENDER_CACHE_DEFAULT_SIZE (256 * 1024 * 1024)
+
+/* Scale buckets per doubling of the scale, previews are taken from at most
+ * one octave away */
+#define RENDER_CACHE_BUCKETS_PER_OCTAVE 8
+
+/* Time a page may take on a regular worker before it is moved to the worker
+ * for slow pages */
+#define RENDER_DEFAULT_BUDGET_MS 250
+
+/* Low quality first passes of slow pages are rendered at this fraction of the
+ * requested scale */
+#define RENDER_LOW_QUALITY_FACTOR 0.25
+
+typedef struct render_cache_entry_s
+{
+    epdf_document_t* document;
+    unsigned int page;
+    double scale;
+    int bucket; /* quantized scale */
+    unsigned int rotation;
+    epdf_recolor_t recolor;
+    epdf_image_buffer_t* image;
+    GList* link; /* position in the LRU queue */
+} render_cache_entry_t;
+
+/* Consumer of a duplicate request merged into a job */
+typedef struct render_waiter_s
+{
+    epdf_page_t* page;
+    epdf_render_callback_t callback;
+    void* data;
+} render_waiter_t;
+
+typedef struct render_job_s
+{
+    epdf_render_request_t request;
+    epdf_recolor_t recolor; /* settings of the document at submit time */
+    render_cache_entry_t key; /* cache key, if the job has no render function */
+    double target_scale; /* normalized scale the consumer asked for */
+    unsigned int generation; /* view generation of the document at submit time */
+    fz_cookie cookie; /* aborts the rendering once obsolete or over budget */
+    gint64 started; /* monotonic time the rendering started */
+    bool budgeted; /* aborted once it runs longer than the budget */
+    bool over_budget; /* aborted for taking too long, not for being obsolete */
+    bool low_quality; /* first pass of a slow page, upscaled to target_scale */
+    GSList* waiters; /* merged duplicate requests */
+} render_job_t;
+
+/* Rendered and recolored pages, least recently used entries are evicted once
+ * the images exceed the byte budget */
+static struct
+{
+    GMutex lock;
+    GHashTable* entries;
+    GHashTable* buckets; /* most recent entry per scale bucket */
+    GQueue lru; /* most recently used first */
+    uint64_t size;
+    uint64_t max_size;
+} cache = { .max_size = RENDER_CACHE_DEFAULT_SIZE };
+
+/* Process-wide render scheduler */
+static struct
+{
+    GMutex lock;
+    GCond cond;
+    GQueue queues[EPDF_RENDER_LANE_NUMBER];
+    GQueue active; /* jobs being rendered */
+    GQueue slow; /* pages known to be slow, served by a dedicated worker */
+    GCond monitor; /* wakes the budget monitor */
+    unsigned int running[EPDF_RENDER_LANE_NUMBER];
+    unsigned int workers;
+    unsigned int budget; /* milliseconds, 0 for no budget */
+} scheduler = { .budget = RENDER_DEFAULT_BUDGET_MS };
+
+static guint
+cache_entry_hash(gconstpointer data)
+{
+    const render_cache_entry_t* entry = data;
+
+    return g_direct_hash(entry->document) ^ (entry->page * 31 + entry->rotation) ^
+        g_double_hash(&entry->scale) ^ entry->recolor.mode;
+}
+
+static gboolean
+cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const render_cache_entry_t* x = a;
+    const render_cache_entry_t* y = b;
+
+    return x->document == y->document && x->page == y->page && x->rotation == y->rotation &&
+        x->scale == y->scale && epdf_recolor_equal(&x->recolor, &y->recolor) == true;
+}
+
+static guint
+cache_bucket_hash(gconstpointer data)
+{
+    const render_cache_entry_t* entry = data;
+
+    return g_direct_hash(entry->document) ^ (entry->page * 31 + entry->rotation) ^
+        (entry->bucket * 7919) ^ entry->recolor.mode;
+}
+
+static gboolean
+cache_bucket_equal(gconstpointer a, gconstpointer b)
+{
+    const render_cache_entry_t* x = a;
+    const render_cache_entry_t* y = b;
+
+    return x->document == y->document && x->page == y->page && x->rotation == y->rotation &&
+        x->bucket == y->bucket && epdf_recolor_equal(&x->recolor, &y->recolor) == true;
+}
+
+static uint64_t
+cache_entry_size(const render_cache_entry_t* entry)
+{
+    return (uint64_t) entry->image->rowstride * entry->image->height;
+}
+
+/* Called with the cache lock held */
+static void
+cache_entry_remove(render_cache_entry_t* entry)
+{
+    g_hash_table_remove(cache.entries, entry);
+    if (g_hash_table_lookup(cache.buckets, entry) == entry) {
+        g_hash_table_remove(cache.buckets, entry);
+    }
+    g_queue_delete_link(&cache.lru, entry->link);
+    cache.size -= cache_entry_size(entry);
+    epdf_metrics_gauge_set(EPDF_GAUGE_PIXMAP_BYTES, cache.size);
+
+    epdf_image_buffer_free(entry->image);
+    g_free(entry);
+}
+
+/* Called with the cache lock held */
+static void
+cache_evict(void)
+{
+    while (cache.size > cache.max_size && g_queue_is_empty(&cache.lru) == FALSE) {
+        cache_entry_remove(g_queue_peek_tail(&cache.lru));
+    }
+}
+
+/* Scales computed along different paths (zoom x factor) differ in the last
+ * bits; snap them to a fine grid so equal device scales share entries. The
+ * difference is far below one pixel. */
+static double
+render_scale_normalize(double scale)
+{
+    return round(scale * 1024.0) / 1024.0;
+}
+
+static void
+cache_key_init(render_cache_entry_t* key, epdf_page_t* page, double scale,
+               unsigned int rotation, const epdf_recolor_t* recolor)
+{
+    /* the views of all openers share the renderings */
+    key->document = epdf_document_get_source(epdf_page_get_document(page));
+    key->page     = epdf_page_get_index(page);
+    key->scale    = render_scale_normalize(scale);
+    key->bucket   = (int) floor(log2(key->scale) * RENDER_CACHE_BUCKETS_PER_OCTAVE + 0.5);
+    key->rotation = rotation;
+    key->recolor  = *recolor;
+}
+
+static epdf_image_buffer_t*
+cache_lookup(const render_cache_entry_t* key)
+{
+    epdf_image_buffer_t* image = NULL;
+
+    g_mutex_lock(&cache.lock);
+
+    render_cache_entry_t* entry = cache.entries != NULL ? g_hash_table_lookup(cache.entries, key) : NULL;
+    if (entry != NULL) {
+        g_queue_unlink(&cache.lru, entry->link);
+        g_queue_push_head_link(&cache.lru, entry->link);
+        image = epdf_image_buffer_ref(entry->image);
+    }
+
+    g_mutex_unlock(&cache.lock);
+
+    return image;
+}
+
+/* Returns a copy of the cached rendering closest in scale to key, scaled to
+ * the size of key; larger renderings are preferred at equal distance since
+ * they scale down more nicely */
+static epdf_image_buffer_t*
+cache_lookup_nearest(const render_cache_entry_t* key)
+{
+    epdf_image_buffer_t* image = NULL;
+    double scale = 0.0;
+
+    g_mutex_lock(&cache.lock);
+
+    if (cache.buckets != NULL) {
+        render_cache_entry_t probe = *key;
+        for (int distance = 0; distance <= RENDER_CACHE_BUCKETS_PER_OCTAVE && image == NULL; distance++) {
+            for (int sign = 1; sign >= -1 && image == NULL; sign -= 2) {
+                probe.bucket = key->bucket + sign * distance;
+                render_cache_entry_t* entry = g_hash_table_lookup(cache.buckets, &probe);
+                if (entry != NULL) {
+                    image = epdf_image_buffer_ref(entry->image);
+                    scale = entry->scale;
+                }
+            }
+        }
+    }
+
+    g_mutex_unlock(&cache.lock);
+
+    if (image == NULL) {
+        return NULL;
+    }
+
+    const double ratio = key->scale / scale;
+    epdf_image_buffer_t* scaled = epdf_image_buffer_scale(image,
+        MAX(1, (unsigned int) round(image->width * ratio)),
+        MAX(1, (unsigned int) round(image->height * ratio)));
+    epdf_image_buffer_free(image);
+
+    return scaled;
+}
+
+static void
+cache_insert(const render_cache_entry_t* key, epdf_image_buffer_t* image)
+{
+    render_cache_entry_t* entry = g_try_malloc(sizeof(render_cache_entry_t));
+    if (entry == NULL) {
+        return;
+    }
+
+    *entry       = *key;
+    entry->image = epdf_image_buffer_ref(image);
+
+    g_mutex_lock(&cache.lock);
+
+    if (cache.entries == NULL) {
+        cache.entries = g_hash_table_new(cache_entry_hash, cache_entry_equal);
+        cache.buckets = g_hash_table_new(cache_bucket_hash, cache_bucket_equal);
+    }
+
+    render_cache_entry_t* old = g_hash_table_lookup(cache.entries, entry);
+    if (old != NULL) {
+        cache_entry_remove(old);
+    }
+
+    g_hash_table_add(cache.entries, entry);
+    g_hash_table_replace(cache.buckets, entry, entry);
+    g_queue_push_head(&cache.lru, entry);
+    entry->link = g_queue_peek_head_link(&cache.lru);
+    cache.size += cache_entry_size(entry);
+    epdf_metrics_gauge_set(EPDF_GAUGE_PIXMAP_BYTES, cache.size);
+    cache_evict();
+
+    g_mutex_unlock(&cache.lock);
+}
+
+void
+epdf_render_cache_purge(epdf_document_t* document)
+{
+    g_mutex_lock(&cache.lock);
+
+    GList* link = cache.lru.head;
+    while (link != NULL) {
+        GList* next = link->next;
+        render_cache_entry_t* entry = link->data;
+        if (document == NULL || entry->document == document) {
+            cache_entry_remove(entry);
+        }
+        link = next;
+    }
+
+    g_mutex_unlock(&cache.lock);
+}
+
+static gint
+page_index_compare(gconstpointer a, gconstpointer b)
+{
+    const unsigned int x = *(const unsigned int*) a;
+    const unsigned int y = *(const unsigned int*) b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+GArray*
+epdf_render_cache_get_pages(epdf_document_t* document)
+{
+    GArray* pages = g_array_new(FALSE, FALSE, sizeof(unsigned int));
+    document      = epdf_document_get_source(document);
+
+    g_mutex_lock(&cache.lock);
+    for (GList* link = cache.lru.head; link != NULL; link = link->next) {
+        render_cache_entry_t* entry = link->data;
+        if (entry->document == document) {
+            g_array_append_val(pages, entry->page);
+        }
+    }
+    g_mutex_unlock(&cache.lock);
+
+    /* one entry per page */
+    g_array_sort(pages, page_index_compare);
+    unsigned int length = 0;
+    for (unsigned int i = 0; i < pages->len; i++) {
+        const unsigned int page = g_array_index(pages, unsigned int, i);
+        if (length == 0 || g_array_index(pages, unsigned int, length - 1) != page) {
+            g_array_index(pages, unsigned int, length++) = page;
+        }
+    }
+    g_array_set_size(pages, length);
+
+    return pages;
+}
+
+void
+epdf_render_cache_migrate(epdf_document_t* from, epdf_document_t* to)
+{
+    if (from == NULL || to == NULL || epdf_document_get_source(from) == epdf_document_get_source(to)) {
+        return;
+    }
+
+    epdf_document_t* from_source = epdf_document_get_source(from);
+    epdf_document_t* to_source   = epdf_document_get_source(to);
+
+    g_mutex_lock(&cache.lock);
+
+    /* copies share the images; the entries of from are purged with it */
+    GList* link = cache.lru.tail;
+    while (link != NULL) {
+        GList* prev = link->prev;
+        render_cache_entry_t* entry = link->data;
+        epdf_page_t* page = entry->document == from_source ? epdf_document_get_page(to, entry->page) : NULL;
+        if (page != NULL && epdf_page_get_changed(page) == false) {
+            render_cache_entry_t* copy = g_try_malloc(sizeof(render_cache_entry_t));
+            if (copy != NULL) {
+                *copy          = *entry;
+                copy->document = to_source;
+                copy->image    = epdf_image_buffer_ref(entry->image);
+                if (g_hash_table_contains(cache.entries, copy) == FALSE) {
+                    g_hash_table_add(cache.entries, copy);
+                    g_hash_table_replace(cache.buckets, copy, copy);
+                    g_queue_push_head(&cache.lru, copy);
+                    copy->link  = g_queue_peek_head_link(&cache.lru);
+                    cache.size += cache_entry_size(copy);
+                } else {
+                    epdf_image_buffer_free(copy->image);
+                    g_free(copy);
+                }
+            }
+        }
+        link = prev;
+    }
+    epdf_metrics_gauge_set(EPDF_GAUGE_PIXMAP_BYTES, cache.size);
+    cache_evict();
+
+    g_mutex_unlock(&cache.lock);
+}
+
+void
+epdf_render_cache_invalidate(epdf_page_t* page, epdf_rectangle_t region)
+{
+    if (page == NULL) {
+        return;
+    }
+
+    epdf_document_t* document = epdf_document_get_source(epdf_page_get_document(page));
+    const unsigned int index  = epdf_page_get_index(page);
+
+    /* snapshot the renderings of the page, they are patched without the lock */
+    GPtrArray* entries = g_ptr_array_new_with_free_func(g_free);
+
+    g_mutex_lock(&cache.lock);
+    for (GList* link = cache.lru.head; link != NULL; link = link->next) {
+        render_cache_entry_t* entry = link->data;
+        if (entry->document == document && entry->page == index) {
+            render_cache_entry_t* copy = g_try_malloc(sizeof(render_cache_entry_t));
+            if (copy != NULL) {
+                *copy       = *entry;
+                copy->image = epdf_image_buffer_ref(entry->image);
+                g_ptr_array_add(entries, copy);
+            }
+        }
+    }
+    g_mutex_unlock(&cache.lock);
+
+    for (unsigned int i = 0; i < entries->len; i++) {
+        render_cache_entry_t* snapshot = g_ptr_array_index(entries, i);
+
+        epdf_image_buffer_t* image = epdf_image_buffer_copy(snapshot->image);
+        epdf_rectangle_t pixels    = { 0, 0, 0, 0 };
+        if (image != NULL &&
+            epdf_page_render_region(page, snapshot->scale, snapshot->rotation, region, image, &pixels) != EPDF_ERROR_OK) {
+            epdf_image_buffer_free(image);
+            image = NULL;
+        }
+
+        /* recolor only what has been drawn again, through a view of the region */
+        if (image != NULL && pixels.x2 > pixels.x1 && pixels.y2 > pixels.y1) {
+            epdf_image_buffer_t view = {
+                .data      = image->data + (size_t) pixels.y1 * image->rowstride + (size_t) pixels.x1 * 3,
+                .width     = pixels.x2 - pixels.x1,
+                .height    = pixels.y2 - pixels.y1,
+                .rowstride = image->rowstride,
+            };
+            epdf_recolor_apply(&snapshot->recolor, &view);
+        }
+
+        /* the entry may have been replaced or evicted in the meantime */
+        g_mutex_lock(&cache.lock);
+        render_cache_entry_t* entry = g_hash_table_lookup(cache.entries, snapshot);
+        if (entry != NULL && entry->image == snapshot->image) {
+            if (image != NULL) {
+                /* same size, the budget is unchanged */
+                epdf_image_buffer_free(entry->image);
+                entry->image = epdf_image_buffer_ref(image);
+            } else {
+                cache_entry_remove(entry);
+            }
+        }
+        g_mutex_unlock(&cache.lock);
+
+        epdf_image_buffer_free(snapshot->image);
+        epdf_image_buffer_free(image);
+    }
+
+    g_ptr_array_unref(entries);
+}
+
+void
+epdf_render_cache_set_size(uint64_t size)
+{
+    g_mutex_lock(&cache.lock);
+    cache.max_size = size;
+    cache_evict();
+    g_mutex_unlock(&cache.lock);
+}
+
+/* A viewport job is obsolete once the view changed since it was submitted and
+ * the page is either no longer visible or shown at another scale, rotation or
+ * recoloring */
+static bool
+render_job_is_obsolete(render_job_t* job)
+{
+    if (job->request.lane != EPDF_RENDER_LANE_VIEWPORT || job->request.render != NULL) {
+        return false;
+    }
+
+    epdf_document_t* document = epdf_page_get_document(job->request.page);
+    if (job->generation == epdf_document_get_generation(document)) {
+        return false;
+    }
+
+    return epdf_page_get_visibility(job->request.page) == false ||
+        job->target_scale != render_scale_normalize(epdf_document_get_device_scale(document)) ||
+        job->request.rotation != epdf_document_get_rotation(document) ||
+        epdf_recolor_equal(&job->recolor, epdf_document_get_recolor(document)) == false;
+}
+
+/* Hands the result to the consumer and all merged ones, then frees the job */
+static void
+render_job_finish(render_job_t* job, epdf_image_buffer_t* image, epdf_error_t error)
+{
+    if (job->low_quality == true && image != NULL) {
+        const double ratio = job->target_scale / job->key.scale;
+        epdf_image_buffer_t* scaled = epdf_image_buffer_scale(image,
+            MAX(1, (unsigned int) round(image->width * ratio)),
+            MAX(1, (unsigned int) round(image->height * ratio)));
+        epdf_image_buffer_free(image);
+        image = scaled;
+        error = image != NULL ? EPDF_ERROR_OK : EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    for (GSList* waiter = job->waiters; waiter != NULL; waiter = waiter->next) {
+        const render_waiter_t* w = waiter->data;
+        w->callback(job->request.page, epdf_image_buffer_ref(image), error, w->data);
+    }
+    job->request.callback(job->request.page, image, error, job->request.data);
+
+    epdf_document_free(epdf_page_get_document(job->request.page));
+    g_slist_free_full(job->waiters, g_free);
+    g_free(job);
+}
+
+static void
+render_jobs_cancel(GQueue* jobs)
+{
+    render_job_t* job = NULL;
+    while ((job = g_queue_pop_head(jobs)) != NULL) {
+        epdf_metrics_count(EPDF_COUNTER_RENDERS_CANCELED, 1);
+        render_job_finish(job, NULL, EPDF_ERROR_CANCELED);
+    }
+}
+
+/* Tells consumers taken out of jobs that their request has been dropped */
+static void
+render_waiters_cancel(GSList* waiters)
+{
+    for (GSList* waiter = waiters; waiter != NULL; waiter = waiter->next) {
+        const render_waiter_t* w = waiter->data;
+        w->callback(w->page, NULL, EPDF_ERROR_CANCELED, w->data);
+    }
+    g_slist_free_full(waiters, g_free);
+}
+
+/* Publishes the queue depths. Called with the lock held. */
+static void
+scheduler_publish_depths(void)
+{
+    epdf_metrics_gauge_set(EPDF_GAUGE_QUEUE_VIEWPORT,
+                           g_queue_get_length(&scheduler.queues[EPDF_RENDER_LANE_VIEWPORT]));
+    epdf_metrics_gauge_set(EPDF_GAUGE_QUEUE_THUMBNAIL,
+                           g_queue_get_length(&scheduler.queues[EPDF_RENDER_LANE_THUMBNAIL]));
+    epdf_metrics_gauge_set(EPDF_GAUGE_QUEUE_SLOW, g_queue_get_length(&scheduler.slow));
+    epdf_metrics_gauge_set(EPDF_GAUGE_RENDERING, g_queue_get_length(&scheduler.active));
+}
+
+/* Viewport jobs first; thumbnail jobs only if no viewport job is waiting and
+ * at most half of the workers are busy with them. The worker for slow pages
+ * only serves those. Obsolete viewport jobs are moved to dropped. Called with
+ * the lock held. */
+static render_job_t*
+scheduler_next_job(bool slow, GQueue* dropped)
+{
+    render_job_t* job = NULL;
+    if (slow == true) {
+        while ((job = g_queue_pop_head(&scheduler.slow)) != NULL) {
+            if (render_job_is_obsolete(job) == false) {
+                return job;
+            }
+            g_queue_push_tail(dropped, job);
+        }
+        return NULL;
+    }
+
+    while ((job = g_queue_pop_head(&scheduler.queues[EPDF_RENDER_LANE_VIEWPORT])) != NULL) {
+        if (render_job_is_obsolete(job) == false) {
+            return job;
+        }
+        g_queue_push_tail(dropped, job);
+    }
+
+    const unsigned int max_thumbnails = MAX(1, scheduler.workers / 2);
+    if (scheduler.running[EPDF_RENDER_LANE_THUMBNAIL] < max_thumbnails) {
+        return g_queue_pop_head(&scheduler.queues[EPDF_RENDER_LANE_THUMBNAIL]);
+    }
+
+    return NULL;
+}
+
+/* A queued request for the same page and consumer is superseded by a newer
+ * one, e.g. during a zoom gesture only the last step is rendered. Only that
+ * consumer is dropped: its waiters are moved to canceled, and a job it shares
+ * with merged consumers is handed over to the first of them instead of being
+ * moved to superseded. Called with the lock held. */
+static void
+scheduler_take_superseded(const epdf_render_request_t* request, GQueue* superseded, GSList** canceled)
+{
+    GQueue* queues[] = {
+        &scheduler.queues[EPDF_RENDER_LANE_VIEWPORT],
+        &scheduler.queues[EPDF_RENDER_LANE_THUMBNAIL],
+        &scheduler.slow
+    };
+
+    for (unsigned int i = 0; i < G_N_ELEMENTS(queues); i++) {
+        GList* link = queues[i]->head;
+        while (link != NULL) {
+            GList* next = link->next;
+            render_job_t* job = link->data;
+            if (job->request.render != NULL || job->request.page != request->page) {
+                link = next;
+                continue;
+            }
+
+            GSList* waiter = job->waiters;
+            while (waiter != NULL) {
+                GSList* next_waiter = waiter->next;
+                const render_waiter_t* w = waiter->data;
+                if (w->callback == request->callback && w->data == request->data) {
+                    job->waiters = g_slist_remove_link(job->waiters, waiter);
+                    *canceled    = g_slist_concat(waiter, *canceled);
+                }
+                waiter = next_waiter;
+            }
+
+            if (job->request.callback == request->callback && job->request.data == request->data) {
+                if (job->waiters == NULL) {
+                    g_queue_unlink(queues[i], link);
+                    g_queue_push_tail_link(superseded, link);
+                } else {
+                    render_waiter_t* dropped = g_malloc(sizeof(render_waiter_t));
+                    dropped->page     = job->request.page;
+                    dropped->callback = job->request.callback;
+                    dropped->data     = job->request.data;
+                    *canceled         = g_slist_prepend(*canceled, dropped);
+
+                    render_waiter_t* first = job->waiters->data;
+                    job->request.callback  = first->callback;
+                    job->request.data      = first->data;
+                    job->request.preview   = NULL;
+                    job->waiters           = g_slist_delete_link(job->waiters, job->waiters);
+                    g_free(first);
+                }
+            }
+            link = next;
+        }
+    }
+}
+
+/* Drops queued and aborts running jobs of the document that became obsolete.
+ * Called with the lock held. */
+static void
+scheduler_take_obsolete(epdf_document_t* document, GQueue* dropped)
+{
+    GQueue* queues[] = { &scheduler.queues[EPDF_RENDER_LANE_VIEWPORT], &scheduler.slow };
+
+    for (unsigned int i = 0; i < G_N_ELEMENTS(queues); i++) {
+        GList* link = queues[i]->head;
+        while (link != NULL) {
+            GList* next = link->next;
+            render_job_t* job = link->data;
+            if (epdf_page_get_document(job->request.page) == document && render_job_is_obsolete(job) == true) {
+                g_queue_unlink(queues[i], link);
+                g_queue_push_tail_link(dropped, link);
+            }
+            link = next;
+        }
+    }
+
+    for (GList* link = scheduler.active.head; link != NULL; link = link->next) {
+        render_job_t* job = link->data;
+        if (epdf_page_get_document(job->request.page) == document && render_job_is_obsolete(job) == true) {
+            job->cookie.abort = 1;
+        }
+    }
+}
+
+/* Returns a queued job of the same lane or a running job producing the same
+ * image for the same view. Views of a document share cache keys, but a job
+ * delivers its own page and is kept or dropped by its own view's generation
+ * and visibility; another view's request finds the image in the cache once
+ * the job is done. Called with the lock held. */
+static render_job_t*
+scheduler_find_duplicate(const render_job_t* job)
+{
+    GQueue* queues[] = { &scheduler.active, &scheduler.queues[job->request.lane], &scheduler.slow };
+    const epdf_document_t* document = epdf_page_get_document(job->request.page);
+
+    for (unsigned int i = 0; i < G_N_ELEMENTS(queues); i++) {
+        for (GList* link = queues[i]->head; link != NULL; link = link->next) {
+            render_job_t* other = link->data;
+            if (other->request.render == NULL && other->cookie.abort == 0 && other->low_quality == false &&
+                epdf_page_get_document(other->request.page) == document &&
+                cache_entry_equal(&other->key, &job->key) == TRUE) {
+                return other;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Predicts from the page's history whether the job exceeds the budget.
+ * Rasterization grows with the pixel count, interpretation does not shrink
+ * with it. */
+static bool
+render_job_is_slow(render_job_t* job)
+{
+    epdf_render_cost_t cost;
+    if (scheduler.budget == 0 || job->request.render != NULL ||
+        epdf_document_get_render_cost(epdf_page_get_document(job->request.page),
+                                      epdf_page_get_index(job->request.page), &cost) == false) {
+        return false;
+    }
+
+    const double ratio = job->key.scale / cost.scale;
+
+    return cost.milliseconds * MAX(1.0, ratio * ratio) > scheduler.budget;
+}
+
+/* Creates the low quality first pass of a slow job, delivered to the preview
+ * callback of its request */
+static render_job_t*
+render_job_new_low_quality(const render_job_t* job)
+{
+    render_job_t* first = g_try_malloc0(sizeof(render_job_t));
+    if (first == NULL) {
+        return NULL;
+    }
+
+    first->request          = job->request;
+    first->request.callback = job->request.preview;
+    first->request.preview  = NULL;
+    first->recolor          = job->recolor;
+    first->target_scale     = job->target_scale;
+    first->generation       = job->generation;
+    first->low_quality      = true;
+    cache_key_init(&first->key, job->request.page, job->target_scale * RENDER_LOW_QUALITY_FACTOR,
+                   job->request.rotation, &job->recolor);
+
+    epdf_document_ref(epdf_page_get_document(job->request.page));
+
+    return first;
+}
+
+/* Moves a job to the worker for slow pages, preceded by a low quality pass if
+ * the consumer takes previews. Called with the lock held. */
+static void
+scheduler_push_slow(render_job_t* job)
+{
+    if (job->request.preview != NULL) {
+        render_job_t* first = render_job_new_low_quality(job);
+        if (first != NULL) {
+            g_queue_push_tail(&scheduler.slow, first);
+        }
+    }
+
+    g_queue_push_tail(&scheduler.slow, job);
+    g_cond_broadcast(&scheduler.cond);
+}
+
+/* Aborts budgeted jobs that run longer than the budget */
+static gpointer
+scheduler_monitor(gpointer UNUSED(data))
+{
+    g_mutex_lock(&scheduler.lock);
+
+    for (;;) {
+        const gint64 now = g_get_monotonic_time();
+        gint64 next      = G_MAXINT64;
+
+        for (GList* link = scheduler.active.head; link != NULL; link = link->next) {
+            render_job_t* job = link->data;
+            if (job->budgeted == false || job->cookie.abort != 0) {
+                continue;
+            }
+
+            const gint64 deadline = job->started + (gint64) scheduler.budget * 1000;
+            if (now >= deadline) {
+                job->over_budget  = true;
+                job->cookie.abort = 1;
+            } else {
+                next = MIN(next, deadline);
+            }
+        }
+
+        if (next == G_MAXINT64) {
+            g_cond_wait(&scheduler.monitor, &scheduler.lock);
+        } else {
+            g_cond_wait_until(&scheduler.monitor, &scheduler.lock, next);
+        }
+    }
+
+    return NULL;
+}
+
+static gpointer
+scheduler_worker(gpointer data)
+{
+    const bool slow = data != NULL;
+
+    for (;;) {
+        GQueue dropped = G_QUEUE_INIT;
+
+        g_mutex_lock(&scheduler.lock);
+        render_job_t* job = NULL;
+        while ((job = scheduler_next_job(slow, &dropped)) == NULL && g_queue_is_empty(&dropped) == TRUE) {
+            g_cond_wait(&scheduler.cond, &scheduler.lock);
+        }
+        if (job != NULL) {
+            scheduler.running[job->request.lane]++;
+            g_queue_push_tail(&scheduler.active, job);
+            job->started  = g_get_monotonic_time();
+            job->budgeted = slow == false && scheduler.budget != 0 && job->request.render == NULL;
+            if (job->budgeted == true) {
+                g_cond_signal(&scheduler.monitor);
+            }
+        }
+        scheduler_publish_depths();
+        g_mutex_unlock(&scheduler.lock);
+
+        render_jobs_cancel(&dropped);
+        if (job == NULL) {
+            continue;
+        }
+
+        epdf_render_request_t* request = &job->request;
+        epdf_error_t error             = EPDF_ERROR_OK;
+        epdf_image_buffer_t* image     = NULL;
+
+        if (request->render != NULL) {
+            image = request->render(request->page, request->scale, request->rotation,
+                                    request->data, &error);
+        } else {
+            /* an identical job may have finished while this one was queued;
+             * the request has been counted as a miss when it was submitted */
+            image = cache_lookup(&job->key);
+            if (image == NULL) {
+                epdf_page_t* source = epdf_page_get_source(request->page);
+                const int revision  = g_atomic_int_get(&source->annotations_revision);
+                image = epdf_page_render_image(request->page, job->key.scale, request->rotation,
+                                               &job->cookie, &error);
+                if (image != NULL) {
+                    epdf_recolor_apply(&job->recolor, image);
+                    /* annotations changed while rendering, the cache must not
+                     * keep a rendering that missed the invalidation */
+                    if (g_atomic_int_get(&source->annotations_revision) == revision) {
+                        cache_insert(&job->key, image);
+                    }
+                }
+
+                /* obsolete jobs say nothing about the page */
+                const double elapsed = (g_get_monotonic_time() - job->started) / 1000.0;
+                if (image != NULL || job->over_budget == true) {
+                    epdf_document_add_render_cost(epdf_page_get_document(request->page),
+                        epdf_page_get_index(request->page), elapsed,
+                        job->cookie.progress, job->key.scale);
+                }
+                if (image != NULL) {
+                    epdf_metrics_count(EPDF_COUNTER_RENDERS, 1);
+                    epdf_metrics_record_render(job->key.scale, elapsed);
+                }
+            }
+        }
+
+        if (image == NULL && error == EPDF_ERROR_OK) {
+            error = EPDF_ERROR_UNKNOWN;
+        }
+
+        /* no more waiters can be merged once the job left the active queue */
+        g_mutex_lock(&scheduler.lock);
+        g_queue_remove(&scheduler.active, job);
+        scheduler.running[request->lane]--;
+        if (request->lane == EPDF_RENDER_LANE_THUMBNAIL) {
+            g_cond_broadcast(&scheduler.cond);
+        }
+
+        /* a page over budget continues on the worker for slow pages */
+        const bool moved = image == NULL && job->over_budget == true;
+        if (moved == true) {
+            memset(&job->cookie, 0, sizeof(job->cookie));
+            job->over_budget = false;
+            job->budgeted    = false;
+            scheduler_push_slow(job);
+        }
+        scheduler_publish_depths();
+        g_mutex_unlock(&scheduler.lock);
+
+        if (moved == false) {
+            if (error == EPDF_ERROR_CANCELED) {
+                epdf_metrics_count(EPDF_COUNTER_RENDERS_CANCELED, 1);
+            }
+            render_job_finish(job, image, error);
+        }
+    }
+
+    return NULL;
+}
+
+static gpointer
+scheduler_start(gpointer UNUSED(data))
+{
+    for (unsigned int lane = 0; lane < EPDF_RENDER_LANE_NUMBER; lane++) {
+        g_queue_init(&scheduler.queues[lane]);
+    }
+    g_queue_init(&scheduler.active);
+    g_queue_init(&scheduler.slow);
+
+    /* leave one core for Emacs */
+    const unsigned int cores = g_get_num_processors();
+    scheduler.workers = cores > 1 ? cores - 1 : 1;
+
+    for (unsigned int i = 0; i < scheduler.workers; i++) {
+        GThread* thread = g_thread_new("epdf-render", scheduler_worker, NULL);
+        g_thread_unref(thread);
+    }
+
+    g_thread_unref(g_thread_new("epdf-render-slow", scheduler_worker, GINT_TO_POINTER(1)));
+    g_thread_unref(g_thread_new("epdf-render-monitor", scheduler_monitor, NULL));
+
+    return NULL;
+}
+
+epdf_error_t
+epdf_render_submit(const epdf_render_request_t* request)
+{
+    if (request == NULL || request->page == NULL || request->callback == NULL ||
+        request->scale <= 0.0 || request->lane >= EPDF_RENDER_LANE_NUMBER) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    epdf_document_t* document = epdf_page_get_document(request->page);
+
+    /* served from the cache without queueing */
+    if (request->render == NULL) {
+        render_cache_entry_t key;
+        cache_key_init(&key, request->page, request->scale, request->rotation,
+                       epdf_document_get_recolor(document));
+
+        epdf_image_buffer_t* image = cache_lookup(&key);
+        if (image != NULL) {
+            epdf_metrics_count(EPDF_COUNTER_RENDER_CACHE_HITS, 1);
+            request->callback(request->page, image, EPDF_ERROR_OK, request->data);
+            return EPDF_ERROR_OK;
+        }
+        epdf_metrics_count(EPDF_COUNTER_RENDER_CACHE_MISSES, 1);
+
+        if (request->preview != NULL) {
+            image = cache_lookup_nearest(&key);
+            if (image != NULL) {
+                epdf_metrics_count(EPDF_COUNTER_PREVIEW_HITS, 1);
+                request->preview(request->page, image, EPDF_ERROR_OK, request->data);
+            }
+        }
+    }
+
+    static GOnce once = G_ONCE_INIT;
+    g_once(&once, scheduler_start, NULL);
+
+    render_job_t* job = g_try_malloc0(sizeof(render_job_t));
+    if (job == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    job->request    = *request;
+    job->recolor    = *epdf_document_get_recolor(document);
+    job->generation = epdf_document_get_generation(document);
+    if (request->render == NULL) {
+        cache_key_init(&job->key, request->page, request->scale, request->rotation, &job->recolor);
+        job->target_scale = job->key.scale;
+    }
+
+    GQueue dropped   = G_QUEUE_INIT;
+    GSList* canceled = NULL;
+
+    g_mutex_lock(&scheduler.lock);
+
+    render_job_t* duplicate = NULL;
+    if (request->render == NULL) {
+        scheduler_take_superseded(request, &dropped, &canceled);
+        scheduler_take_obsolete(document, &dropped);
+        duplicate = scheduler_find_duplicate(job);
+    }
+
+    if (duplicate != NULL) {
+        render_waiter_t* waiter = g_malloc(sizeof(render_waiter_t));
+        waiter->page     = request->page;
+        waiter->callback = request->callback;
+        waiter->data     = request->data;
+        duplicate->waiters    = g_slist_append(duplicate->waiters, waiter);
+        duplicate->generation = MAX(duplicate->generation, job->generation);
+        g_free(job);
+    } else if (render_job_is_slow(job) == true) {
+        epdf_document_ref(document);
+        scheduler_push_slow(job);
+    } else {
+        epdf_document_ref(document);
+        g_queue_push_tail(&scheduler.queues[request->lane], job);
+        g_cond_broadcast(&scheduler.cond);
+    }
+    scheduler_publish_depths();
+
+    g_mutex_unlock(&scheduler.lock);
+
+    render_jobs_cancel(&dropped);
+    render_waiters_cancel(canceled);
+
+    return EPDF_ERROR_OK;
+}
+
+void
+epdf_render_set_budget(unsigned int milliseconds)
+{
+    g_mutex_lock(&scheduler.lock);
+    scheduler.budget = milliseconds;
+    g_cond_signal(&scheduler.monitor);
+    g_mutex_unlock(&scheduler.lock);
+}
@@ -0,0 +1,140 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "image.h"
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Render lanes. Jobs of the viewport lane are always picked first, thumbnail
+ * jobs only run while no viewport job is waiting and never occupy more than
+ * half of the workers.
+ */
+typedef enum epdf_render_lane_e
+{
+    EPDF_RENDER_LANE_VIEWPORT, /**< Pages shown in a window */
+    EPDF_RENDER_LANE_THUMBNAIL, /**< Thumbnails and other background work */
+    EPDF_RENDER_LANE_NUMBER /**< Number of lanes */
+} epdf_render_lane_t;
+
+/**
+ * Function producing the image of a render job
+ *
+ * @param page The page
+ * @param scale The scale (pixels per point)
+ * @param rotation The rotation (0, 90, 180 or 270)
+ * @param data Custom data of the request
+ * @param error Set to an error value (see \ref epdf_error_t) if an
+ *   error occurred
+ * @return The image or NULL if an error occurred
+ */
+typedef epdf_image_buffer_t* (*epdf_render_function_t)(epdf_page_t* page, double scale,
+    unsigned int rotation, void* data, epdf_error_t* error);
+
+/**
+ * Callback invoked from a worker thread when a render job finished
+ *
+ * @param page The page
+ * @param image The rendered image or NULL. The callback owns a reference to
+ *   it; the image may be shared with the render cache and must not be modified.
+ * @param error EPDF_ERROR_OK if the page has been rendered
+ * @param data Custom data of the request
+ */
+typedef void (*epdf_render_callback_t)(epdf_page_t* page, epdf_image_buffer_t* image,
+    epdf_error_t error, void* data);
+
+/**
+ * Render request
+ */
+typedef struct epdf_render_request_s
+{
+    epdf_page_t* page; /**< Page to render */
+    double scale; /**< Scale in device pixels per point, see epdf_document_get_device_scale */
+    unsigned int rotation; /**< Rotation */
+    epdf_render_lane_t lane; /**< Lane of the job */
+    epdf_render_function_t render; /**< Render function or NULL for epdf_page_render_image */
+    epdf_render_callback_t callback; /**< Completion callback */
+    epdf_render_callback_t preview; /**< Invoked right away with the nearest cached rendering
+                                       scaled to the requested size, or NULL */
+    void* data; /**< Custom data passed to render and callback */
+} epdf_render_request_t;
+
+/**
+ * Queues a render job. The document of the page is kept alive until the job
+ * finished. Jobs without a custom render function apply the recolor settings
+ * of the document and go through the render cache; on a cache hit the
+ * callback is invoked right away from the calling thread. Otherwise the preview
+ * callback gets a scaled copy of a rendering at a nearby scale, if any, and
+ * queued requests of the same page with the same callback and data are
+ * dropped (their callback receives EPDF_ERROR_CANCELED), so zoom steps
+ * coalesce. Requests of other consumers merged into the same job are kept.
+ * A request for an image that is already queued or being rendered for a page
+ * of the same document view is merged into that job. Viewport jobs submitted
+ * before the view generation of the document changed (see
+ * epdf_document_get_generation) are dropped or aborted once their page is
+ * hidden or shown at another scale, rotation or recoloring.
+ *
+ * Every page rendering has a time budget (see epdf_render_set_budget) and its
+ * cost is recorded on the document. A rendering exceeding the budget is
+ * aborted and continues on a dedicated worker for slow pages, as do later
+ * requests for pages known to be slow; if the request has a preview callback
+ * it first gets a quick low resolution pass there.
+ *
+ * @param request The render request
+ * @return EPDF_ERROR_OK when the job has been queued, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_render_submit(const epdf_render_request_t* request);
+
+/**
+ * Drops the cached renderings of a document
+ *
+ * @param document The document or NULL to clear the whole cache
+ */
+EPDF_PLUGIN_API void epdf_render_cache_purge(epdf_document_t* document);
+
+/**
+ * Draws a region of the cached renderings of a page again, e.g. after an
+ * annotation changed. Each rendering is replaced by a copy in which only the
+ * region has been rasterized and recolored; renderings that fail are dropped.
+ * Renderings of the page in progress are delivered but not cached.
+ *
+ * @param page The page
+ * @param region The region in page coordinates (points)
+ */
+EPDF_PLUGIN_API void epdf_render_cache_invalidate(epdf_page_t* page, epdf_rectangle_t region);
+
+/**
+ * Returns the pages of a document that have cached renderings
+ *
+ * @param document The document
+ * @return Array of unsigned int with the ascending page indices, free with
+ *   g_array_unref
+ */
+EPDF_PLUGIN_API GArray* epdf_render_cache_get_pages(epdf_document_t* document);
+
+/**
+ * Makes the cached renderings of the pages of from that are unchanged in to
+ * (see epdf_page_get_changed) available for to as well
+ *
+ * @param from The previous revision of the document
+ * @param to The new revision
+ */
+EPDF_PLUGIN_API void epdf_render_cache_migrate(epdf_document_t* from, epdf_document_t* to);
+
+/**
+ * Sets the memory budget of the render cache
+ *
+ * @param size Maximum size of the cached images in bytes
+ */
+EPDF_PLUGIN_API void epdf_render_cache_set_size(uint64_t size);
+
+/**
+ * Sets the time a page may take on a regular render worker
+ *
+ * @param milliseconds The budget, 0 to never move pages to the worker for slow
+ *   pages
+ */
+EPDF_PLUGIN_API void epdf_render_set_budget(unsigned int milliseconds);
+
+#endif // RENDER_H
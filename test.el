@@ -132,3 +132,237 @@
 
         (should (eq (mod-test-vector-fill v-test e) t))
         (should (eq (mod-test-vector-eq v-test e) eq-ref))))))
+
+;;
+;; Tracing tests.
+;;
+
+(ert-deftest epdf-trace-test ()
+  (should-not (epdf-trace-enabled-p))
+  (should (eq (epdf-trace-enable t) t))
+  (should (epdf-trace-enabled-p))
+  (let ((file (make-temp-file "epdf-trace" nil ".json")))
+    (unwind-protect
+        (progn
+          (should (eq (epdf-trace-dump file) t))
+          (with-temp-buffer
+            (insert-file-contents file)
+            (should (string-match-p "\"traceEvents\":\\[" (buffer-string)))))
+      (delete-file file)))
+  (should (eq (epdf-trace-clear) t))
+  (should-error (epdf-trace-dump "/nonexistent/directory/trace.json")
+                :type 'file-error)
+  (should (eq (epdf-trace-enable nil) nil))
+  (should-not (epdf-trace-enabled-p)))
+
+;;
+;; Metrics tests.
+;;
+
+(ert-deftest epdf-metrics-test ()
+  (let ((metrics (epdf-metrics)))
+    (dolist (key '(:pages-loaded :pages-evicted :render-cache-hits
+                   :render-cache-misses :preview-hits :renders
+                   :renders-canceled :pixmap-bytes :display-lists
+                   :text-bytes :queue-viewport :queue-thumbnail
+                   :queue-slow :rendering))
+      (should (natnump (plist-get metrics key))))
+    (let ((latency (plist-get metrics :render-latency)))
+      (should (= (length latency) 4))
+      (dotimes (i 4)
+        (should (= (length (aref latency i)) 12))))))
+
+;;
+;; Document tests.
+;;
+
+(defun epdf-test-pdf (text &rest texts)
+  "Return a PDF with one page showing TEXT, and one more per TEXTS."
+  (let* ((texts (cons text texts))
+         (objects
+          (list "<< /Type /Catalog /Pages 2 0 R >>"
+                (format "<< /Type /Pages /Kids [%s] /Count %d >>"
+                        (mapconcat (lambda (i) (format "%d 0 R" (+ 4 (* 2 i))))
+                                   (number-sequence 0 (1- (length texts))) " ")
+                        (length texts))
+                "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>"))
+         (pdf "%PDF-1.4\n")
+         (offsets nil)
+         (number 0))
+    (dotimes (i (length texts))
+      (let ((stream (format "BT /F1 24 Tf 72 720 Td (%s) Tj ET" (nth i texts))))
+        (setq objects
+              (append objects
+                      (list (format (concat "<< /Type /Page /Parent 2 0 R"
+                                            " /MediaBox [0 0 612 792]"
+                                            " /Resources << /Font << /F1 3 0 R >> >>"
+                                            " /Contents %d 0 R >>")
+                                    (+ 5 (* 2 i)))
+                            (format "<< /Length %d >>\nstream\n%s\nendstream"
+                                    (length stream) stream))))))
+    (dolist (object objects)
+      (setq number (1+ number))
+      (push (length pdf) offsets)
+      (setq pdf (concat pdf (format "%d 0 obj\n%s\nendobj\n" number object))))
+    (concat pdf
+            (format "xref\n0 %d\n0000000000 65535 f \n" (1+ number))
+            (mapconcat (lambda (offset) (format "%010d 00000 n \n" offset))
+                       (nreverse offsets) "")
+            (format "trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%d\n%%%%EOF\n"
+                    (1+ number) (length pdf)))))
+
+(defun epdf-test-write-pdf (file text &rest texts)
+  "Write a PDF with one page showing TEXT, and one more per TEXTS, to FILE."
+  (let ((coding-system-for-write 'no-conversion))
+    (write-region (apply #'epdf-test-pdf text texts) nil file nil 'silent)))
+
+(ert-deftest epdf-open-test ()
+  (let ((file (make-temp-file "epdf-open" nil ".pdf")))
+    (unwind-protect
+        (progn
+          (epdf-test-write-pdf file "open")
+          (should (user-ptrp (epdf-open file))))
+      (delete-file file)))
+  (should-error (epdf-open "/nonexistent/directory/document.pdf")
+                :type 'file-error)
+  (should-error (epdf-reload 'document) :type 'wrong-type-argument))
+
+(ert-deftest epdf-reload-test ()
+  (let ((file (make-temp-file "epdf-reload" nil ".pdf")))
+    (unwind-protect
+        (progn
+          (epdf-test-write-pdf file "first")
+          (let ((document (epdf-open file)))
+            ;; rewritten with the same contents
+            (epdf-test-write-pdf file "first")
+            (should-not (epdf-reload document))
+            (epdf-test-write-pdf file "second")
+            (should (user-ptrp (epdf-reload document)))))
+      (delete-file file))))
+
+;;
+;; Image tests.
+;;
+
+(ert-deftest epdf-image-ppm-test ()
+  (let* ((pixels [255 0 0 0 255 0 0 0 255 10 20 30])
+         (ppm (epdf-image-ppm pixels 2 2)))
+    (should-not (multibyte-string-p ppm))
+    (should (string-prefix-p "P6\n2 2\n255\n" ppm))
+    (should (equal (vconcat (substring ppm (length "P6\n2 2\n255\n")))
+                   pixels))
+    ;; the header is not rewritten on later calls
+    (should (equal (epdf-image-ppm pixels 2 2) ppm)))
+  (should-error (epdf-image-ppm [0 0 0] 2 2) :type 'args-out-of-range)
+  (should-error (epdf-image-ppm [0 0 256] 1 1) :type 'args-out-of-range)
+  (should-error (epdf-image-ppm [0 0 0] 0 1) :type 'args-out-of-range))
+
+(ert-deftest epdf-image-scale-test ()
+  (let ((pixels [255 0 0 0 255 0 0 0 255 10 20 30]))
+    (should (equal (epdf-image-scale pixels 2 2 2 2) pixels))
+    (should (= (length (epdf-image-scale pixels 2 2 5 3)) (* 5 3 3))))
+  ;; a uniform image stays uniform at any size
+  (let ((scaled (epdf-image-scale (make-vector (* 4 4 3) 128) 4 4 7 3)))
+    (should (equal scaled (make-vector (* 7 3 3) 128))))
+  (should-error (epdf-image-scale [0 0 0] 1 1 0 1) :type 'args-out-of-range))
+
+;;
+;; Recolor tests.
+;;
+
+(defun epdf-test-two-color (x foreground background)
+  "Return X blended between FOREGROUND and BACKGROUND like the scalar kernel."
+  (let ((tt (+ (* x background) (* (- 255 x) foreground) 128)))
+    (ash (+ tt (ash tt -8)) -8)))
+
+(ert-deftest epdf-image-recolor-test ()
+  ;; 100 x 3 pixels: vector kernels cover 48 byte blocks, the scalar
+  ;; kernel the 12 byte tail of every run
+  (let* ((width 100)
+         (height 3)
+         (pixels (make-vector (* width height 3) 0))
+         (foreground [30 60 90])
+         (background [250 240 200]))
+    (dotimes (i (length pixels))
+      (aset pixels i (% (* i 7) 256)))
+    (should (equal (epdf-image-recolor pixels width height nil) pixels))
+    (should (equal (epdf-image-recolor pixels width height 'invert)
+                   (vconcat (mapcar (lambda (x) (- 255 x)) pixels))))
+    (let ((expected (make-vector (length pixels) 0)))
+      (dotimes (i (length pixels))
+        (aset expected i (epdf-test-two-color (aref pixels i)
+                                              (aref foreground (% i 3))
+                                              (aref background (% i 3)))))
+      (should (equal (epdf-image-recolor pixels width height 'two-color
+                                         foreground background)
+                     expected))))
+  (should-error (epdf-image-recolor [0 0 0] 1 1 'sepia)
+                :type 'wrong-type-argument)
+  (should-error (epdf-image-recolor [0 0 0] 1 1 'two-color [0 0] [0 0 0])
+                :type 'args-out-of-range))
+
+;;
+;; Memory tests.
+;;
+
+(ert-deftest epdf-memory-stats-test ()
+  (let ((file (make-temp-file "epdf-memory" nil ".pdf")))
+    (unwind-protect
+        (progn
+          (epdf-test-write-pdf file "memory")
+          (let* ((document (epdf-open file))
+                 (stats (epdf-memory-stats document)))
+            (dolist (key '(:live :peak :limit :pooled :allocations :failed))
+              (should (natnump (plist-get stats key))))
+            (should (> (plist-get stats :live) 0))
+            (should (>= (plist-get stats :peak) (plist-get stats :live)))
+            (should (= (plist-get stats :limit) 0))
+            (should (eq (epdf-set-memory-limit document (* 64 1024 1024)) t))
+            (should (= (plist-get (epdf-memory-stats document) :limit)
+                       (* 64 1024 1024)))
+            (should-error (epdf-set-memory-limit document -1)
+                          :type 'args-out-of-range)))
+      (delete-file file)))
+  (should-error (epdf-memory-stats 'document) :type 'wrong-type-argument))
+
+(ert-deftest epdf-memory-limit-test ()
+  (let ((file (make-temp-file "epdf-memory" nil ".pdf")))
+    (unwind-protect
+        (progn
+          (epdf-test-write-pdf file "limit")
+          ;; far too little for a mupdf context
+          (epdf-set-default-memory-limit 1024)
+          (should-error (epdf-open file) :type 'file-error)
+          (epdf-set-default-memory-limit 0)
+          (should (user-ptrp (epdf-open file))))
+      (epdf-set-default-memory-limit 0)
+      (delete-file file))))
+
+;;
+;; Page export tests.
+;;
+
+(ert-deftest epdf-export-pages-test ()
+  (let ((file (make-temp-file "epdf-export" nil ".pdf"))
+        (directory (make-temp-file "epdf-export" t)))
+    (unwind-protect
+        (let* ((texts (mapcar #'number-to-string (number-sequence 1 12)))
+               (prefix (expand-file-name "page" directory))
+               document)
+          (apply #'epdf-test-write-pdf file texts)
+          (setq document (epdf-open file))
+          ;; pages are reported in page order however the workers finish
+          (should (equal (epdf-export-pages document prefix 0 11 0.25 'ppm t 4)
+                         (number-sequence 0 11)))
+          (dotimes (i 12)
+            (should (file-exists-p (format "%s-%02d.ppm" prefix (1+ i)))))
+          ;; unordered exports report every page once
+          (should (equal (sort (epdf-export-pages document prefix 2 5 0.25
+                                                  'png nil 3)
+                               #'<)
+                         (number-sequence 2 5)))
+          (should (file-exists-p (concat prefix "-3.png")))
+          (should-error (epdf-export-pages document prefix 5 2 0.25)
+                        :type 'args-out-of-range))
+      (delete-directory directory t)
+      (delete-file file))))
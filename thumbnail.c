@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "document.h"
+#include "image.h"
+#include "page.h"
+#include "render.h"
+#include "thumbnail.h"
+
+/* Number of thumbnails kept in memory, evicted in insertion order */
+#define THUMBNAIL_MEMORY_CACHE_SIZE 1024
+
+static struct
+{
+    GMutex lock;
+    GHashTable* images; /* thumbnail_key() -> epdf_image_buffer_t* */
+    GQueue keys; /* insertion order */
+} cache;
+
+typedef struct atlas_job_s
+{
+    GMutex lock;
+    epdf_document_t* document;
+    epdf_thumbnail_atlas_t* atlas;
+    unsigned int width;
+    unsigned int remaining;
+    epdf_error_t error;
+    epdf_thumbnail_callback_t callback;
+    void* data;
+} atlas_job_t;
+
+typedef struct thumbnail_job_s
+{
+    atlas_job_t* atlas_job;
+    char* key;
+    char* path;
+} thumbnail_job_t;
+
+/* Keys are "hash/width/page" for pages as they are in the file. Pages whose
+ * annotations or form fields were changed are keyed by their fingerprint as
+ * "page-fingerprint/width", or NULL if it is not available and the thumbnail
+ * can not be cached. */
+static char*
+thumbnail_key(epdf_page_t* page, unsigned int width)
+{
+    const bool edited   = g_atomic_int_get(&epdf_page_get_source(page)->annotations_revision) != 0;
+    const uint8_t* hash = edited == true ? epdf_page_get_fingerprint(page, NULL) :
+        epdf_document_get_hash(epdf_page_get_document(page));
+    if (hash == NULL) {
+        return NULL;
+    }
+
+    char hex[65];
+    for (unsigned int i = 0; i < 32; i++) {
+        g_snprintf(hex + 2 * i, 3, "%02x", hash[i]);
+    }
+
+    if (edited == true) {
+        return g_strdup_printf("page-%s/%u", hex, width);
+    }
+
+    return g_strdup_printf("%s/%u/%u", hex, width, epdf_page_get_index(page));
+}
+
+static char*
+thumbnail_path(const char* key)
+{
+    char* file = g_strconcat(key, ".ppm", NULL);
+    char* path = g_build_filename(g_get_user_cache_dir(), "epdf", "thumbnails", file, NULL);
+    g_free(file);
+
+    return path;
+}
+
+static epdf_image_buffer_t*
+thumbnail_load(const char* path)
+{
+    FILE* f = g_fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    unsigned int width  = 0;
+    unsigned int height = 0;
+    epdf_image_buffer_t* image = NULL;
+
+    if (fscanf(f, "P6 %u %u 255", &width, &height) == 2 && fgetc(f) == '\n') {
+        image = epdf_image_buffer_create(width, height);
+        if (image != NULL &&
+            fread(image->data, image->rowstride, height, f) != height) {
+            epdf_image_buffer_free(image);
+            image = NULL;
+        }
+    }
+
+    fclose(f);
+
+    return image;
+}
+
+static void
+thumbnail_store(const char* path, epdf_image_buffer_t* image)
+{
+    char* dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    size_t size = 0;
+    const unsigned char* ppm = epdf_image_buffer_get_ppm(image, &size);
+    if (ppm != NULL) {
+        g_file_set_contents(path, (const gchar*) ppm, size, NULL);
+    }
+}
+
+static void
+cache_insert(char* key, epdf_image_buffer_t* image)
+{
+    g_mutex_lock(&cache.lock);
+
+    if (cache.images == NULL) {
+        cache.images = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify) epdf_image_buffer_free);
+    }
+
+    if (g_hash_table_contains(cache.images, key) == TRUE) {
+        g_free(key);
+        epdf_image_buffer_free(image);
+    } else {
+        if (g_queue_get_length(&cache.keys) >= THUMBNAIL_MEMORY_CACHE_SIZE) {
+            g_hash_table_remove(cache.images, g_queue_pop_head(&cache.keys));
+        }
+        g_hash_table_insert(cache.images, key, image);
+        g_queue_push_tail(&cache.keys, key);
+    }
+
+    g_mutex_unlock(&cache.lock);
+}
+
+/* Copies image into the cell of page index. Called with the job lock held. */
+static void
+atlas_blit(epdf_thumbnail_atlas_t* atlas, unsigned int index, const epdf_image_buffer_t* image)
+{
+    const unsigned int cell = index - atlas->first_page;
+    const unsigned int x    = (cell % atlas->columns) * atlas->cell_width;
+    const unsigned int y    = (cell / atlas->columns) * atlas->cell_height;
+    const unsigned int w    = MIN(image->width, atlas->cell_width);
+    const unsigned int h    = MIN(image->height, atlas->cell_height);
+
+    for (unsigned int row = 0; row < h; row++) {
+        memcpy(atlas->image->data + (gsize) (y + row) * atlas->image->rowstride + x * 3,
+               image->data + (gsize) row * image->rowstride, w * 3);
+    }
+}
+
+static bool
+cache_blit(const char* key, epdf_thumbnail_atlas_t* atlas, unsigned int index)
+{
+    g_mutex_lock(&cache.lock);
+
+    epdf_image_buffer_t* image = cache.images != NULL ? g_hash_table_lookup(cache.images, key) : NULL;
+    if (image != NULL) {
+        atlas_blit(atlas, index, image);
+    }
+
+    g_mutex_unlock(&cache.lock);
+
+    return image != NULL;
+}
+
+/* Drops one outstanding thumbnail and hands out the atlas with the last one */
+static void
+atlas_job_release(atlas_job_t* job)
+{
+    g_mutex_lock(&job->lock);
+    const bool done = --job->remaining == 0;
+    g_mutex_unlock(&job->lock);
+
+    if (done == false) {
+        return;
+    }
+
+    if (job->error != EPDF_ERROR_OK) {
+        epdf_thumbnail_atlas_free(job->atlas);
+        job->atlas = NULL;
+    }
+
+    job->callback(job->document, job->atlas, job->error, job->data);
+
+    epdf_document_free(job->document);
+    g_mutex_clear(&job->lock);
+    g_free(job);
+}
+
+/* Runs on the render worker: the disk cache is read off the calling thread */
+static epdf_image_buffer_t*
+thumbnail_render(epdf_page_t* page, double scale, unsigned int rotation, void* data,
+                 epdf_error_t* error)
+{
+    thumbnail_job_t* job = data;
+
+    epdf_image_buffer_t* image = job->path != NULL ? thumbnail_load(job->path) : NULL;
+    if (image == NULL) {
+        image = epdf_page_render_image(page, scale, rotation, NULL, error);
+        if (image != NULL && job->path != NULL) {
+            thumbnail_store(job->path, image);
+        }
+    }
+
+    return image;
+}
+
+static void
+thumbnail_done(epdf_page_t* page, epdf_image_buffer_t* image, epdf_error_t error, void* data)
+{
+    thumbnail_job_t* job     = data;
+    atlas_job_t* atlas_job   = job->atlas_job;
+
+    g_mutex_lock(&atlas_job->lock);
+    if (image != NULL) {
+        atlas_blit(atlas_job->atlas, epdf_page_get_index(page), image);
+    } else {
+        atlas_job->error = error;
+    }
+    g_mutex_unlock(&atlas_job->lock);
+
+    if (image != NULL && job->key != NULL) {
+        cache_insert(job->key, image);
+    } else {
+        g_free(job->key);
+        epdf_image_buffer_free(image);
+    }
+
+    g_free(job->path);
+    g_free(job);
+
+    atlas_job_release(atlas_job);
+}
+
+epdf_error_t
+epdf_thumbnail_atlas_render(epdf_document_t* document, unsigned int first_page,
+                            unsigned int number_of_pages, unsigned int columns,
+                            unsigned int width, epdf_thumbnail_callback_t callback, void* data)
+{
+    const unsigned int total = epdf_document_get_number_of_pages(document);
+    if (document == NULL || callback == NULL || columns == 0 || width == 0 ||
+        first_page >= total || number_of_pages == 0 || document->cell_width <= 0.0) {
+        return EPDF_ERROR_INVALID_ARGUMENTS;
+    }
+
+    number_of_pages = MIN(number_of_pages, total - first_page);
+    columns         = MIN(columns, number_of_pages);
+
+    epdf_thumbnail_atlas_t* atlas = g_try_malloc0(sizeof(epdf_thumbnail_atlas_t));
+    if (atlas == NULL) {
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+
+    atlas->first_page      = first_page;
+    atlas->number_of_pages = number_of_pages;
+    atlas->columns         = columns;
+    atlas->cell_width      = width;
+    atlas->cell_height     = ceil(width * document->cell_height / document->cell_width);
+
+    const unsigned int rows = (number_of_pages + columns - 1) / columns;
+    atlas->image = epdf_image_buffer_create(columns * atlas->cell_width, rows * atlas->cell_height);
+    if (atlas->image == NULL) {
+        g_free(atlas);
+        return EPDF_ERROR_OUT_OF_MEMORY;
+    }
+    memset(atlas->image->data, 0xff, (gsize) atlas->image->rowstride * atlas->image->height);
+
+    atlas_job_t* job = g_malloc0(sizeof(atlas_job_t));
+    g_mutex_init(&job->lock);
+    job->document  = epdf_document_ref(document);
+    job->atlas     = atlas;
+    job->width     = width;
+    job->error     = EPDF_ERROR_OK;
+    job->callback  = callback;
+    job->data      = data;
+    /* one extra reference so the atlas is not handed out while submitting */
+    job->remaining = number_of_pages + 1;
+
+    for (unsigned int index = first_page; index < first_page + number_of_pages; index++) {
+        epdf_page_t* page = epdf_document_get_page(document, index);
+
+        char* key = thumbnail_key(page, width);
+        if (key != NULL && cache_blit(key, atlas, index) == true) {
+            g_free(key);
+            atlas_job_release(job);
+            continue;
+        }
+
+        thumbnail_job_t* thumbnail_job = g_malloc0(sizeof(thumbnail_job_t));
+        thumbnail_job->atlas_job = job;
+        thumbnail_job->key       = key;
+        thumbnail_job->path      = key != NULL ? thumbnail_path(key) : NULL;
+
+        epdf_render_request_t request = {
+            .page     = page,
+            .scale    = width / epdf_page_get_width(page),
+            .rotation = 0,
+            .lane     = EPDF_RENDER_LANE_THUMBNAIL,
+            .render   = thumbnail_render,
+            .callback = thumbnail_done,
+            .data     = thumbnail_job
+        };
+
+        epdf_error_t error = epdf_render_submit(&request);
+        if (error != EPDF_ERROR_OK) {
+            g_mutex_lock(&job->lock);
+            job->error = error;
+            g_mutex_unlock(&job->lock);
+            g_free(thumbnail_job->key);
+            g_free(thumbnail_job->path);
+            g_free(thumbnail_job);
+            atlas_job_release(job);
+        }
+    }
+
+    atlas_job_release(job);
+
+    return EPDF_ERROR_OK;
+}
+
+void
+epdf_thumbnail_atlas_free(epdf_thumbnail_atlas_t* atlas)
+{
+    if (atlas == NULL) {
+        return;
+    }
+
+    epdf_image_buffer_free(atlas->image);
+    g_free(atlas);
+}
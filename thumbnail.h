@@ -0,0 +1,61 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include "macros.h"
+#include "types.h"
+
+/**
+ * Thumbnail atlas: the thumbnails of a page range packed into one image, row
+ * by row. The thumbnail of page first_page + i is in column i % columns and
+ * row i / columns.
+ */
+typedef struct epdf_thumbnail_atlas_s
+{
+    epdf_image_buffer_t* image; /**< Atlas image */
+    unsigned int first_page; /**< Index of the first page */
+    unsigned int number_of_pages; /**< Number of pages in the atlas */
+    unsigned int columns; /**< Number of columns */
+    unsigned int cell_width; /**< Width of a cell in pixels */
+    unsigned int cell_height; /**< Height of a cell in pixels */
+} epdf_thumbnail_atlas_t;
+
+/**
+ * Callback invoked when an atlas is complete. It is invoked from a render
+ * worker, or from the calling thread if all thumbnails were in the memory
+ * cache.
+ *
+ * @param document The document
+ * @param atlas The atlas (free with epdf_thumbnail_atlas_free) or NULL
+ * @param error EPDF_ERROR_OK if all thumbnails have been rendered
+ * @param data Custom data
+ */
+typedef void (*epdf_thumbnail_callback_t)(epdf_document_t* document,
+    epdf_thumbnail_atlas_t* atlas, epdf_error_t error, void* data);
+
+/**
+ * Builds a thumbnail atlas of a page range. Thumbnails come from the memory
+ * cache, the disk cache (keyed by the document hash) or are rendered from the
+ * display lists on the thumbnail lane of the render scheduler.
+ *
+ * @param document The document
+ * @param first_page Index of the first page
+ * @param number_of_pages Number of pages
+ * @param columns Number of columns of the atlas
+ * @param width Width of a thumbnail in pixels
+ * @param callback Callback invoked with the atlas
+ * @param data Custom data passed to callback
+ * @return EPDF_ERROR_OK if the atlas is being built, otherwise see
+ *    epdf_error_t
+ */
+EPDF_PLUGIN_API epdf_error_t epdf_thumbnail_atlas_render(epdf_document_t* document,
+    unsigned int first_page, unsigned int number_of_pages, unsigned int columns,
+    unsigned int width, epdf_thumbnail_callback_t callback, void* data);
+
+/**
+ * Frees the atlas
+ *
+ * @param atlas The atlas
+ */
+EPDF_PLUGIN_API void epdf_thumbnail_atlas_free(epdf_thumbnail_atlas_t* atlas);
+
+#endif // THUMBNAIL_H
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "trace.h"
+
+/* Events per thread, older ones are overwritten */
+#define TRACE_RING_SIZE 16384
+
+typedef struct trace_event_s
+{
+    const char* name;
+    int64_t start;
+    int64_t duration;
+} trace_event_t;
+
+/* Single producer ring, written by its thread only. head counts all events
+ * ever written and is published after the event. */
+typedef struct trace_ring_s
+{
+    unsigned int tid;
+    guint64 head;
+    guint64 cleared; /* events before this index have been discarded */
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+static int enabled = 0;
+
+static void trace_ring_release(gpointer data);
+
+/* Rings of all threads that recorded a span, never freed. The ring of an
+ * exited thread keeps its events and is handed to the next new thread. */
+static GMutex rings_lock;
+static GPtrArray* rings      = NULL;
+static GPtrArray* free_rings = NULL;
+
+static GPrivate thread_ring = G_PRIVATE_INIT(trace_ring_release);
+
+void
+epdf_trace_set_enabled(bool enable)
+{
+    g_atomic_int_set(&enabled, enable == true ? 1 : 0);
+}
+
+bool
+epdf_trace_get_enabled(void)
+{
+    return g_atomic_int_get(&enabled) != 0;
+}
+
+epdf_trace_span_t
+epdf_trace_span_begin(const char* name)
+{
+    epdf_trace_span_t span = { NULL, 0 };
+
+    if (__atomic_load_n(&enabled, __ATOMIC_RELAXED) != 0) {
+        span.name  = name;
+        span.start = g_get_monotonic_time();
+    }
+
+    return span;
+}
+
+/* Invoked when a thread that recorded a span exits */
+static void
+trace_ring_release(gpointer data)
+{
+    g_mutex_lock(&rings_lock);
+    if (free_rings == NULL) {
+        free_rings = g_ptr_array_new();
+    }
+    g_ptr_array_add(free_rings, data);
+    g_mutex_unlock(&rings_lock);
+}
+
+static trace_ring_t*
+trace_ring_get(void)
+{
+    trace_ring_t* ring = g_private_get(&thread_ring);
+    if (ring != NULL) {
+        return ring;
+    }
+
+    g_mutex_lock(&rings_lock);
+    if (free_rings != NULL && free_rings->len > 0) {
+        ring = g_ptr_array_remove_index_fast(free_rings, free_rings->len - 1);
+    } else {
+        ring = g_try_malloc0(sizeof(trace_ring_t));
+        if (ring != NULL) {
+            if (rings == NULL) {
+                rings = g_ptr_array_new();
+            }
+            ring->tid = rings->len + 1;
+            g_ptr_array_add(rings, ring);
+        }
+    }
+    g_mutex_unlock(&rings_lock);
+
+    if (ring != NULL) {
+        g_private_set(&thread_ring, ring);
+    }
+
+    return ring;
+}
+
+void
+epdf_trace_span_end(epdf_trace_span_t* span)
+{
+    if (span == NULL || span->name == NULL) {
+        return;
+    }
+
+    trace_ring_t* ring = trace_ring_get();
+    if (ring == NULL) {
+        return;
+    }
+
+    const guint64 head   = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    trace_event_t* event = &ring->events[head % TRACE_RING_SIZE];
+    event->name     = span->name;
+    event->start    = span->start;
+    event->duration = g_get_monotonic_time() - span->start;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Copies the events of a ring that were not overwritten while copying */
+static void
+trace_ring_write(FILE* file, trace_ring_t* ring, bool* first)
+{
+    trace_event_t* events = g_try_new(trace_event_t, TRACE_RING_SIZE);
+    if (events == NULL) {
+        return;
+    }
+
+    const guint64 head  = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    const guint64 begin = MAX(head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0, ring->cleared);
+    for (guint64 i = begin; i < head; i++) {
+        events[i - begin] = ring->events[i % TRACE_RING_SIZE];
+    }
+
+    /* slots the writer reused meanwhile hold newer events, skip them. The
+     * writer may also be filling the slot of event now - TRACE_RING_SIZE. */
+    const guint64 now  = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    const guint64 safe = now >= TRACE_RING_SIZE ? MAX(begin, now - TRACE_RING_SIZE + 1) : begin;
+
+    for (guint64 i = safe; i < head; i++) {
+        const trace_event_t* event = &events[i - begin];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT
+                ",\"pid\":1,\"tid\":%u}", *first == true ? "" : ",", event->name, (gint64) event->start,
+                (gint64) event->duration, ring->tid);
+        *first = false;
+    }
+
+    g_free(events);
+}
+
+bool
+epdf_trace_dump(const char* path)
+{
+    if (path == NULL) {
+        return false;
+    }
+
+    FILE* file = g_fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+    g_mutex_lock(&rings_lock);
+    for (unsigned int i = 0; rings != NULL && i < rings->len; i++) {
+        trace_ring_write(file, g_ptr_array_index(rings, i), &first);
+    }
+    g_mutex_unlock(&rings_lock);
+
+    fputs("\n]}\n", file);
+
+    return fclose(file) == 0;
+}
+
+void
+epdf_trace_clear(void)
+{
+    g_mutex_lock(&rings_lock);
+    for (unsigned int i = 0; rings != NULL && i < rings->len; i++) {
+        trace_ring_t* ring = g_ptr_array_index(rings, i);
+        ring->cleared = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+    g_mutex_unlock(&rings_lock);
+}
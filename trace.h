@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+/**
+ * Span of a trace, see EPDF_TRACE_SPAN
+ */
+typedef struct epdf_trace_span_s
+{
+    const char* name; /**< Name of the span, NULL if tracing is disabled */
+    int64_t start; /**< Monotonic start time in microseconds */
+} epdf_trace_span_t;
+
+/**
+ * Enables or disables tracing. Tracing is off by default; disabled spans only
+ * cost a relaxed load of a flag.
+ *
+ * @param enabled true to record spans
+ */
+EPDF_PLUGIN_API void epdf_trace_set_enabled(bool enabled);
+
+/**
+ * Returns whether spans are recorded
+ *
+ * @return true if tracing is enabled
+ */
+EPDF_PLUGIN_API bool epdf_trace_get_enabled(void);
+
+/**
+ * Starts a span
+ *
+ * @param name Name of the span, must be a string literal
+ * @return The span
+ */
+EPDF_PLUGIN_API epdf_trace_span_t epdf_trace_span_begin(const char* name);
+
+/**
+ * Ends a span and records it into the ring buffer of the calling thread
+ *
+ * @param span The span
+ */
+EPDF_PLUGIN_API void epdf_trace_span_end(epdf_trace_span_t* span);
+
+/**
+ * Writes the recorded spans of all threads as Chrome trace JSON, which can be
+ * loaded into Perfetto or chrome://tracing. Every thread keeps its most
+ * recent spans only, a thread that exited hands its spans on to the next
+ * new thread, which reports them under the same id.
+ *
+ * @param path The target file
+ * @return true if the file has been written
+ */
+EPDF_PLUGIN_API bool epdf_trace_dump(const char* path);
+
+/**
+ * Discards the recorded spans
+ */
+EPDF_PLUGIN_API void epdf_trace_clear(void);
+
+#define EPDF_TRACE_CONCAT_(a, b) a ## b
+#define EPDF_TRACE_CONCAT(a, b) EPDF_TRACE_CONCAT_(a, b)
+
+/**
+ * Records a span from here to the end of the enclosing scope
+ */
+#define EPDF_TRACE_SPAN(name)                                                   \
+    epdf_trace_span_t EPDF_TRACE_CONCAT(trace_span_, __LINE__)                  \
+        __attribute__((cleanup(epdf_trace_span_end))) = epdf_trace_span_begin(name)
+
+#endif // TRACE_H
@@ -1,6 +1,7 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <glib.h>
 #include <mupdf/fitz.h>
 #include <mupdf/pdf.h>
 /**
@@ -24,6 +25,141 @@ typedef struct epdf_device_factors_s
   double y;
 } epdf_device_factors_t;
 
+/**
+ * Rectangle in page coordinates (points)
+ */
+typedef struct epdf_rectangle_s
+{
+  double x1; /**< X coordinate of the top left corner */
+  double y1; /**< Y coordinate of the top left corner */
+  double x2; /**< X coordinate of the bottom right corner */
+  double y2; /**< Y coordinate of the bottom right corner */
+} epdf_rectangle_t;
+
+
+/**
+ * Recolor modes
+ */
+typedef enum epdf_recolor_mode_e
+{
+    EPDF_RECOLOR_NONE, /**< Keep colours */
+    EPDF_RECOLOR_INVERT, /**< Invert all channels */
+    EPDF_RECOLOR_TWO_COLOR, /**< Map white to background and black to foreground, per channel */
+} epdf_recolor_mode_t;
+
+/**
+ * Pixel post-processing applied to rendered pages
+ */
+typedef struct epdf_recolor_s
+{
+  epdf_recolor_mode_t mode; /**< Recolor mode */
+  uint8_t foreground[3]; /**< RGB foreground of EPDF_RECOLOR_TWO_COLOR */
+  uint8_t background[3]; /**< RGB background of EPDF_RECOLOR_TWO_COLOR */
+  double gamma; /**< Gamma correction, 1.0 for none */
+  double contrast; /**< Contrast around mid-grey, 1.0 for none */
+} epdf_recolor_t;
+
+/**
+ * Annotation types
+ */
+typedef enum epdf_annotation_type_e
+{
+    EPDF_ANNOTATION_UNKNOWN, /**< Any type not listed here, read only */
+    EPDF_ANNOTATION_TEXT, /**< Sticky note */
+    EPDF_ANNOTATION_FREE_TEXT, /**< Text written on the page */
+    EPDF_ANNOTATION_HIGHLIGHT, /**< Highlighted text */
+    EPDF_ANNOTATION_UNDERLINE, /**< Underlined text */
+    EPDF_ANNOTATION_STRIKE_OUT, /**< Struck out text */
+    EPDF_ANNOTATION_SQUARE, /**< Rectangle */
+    EPDF_ANNOTATION_CIRCLE, /**< Ellipse */
+} epdf_annotation_type_t;
+
+/**
+ * Annotation of a page
+ */
+typedef struct epdf_annotation_s
+{
+  int id; /**< Identifier, unique within the document, or -1 for new annotations */
+  epdf_annotation_type_t type; /**< Type */
+  epdf_rectangle_t rectangle; /**< Area on the page (points) */
+  float color[3]; /**< RGB colour, components from 0 to 1 */
+  float opacity; /**< Opacity from 0 to 1 */
+  char* contents; /**< Text of the annotation or NULL */
+} epdf_annotation_t;
+
+/**
+ * Form field types
+ */
+typedef enum epdf_form_field_type_e
+{
+    EPDF_FORM_FIELD_UNKNOWN, /**< Unknown or unsupported field */
+    EPDF_FORM_FIELD_TEXT, /**< Text field */
+    EPDF_FORM_FIELD_CHECK_BOX, /**< Check box */
+    EPDF_FORM_FIELD_RADIO_BUTTON, /**< Radio button */
+    EPDF_FORM_FIELD_COMBO_BOX, /**< Combo box */
+    EPDF_FORM_FIELD_LIST_BOX, /**< List box */
+    EPDF_FORM_FIELD_PUSH_BUTTON, /**< Push button, has no value */
+    EPDF_FORM_FIELD_SIGNATURE, /**< Signature field */
+} epdf_form_field_type_t;
+
+/**
+ * Widget of a form field on a page
+ */
+typedef struct epdf_form_field_s
+{
+  int id; /**< Identifier of the widget, unique within the document */
+  epdf_form_field_type_t type; /**< Type */
+  epdf_rectangle_t rectangle; /**< Area on the page (points) */
+  char* name; /**< Fully qualified name of the field */
+  char* value; /**< Value or NULL; check boxes and radio buttons are "Off" or
+                    their on state */
+  bool read_only; /**< If the value can not be changed */
+} epdf_form_field_t;
+
+/**
+ * Measured cost of rendering a page
+ */
+typedef struct epdf_render_cost_s
+{
+  double milliseconds; /**< Render time, moving average */
+  uint64_t objects; /**< Objects processed (fz_cookie progress) by the last render */
+  double scale; /**< Scale of the last render */
+  unsigned int renders; /**< Number of measured renders, 0 if unknown */
+} epdf_render_cost_t;
+
+typedef struct epdf_file_watch_s epdf_file_watch_t;
+typedef struct epdf_s epdf_t;
+typedef struct epdf_plugin_s epdf_plugin_t;
+typedef struct epdf_image_s epdf_image_t;
+
+/**
+ * Page size and font size reflowable documents (EPUB, FictionBook, XHTML) are
+ * laid out with
+ */
+typedef struct epdf_reflow_s
+{
+  double width; /**< Page width in points, 0 to keep the layout of the backend */
+  double height; /**< Page height in points */
+  double em; /**< Font size in points, 0 for the default */
+} epdf_reflow_t;
+
+/**
+ * Open options
+ */
+typedef struct epdf_open_options_s
+{
+  uint64_t store_size; /**< Size of the resource store in bytes or 0 for the default */
+  bool mmap; /**< Map the file into memory instead of reading it. The file must not be
+                truncated or rewritten in place while open, reading a mapped page that
+                is gone raises SIGBUS; replacing it is fine. Files that are rewritten
+                in place, e.g. by LaTeX, must be read instead: documents opened with
+                this option can not be reloaded (see epdf_reload_new). */
+  bool progressive; /**< Open a file that is still being written and load its pages as they
+                       arrive, see epdf_document_update. Takes precedence over mmap. */
+  epdf_reflow_t reflow; /**< Layout of reflowable documents. Pages are counted in the background
+                           and become available through epdf_document_update; the counts
+                           are cached per file and layout. Ignored for progressive opens. */
+} epdf_open_options_t;
 
 /**
  * Document
@@ -33,12 +169,13 @@ typedef struct epdf_document_s {
     char* uri; /**< URI of the document */
     char* basename; /**< Basename of the document */
     uint8_t hash_sha256[32]; /**< SHA256 hash of the document */
-    const char* password; /**< Password of the document */
+    char* password; /**< Password of the document */
     unsigned int current_page_number; /**< Current page number */
     unsigned int number_of_pages; /**< Number of pages */
     double zoom; /**< Zoom value */
     unsigned int rotate; /**< Rotation */
     void* data; /**< Custom data */
+    epdf_plugin_t* plugin; /**< Backend the document has been opened with */
     epdf_adjust_mode_t adjust_mode; /**< Adjust mode (best-fit, width) */
     int page_offset; /**< Page offset */
     double cell_width; /**< width of a page cell in the document (not transformed by scale and rotation) */
@@ -52,11 +189,25 @@ typedef struct epdf_document_s {
     unsigned int page_padding; /**< padding between pages */
     double position_x; /**< X adjustment */
     double position_y; /**< Y adjustment */
+    epdf_recolor_t recolor; /**< Post-processing of rendered pages */
+    unsigned int ref_count; /**< Number of references to this document */
+    struct epdf_document_s* source; /**< Document of an earlier opener whose backend data, pages and
+                                         renderings this one shares, or NULL if it owns them */
+    int generation; /**< Bumped whenever zoom, rotation, viewport or position change */
+    epdf_open_options_t open_options; /**< Options the document has been opened with */
+    int64_t file_size; /**< Size of the file when it was opened */
+    int64_t file_mtime; /**< Modification time of the file (ns) when it was opened */
+    epdf_render_cost_t* render_costs; /**< Render cost per page */
+    GMappedFile* mapping; /**< Mapping of the file if opened with the mmap option, or NULL */
+    unsigned int ready_pages; /**< Number of leading pages that have been loaded */
+    bool complete; /**< The file has been written completely */
+    epdf_file_watch_t* watch; /**< Watches a progressively opened file while it grows */
+    int file_changed; /**< Set by watch when the file has been written to */
 
     /**
      * Document pages
      */
-    epdf_page_t** pages;
+    struct epdf_page_s** pages;
 
 } epdf_document_t;
 
@@ -69,7 +220,14 @@ typedef struct epdf_page_s {
     unsigned int index; /**< Page number */
     void* data; /**< Custom data */
     bool visible; /**< Page is visible */
+    bool changed; /**< Content differs from the previously opened revision */
+    int annotations_revision; /**< Bumped whenever an annotation of the page changes */
+    bool has_fingerprint; /**< If fingerprint has already been computed */
+    int fingerprint_revision; /**< annotations_revision fingerprint was computed at */
+    uint8_t fingerprint[32]; /**< SHA256 over the page's content objects */
     epdf_document_t* document; /**< Document */
+    struct epdf_page_s* source; /**< Page of an earlier opener whose backend data this page shares,
+                                     or NULL if it owns it */
 } epdf_page_t;
 
 /**
@@ -82,23 +240,167 @@ typedef enum epdf_plugin_error_e
   EPDF_ERROR_OUT_OF_MEMORY, /**< Out of memory */
   EPDF_ERROR_NOT_IMPLEMENTED, /**< The called function has not been implemented */
   EPDF_ERROR_INVALID_ARGUMENTS, /**< Invalid arguments have been passed */
-  EPDF_ERROR_INVALID_PASSWORD /**< The provided password is invalid */
+  EPDF_ERROR_INVALID_PASSWORD, /**< The provided password is invalid */
+  EPDF_ERROR_CANCELED, /**< The operation has been superseded or canceled */
+  EPDF_ERROR_TRY_LATER /**< The data has not been written yet */
 } epdf_error_t;
 
+/**
+ * Progress callback for long running operations
+ *
+ * @param done Number of bytes processed so far
+ * @param total Expected number of bytes or 0 if unknown
+ * @param data Custom data
+ */
+typedef void (*epdf_progress_callback_t)(uint64_t done, uint64_t total, void* data);
+
+/**
+ * Save options
+ */
+typedef struct epdf_save_options_s
+{
+  bool incremental; /**< Only append changed objects (falls back to a full save) */
+  epdf_progress_callback_t progress; /**< Progress callback or NULL */
+  void* progress_data; /**< Custom data passed to progress */
+} epdf_save_options_t;
+
+/**
+ * Export options
+ */
+typedef struct epdf_export_options_s
+{
+  bool garbage_collect; /**< Drop unused objects and compact the xref */
+  bool deduplicate; /**< Merge duplicate objects and streams (implies garbage_collect) */
+  bool compress; /**< Compress streams, images and fonts */
+  bool linearize; /**< Linearize for fast web view */
+  epdf_progress_callback_t progress; /**< Progress callback or NULL */
+  void* progress_data; /**< Custom data passed to progress */
+} epdf_export_options_t;
+
+/**
+ * Export result
+ */
+typedef struct epdf_export_result_s
+{
+  epdf_error_t error; /**< Error of the export */
+  uint64_t input_size; /**< Size of the original file in bytes */
+  uint64_t output_size; /**< Size of the exported file in bytes */
+  double elapsed; /**< Time taken in seconds */
+} epdf_export_result_t;
+
+/**
+ * Image buffer holding packed RGB pixels
+ */
+typedef struct epdf_image_buffer_s
+{
+  unsigned char* memory; /**< Allocation, with room for an image header before data */
+  unsigned char* data; /**< Pixel data */
+  unsigned char* ppm; /**< PPM header, written once in front of data */
+  unsigned int width; /**< Width in pixels */
+  unsigned int height; /**< Height in pixels */
+  unsigned int rowstride; /**< Bytes per row */
+  int ref_count; /**< Reference count, images may be shared by caches */
+} epdf_image_buffer_t;
+
+/**
+ * Attachment
+ */
+typedef struct epdf_attachment_s
+{
+  char* name; /**< Name of the attachment */
+  char* filename; /**< File name stored with the attachment */
+  int64_t size; /**< Size of the attached file in bytes or -1 if unknown */
+  int64_t stored_size; /**< Size of the (compressed) data in the document */
+} epdf_attachment_t;
+
+/**
+ * Memory statistics of a document
+ */
+typedef struct epdf_memory_stats_s
+{
+  uint64_t live; /**< Bytes currently allocated */
+  uint64_t peak; /**< Maximum of live */
+  uint64_t limit; /**< Hard limit of live or 0 if unlimited */
+  uint64_t pooled; /**< Bytes reserved by the small allocation pools */
+  uint64_t allocations; /**< Number of allocations */
+  uint64_t failed; /**< Number of allocations refused by the limit */
+} epdf_memory_stats_t;
+
+/**
+ * Resource store statistics of a document. mupdf does not report the fill
+ * level of its store or the items it evicts on its own, so everything but max
+ * is measured by the document's allocator and its explicit shrinks.
+ */
+typedef struct epdf_store_stats_s
+{
+  uint64_t max; /**< Maximum size of the store in bytes */
+  uint64_t allocated; /**< Bytes allocated by the document, the store is a part of them */
+  uint64_t shrinks; /**< Number of times the store has been shrunk explicitly */
+  uint64_t released; /**< Allocated bytes freed by explicit shrinks */
+  uint64_t refused; /**< Allocations refused by the memory limit after mupdf scavenged the store */
+} epdf_store_stats_t;
+
+typedef struct epdf_allocator_s epdf_allocator_t;
+typedef struct mupdf_progressive_s mupdf_progressive_t;
+typedef struct mupdf_reflow_s mupdf_reflow_t;
+
+/**
+ * Document formats read through mupdf's document handlers
+ */
+typedef enum mupdf_format_e
+{
+    MUPDF_FORMAT_PDF, /**< PDF */
+    MUPDF_FORMAT_XPS, /**< XPS and OpenXPS */
+    MUPDF_FORMAT_EPUB, /**< EPUB and the other reflowable formats (FB2, XHTML) */
+    MUPDF_FORMAT_CBZ, /**< Comic book archive, one image per page */
+    MUPDF_FORMAT_IMAGE, /**< Single image, or one page per frame of a TIFF */
+    MUPDF_FORMAT_OTHER /**< Other fixed layout formats, e.g. SVG */
+} mupdf_format_t;
 
 typedef struct mupdf_document_s
 {
   fz_context* ctx; /**< Context */
   fz_document* document; /**< mupdf document */
+  GMutex lock; /**< Serializes access to document across threads */
+  GMutex locks[FZ_LOCK_MAX]; /**< Locks handed to mupdf */
+  fz_locks_context locks_context; /**< Locks context of ctx */
+  epdf_allocator_t* allocator; /**< Allocator of ctx */
+  uint64_t store_size; /**< Maximum size of the store of ctx */
+  uint64_t store_shrinks; /**< Number of times the store has been shrunk */
+  uint64_t store_released; /**< Allocated bytes freed by shrinking the store */
+  mupdf_progressive_t* progressive; /**< Stream of a file still being written, or NULL */
+  mupdf_format_t format; /**< Format of document */
+  mupdf_reflow_t* reflow; /**< Chapters of a reflowed document being counted, or NULL */
+  bool rewritten; /**< The file has been replaced by a full save, later saves can not append
+                       to it */
 } mupdf_document_t;
 
+/**
+ * Entry of the widget index of a page
+ */
+typedef struct mupdf_widget_s
+{
+  fz_rect rect; /**< Bounds of the widget */
+  float bottom; /**< Largest y1 of this and all preceding entries */
+  pdf_widget* widget; /**< The widget, owned by the page */
+} mupdf_widget_t;
+
 typedef struct mupdf_page_s
 {
-  fz_page* page; /**< Reference to the mupdf page */
+  fz_page* page; /**< Reference to the mupdf page, loaded on first use in reflowed documents */
+  unsigned int index; /**< Index of the page */
   fz_context* ctx; /**< Context */
   fz_stext_page* text; /**< Page text */
+  fz_display_list* list; /**< Display list of the page contents, recorded on first render */
+  fz_display_list* annotations; /**< Display list of annotations and widgets, recorded on first
+                                     render and dropped when they change */
   fz_rect bbox; /**< Bbox */
   bool extracted_text; /**< If text has already been extracted */
+  size_t text_size; /**< Bytes held by the extracted text */
+  mupdf_widget_t* widgets; /**< Widgets sorted by top edge, built when the page is first
+                                rendered or hit-tested */
+  unsigned int widgets_number; /**< Number of entries in widgets */
+  bool indexed_widgets; /**< If widgets has been built */
 } mupdf_page_t;
 
 